@@ -3,6 +3,7 @@ LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 
 BUILD_IPC-MODEMCTRL := true
+BUILD_MOCHA-TESTS := false
 DEBUG := true
 
 LOCAL_MODULE := libmocha-ipc
@@ -120,11 +121,19 @@ mocha-ril_files := \
 	mocha-ril/misc.c \
 	mocha-ril/network.c \
 	mocha-ril/sim.c \
+	mocha-ril/sim_store.c \
+	mocha-ril/sim_cache.c \
+	mocha-ril/sim_prefetch.c \
 	mocha-ril/sms.c \
+	mocha-ril/outbox.c \
+	mocha-ril/cbs.c \
+	mocha-ril/stk.c \
 	mocha-ril/ss.c \
 	mocha-ril/snd.c \
 	mocha-ril/gprs.c \
 	mocha-ril/gps.c \
+	mocha-ril/gsm7.c \
+	mocha-ril/hex.c \
 	mocha-ril/util.c
 
 LOCAL_SHARED_LIBRARIES := \
@@ -184,4 +193,178 @@ LOCAL_MODULE_TAGS := optional
 LOCAL_MODULE := libsrs-client
 
 include $(BUILD_SHARED_LIBRARY)
+
+ifeq ($(BUILD_MOCHA-TESTS),true)
+
+# The RIL on a fake RIL_Env and modem transport, in place of rild,
+# mocha-ril/ipc.c and the device handlers
+mocha-tests_files := \
+	$(filter-out mocha-ipc/device/%,$(mocha-ipc_files)) \
+	$(filter-out mocha-ril/ipc.c,$(mocha-ril_files)) \
+	tests/fake_modem.c \
+	tests/fake_ril.c
+
+mocha-tests_cflags := -D_GNU_SOURCE -DRIL_SHLIB
+
+ifeq ($(TARGET_DEVICE),jet)
+	mocha-tests_cflags += -DDEVICE_JET
+endif
+ifeq ($(TARGET_DEVICE),wave)
+	mocha-tests_cflags += -DDEVICE_WAVE
+endif
+
+mocha-tests_includes := \
+	$(LOCAL_PATH)/include \
+	$(LOCAL_PATH)/mocha-ipc \
+	$(LOCAL_PATH)/mocha-ril \
+	$(LOCAL_PATH)/tests
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := mocha-sms-bench
+LOCAL_MODULE_TAGS := optional debug
+
+LOCAL_SRC_FILES := $(mocha-tests_files) \
+	tests/fake_amss.c \
+	tests/fake_alloc.c \
+	tests/sms_bench.c
+
+LOCAL_CFLAGS := $(mocha-tests_cflags)
+LOCAL_LDFLAGS := -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=strdup
+LOCAL_LDLIBS += -lpthread
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	liblog \
+	libutils
+
+LOCAL_C_INCLUDES := $(mocha-tests_includes)
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := mocha-bcd-test
+LOCAL_MODULE_TAGS := optional debug
+
+LOCAL_SRC_FILES := $(mocha-tests_files) \
+	tests/bcd_test.c
+
+LOCAL_CFLAGS := $(mocha-tests_cflags)
+LOCAL_LDLIBS += -lpthread
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	liblog \
+	libutils
+
+LOCAL_C_INCLUDES := $(mocha-tests_includes)
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := mocha-gsm7-test
+LOCAL_MODULE_TAGS := optional debug
+
+LOCAL_SRC_FILES := \
+	mocha-ril/gsm7.c \
+	tests/gsm7_test.c
+
+LOCAL_SHARED_LIBRARIES := liblog
+
+LOCAL_C_INCLUDES := $(mocha-tests_includes)
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := mocha-gsm7-bench
+LOCAL_MODULE_TAGS := optional debug
+
+LOCAL_SRC_FILES := \
+	mocha-ril/gsm7.c \
+	tests/gsm7_bench.c
+
+LOCAL_SHARED_LIBRARIES := liblog
+
+LOCAL_C_INCLUDES := $(mocha-tests_includes)
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := mocha-hex-test
+LOCAL_MODULE_TAGS := optional debug
+
+LOCAL_SRC_FILES := \
+	mocha-ril/hex.c \
+	tests/hex_test.c
+
+LOCAL_C_INCLUDES := $(mocha-tests_includes)
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := mocha-pdu-test
+LOCAL_MODULE_TAGS := optional debug
+
+LOCAL_SRC_FILES := $(mocha-tests_files) \
+	tests/pdu_test.c
+
+LOCAL_CFLAGS := $(mocha-tests_cflags)
+LOCAL_LDLIBS += -lpthread
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	liblog \
+	libutils
+
+LOCAL_C_INCLUDES := $(mocha-tests_includes)
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := mocha-pdu-bench
+LOCAL_MODULE_TAGS := optional debug
+
+LOCAL_SRC_FILES := $(mocha-tests_files) \
+	tests/pdu_bench.c
+
+LOCAL_CFLAGS := $(mocha-tests_cflags)
+LOCAL_LDLIBS += -lpthread
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	liblog \
+	libutils
+
+LOCAL_C_INCLUDES := $(mocha-tests_includes)
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := mocha-sim-boot
+LOCAL_MODULE_TAGS := optional debug
+
+LOCAL_SRC_FILES := $(mocha-tests_files) \
+	tests/fake_sim.c \
+	tests/sim_boot.c
+
+LOCAL_CFLAGS := $(mocha-tests_cflags)
+LOCAL_LDLIBS += -lpthread
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	liblog \
+	libutils
+
+LOCAL_C_INCLUDES := $(mocha-tests_includes)
+
+include $(BUILD_EXECUTABLE)
+
+endif
 endif
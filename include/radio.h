@@ -73,11 +73,13 @@ enum ipc_ril_cb_type {
     CALL_ERROR,
     NETTEXT_INCOMING,
     NETTEXT_SEND_CALLBACK,
+    NETTEXT_CB_INCOMING,
     SIM_OPEN,
     SIM_STATUS,
     LOCK_STATUS,
     SIM_IO_RESPONSE,
     SIM_SMSC_NUMBER,
+    SIM_ATK_EVENT,
     SS_USSD_CALLBACK,
     SS_ERROR,
     LBS_GET_POSITION_IND,
@@ -89,6 +91,7 @@ enum ipc_ril_cb_type {
     PROTO_RECEIVE_DATA_IND,
     PROTO_SUSPEND_NETWORK_IND,
     PROTO_RESUME_NETWORK_IND,
+    DRV_BATTERY_STATUS,
 	IPC_RIL_CB_LAST
 };
 
@@ -126,7 +129,7 @@ void ipc_init(void);
 void ipc_shutdown(void);
 
 void ipc_register_ril_cb(int type, ipc_ril_cb cb);
-void ipc_invoke_ril_cb(int type, void* data);
+int ipc_invoke_ril_cb(int type, void* data);
 
 struct ipc_client* ipc_client_new();
 struct ipc_client *ipc_client_new_for_device(int device_type);
@@ -162,8 +165,33 @@ void ipc_client_send_exec(struct ipc_client *client, const unsigned short comman
 /* Utility functions */
 void imei_bcd2ascii(char* out, const uint8_t* in);
 void imsi_bcd2ascii(char* out, const uint8_t* in, int len);
-void bcd2ascii(char* out, const uint8_t* in, int size);
+char bcddigit2ascii(uint8_t in);
+int bcd2ascii(char* out, const uint8_t* in, int size);
+int ascii2bcd(uint8_t* out, const char* in, int length, int size);
 void ipc_hex_dump(struct ipc_client *client, void *data, int size);
+
+/* Frame dumps, per module */
+enum ipc_log_module {
+	IPC_LOG_DISPATCH,
+	IPC_LOG_SIM,
+	IPC_LOG_DRV,
+	IPC_LOG_TM,
+	IPC_LOG_SOUND,
+	IPC_LOG_SYSSEC,
+	IPC_LOG_MODULE_LAST
+};
+
+#define IPC_LOG_NONE		0	/* dropped */
+#define IPC_LOG_RING		1	/* kept raw in the ring buffer */
+#define IPC_LOG_DUMP		2	/* formatted to the log handler */
+
+#define IPC_LOG_RING_SLOTS	32
+#define IPC_LOG_RING_DATA	256
+
+void ipc_log_set_level(int module, int level);
+int ipc_log_set_levels(const char *levels);
+void ipc_log_frame(struct ipc_client *client, int module, void *data, int size);
+void ipc_log_ring_dump(struct ipc_client *client);
 void *ipc_mtd_read(struct ipc_client *client, char *mtd_name, int size, int block_size);
 void *ipc_file_read(struct ipc_client *client, char *file_name, int size, int block_size);
 
@@ -23,15 +23,24 @@
 #ifndef _SAMSUNG_RIL_SOCKET_H_
 #define _SAMSUNG_RIL_SOCKET_H_
 
-#define SRS_COMMAND(f)  ((f->group << 8) | f->index)
+#include <stdint.h>
+#include <hardware/gps.h>
+
+#define SRS_COMMAND(f)  (((f->group & ~SRS_GROUP_SEQ) << 8) | f->index)
 #define SRS_GROUP(m)    (m >> 8)
 #define SRS_INDEX(m)    (m & 0xff)
 
+/* Set in the header group when a struct srs_header_seq follows the header */
+#define SRS_GROUP_SEQ			0x80
+
 #define SRS_SOCKET_NAME			"samsung-ril-socket"
 #define SRS_DATA_MAX_SIZE		0x1000
 
 #define SRS_CONTROL			0x01
 #define SRS_CONTROL_PING		0x0101
+#define SRS_CONTROL_SUBSCRIBE		0x0102
+#define SRS_CONTROL_UNSUBSCRIBE		0x0103
+#define SRS_CONTROL_ACK			0x0104
 
 #define SRS_SND				0x02
 #define SRS_SND_SET_VOLUME		0x0201
@@ -46,6 +55,26 @@
 #define SRS_GPS_STATE			0x0304
 #define SRS_GPS_HELLO			0x03FF
 
+#define SRS_STATE			0x04
+#define SRS_STATE_SIGNAL_STRENGTH	0x0401
+#define SRS_STATE_CALL			0x0402
+#define SRS_STATE_BATTERY		0x0403
+
+/* Subscription topics, GPS state is sent with both GPS topics */
+#define SRS_TOPIC_GPS_LOCATION		(1 << 0)
+#define SRS_TOPIC_GPS_SV_STATUS		(1 << 1)
+#define SRS_TOPIC_SIGNAL_STRENGTH	(1 << 2)
+#define SRS_TOPIC_CALL_STATE		(1 << 3)
+#define SRS_TOPIC_BATTERY		(1 << 4)
+
+#define SRS_CALL_STATE_MAX		8
+
+/* GPS hello flags */
+#define SRS_GPS_HELLO_SHM		(1 << 0)
+
+#define SRS_GPS_SHM_MAGIC		0x47535253
+#define SRS_GPS_SHM_VERSION		1
+
 #define SRS_CONTROL_CAFFE		0xCAFFE
 
 struct srs_header {
@@ -54,8 +83,17 @@ struct srs_header {
 	unsigned char index;
 } __attribute__((__packed__));
 
+/*
+ * Sequenced messages are answered with the same sequence id, either by
+ * the command reply or by SRS_CONTROL_ACK when the command has none.
+ */
+struct srs_header_seq {
+	unsigned int seq;
+} __attribute__((__packed__));
+
 struct srs_message {
 	unsigned short command;
+	unsigned int seq;
 	int length;
 	void *data;
 };
@@ -115,4 +153,56 @@ struct srs_control_ping {
 	int caffe;
 } __attribute__((__packed__));
 
+struct srs_control_subscribe_packet {
+	uint32_t topics;
+} __attribute__((__packed__));
+
+struct srs_state_signal_strength_packet {
+	int signal_strength;
+	int bit_error_rate;
+} __attribute__((__packed__));
+
+struct srs_state_call_entry {
+	uint32_t id;
+	uint32_t state;
+	uint8_t mt;
+} __attribute__((__packed__));
+
+/* Only count entries are sent */
+struct srs_state_call_packet {
+	uint8_t count;
+	struct srs_state_call_entry calls[SRS_CALL_STATE_MAX];
+} __attribute__((__packed__));
+
+struct srs_state_battery_packet {
+	uint8_t percentage;
+} __attribute__((__packed__));
+
+/*
+ * Sent with SRS_GPS_HELLO, the reply carries the shared memory fd
+ * as SCM_RIGHTS ancillary data when SRS_GPS_HELLO_SHM is set.
+ */
+struct srs_gps_hello_packet {
+	uint32_t flags;
+	uint32_t shm_size;
+} __attribute__((__packed__));
+
+/*
+ * Latest GPS data shared with the GPS HAL. The RIL is the only writer:
+ * sequence is odd while an update is in progress.
+ */
+struct srs_gps_shm {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	volatile uint32_t sequence;
+
+	uint32_t location_count;
+	uint32_t sv_status_count;
+	int32_t state;
+
+	GpsLocation location;
+	GpsSvStatus sv_status;
+};
+
 #endif
@@ -159,6 +159,25 @@ typedef struct
 	uint32_t 	atkBufLen;
 } __attribute__((__packed__))  sim_atk_packet_header;
 
+/*
+ * ATK traffic handed to the RIL, which may answer it from its own thread
+ */
+enum SIM_ATK_EVENT_TYPE
+{
+	SIM_ATK_EVENT_PROACTIVE = 0, /**< ATK indication from the card */
+	SIM_ATK_EVENT_RESPONSE = 1, /**< ATK interface response */
+	SIM_ATK_EVENT_ACK = 2, /**< SIM event to acknowledge with an ATK packet */
+	SIM_ATK_EVENT_OEM_REQUEST = 3, /**< OEM request to bounce back */
+};
+
+typedef struct
+{
+	uint32_t 	type;
+	uint32_t 	subType;
+	uint32_t 	length;
+	uint8_t 	*data;
+} simAtkEvent;
+
 typedef struct
 {
 	uint8_t 	status;
@@ -98,6 +98,15 @@ typedef struct {
 	uint32_t status;
 } __attribute__((__packed__)) tapiNettextCallBack;
 
+/**
+ * Cell broadcast page as received with TAPI_NETTEXT_CB_INCOMING, assumed
+ * to be the raw 3GPP TS 23.041 page (88 bytes for GSM pages)
+ */
+typedef struct {
+	uint32_t length;
+	uint8_t *data;
+} tapiNettextCbPage;
+
 
 void tapi_nettext_parser(uint16_t tapiNettextType, uint32_t tapiNettextLength, uint8_t *tapiNettextData);
 void tapi_nettext_send(uint8_t* tapiNettextOutgoingMessage);
@@ -99,7 +99,7 @@ void ipc_parse_drv(struct ipc_client* client, struct modem_io *ipc_frame)
 	default:
 		DEBUG_I("IpcDrv Packet type 0x%X is not yet handled", rx_header->drvPacketType);
 		DEBUG_I("Frame type = 0x%x\n Frame length = 0x%x", ipc_frame->cmd, ipc_frame->datasize);
-		ipc_hex_dump(client, ipc_frame->data, ipc_frame->datasize);
+		ipc_log_frame(client, IPC_LOG_DRV, ipc_frame->data, ipc_frame->datasize);
 		break;
     }
 }
@@ -379,4 +379,6 @@ void handleFuelGaugeStatus(uint8_t percentage)
 	len = strlen(buf);
 	if(write(fd_cap, buf, strlen(buf)) != len)
 		DEBUG_E("%s: Failed to write battery capacity, error: %s", __func__, strerror(errno));
+
+	ipc_invoke_ril_cb(DRV_BATTERY_STATUS, (void*)&percentage);
 }
\ No newline at end of file
@@ -85,15 +85,17 @@ void ipc_register_ril_cb(int type, ipc_ril_cb cb)
 	ipc_ril_cb_map[type] = cb;
 }
 
-void ipc_invoke_ril_cb(int type, void* data)
+int ipc_invoke_ril_cb(int type, void* data)
 {
 	//DEBUG_I("Invoking RIL callback of type %d", type);
 	if(ipc_ril_cb_map[type])
 	{
 		ipc_ril_cb_map[type](data);
+		return 0;
 	}
-	else
-		DEBUG_W("Missing IPC RIL CB of type %d", (int) type);
+
+	DEBUG_W("Missing IPC RIL CB of type %d", (int) type);
+	return -1;
 }
 
 void log_handler_default(const char *message, void *user_data)
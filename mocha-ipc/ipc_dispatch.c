@@ -120,7 +120,7 @@ void ipc_dispatch(struct ipc_client *client, struct modem_io *ipc_frame)
 			DEBUG_I("Packet type 0x%x not yet handled\n", ipc_frame->cmd);
 			DEBUG_I("Frame header = 0x%x\n Frame type = 0x%x\n Frame length = 0x%x\n",
 				ipc_frame->magic, ipc_frame->cmd, ipc_frame->datasize);
-			ipc_hex_dump(client, ipc_frame->data, ipc_frame->datasize);
+			ipc_log_frame(client, IPC_LOG_DISPATCH, ipc_frame->data, ipc_frame->datasize);
 
 	}
 }
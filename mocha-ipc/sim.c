@@ -53,6 +53,7 @@ void ipc_parse_sim(struct ipc_client* client, struct modem_io *ipc_frame)
 	uint32_t diffedSubtype;
 	struct simPacketHeader *simHeader;
 	struct simPacket sim_packet;
+	simAtkEvent atk_event;
 	struct modem_io request;
 	void *frame;
  	uint8_t *payload;
@@ -66,6 +67,12 @@ void ipc_parse_sim(struct ipc_client* client, struct modem_io *ipc_frame)
     simHeader = (struct simPacketHeader *)(ipc_frame->data);
     sim_packet.simBuf = (uint8_t *)(ipc_frame->data + sizeof(struct simPacketHeader));
 
+	atk_event.subType = simHeader->subType;
+	atk_event.data = sim_packet.simBuf;
+	atk_event.length = simHeader->bufLen;
+	if (atk_event.length > ipc_frame->datasize - sizeof(struct simPacketHeader))
+		atk_event.length = ipc_frame->datasize - sizeof(struct simPacketHeader);
+
 	DEBUG_I("Sim Packet type = 0x%x\n Sim Packet sub-type = 0x%x\n Sim Packet length = 0x%x", simHeader->type, simHeader->subType, simHeader->bufLen);
 
 	if(simHeader->type != 0)
@@ -74,6 +81,8 @@ void ipc_parse_sim(struct ipc_client* client, struct modem_io *ipc_frame)
 		{
 		case 0x00:
 			DEBUG_I("SIM_PACKET OemSimAtkInjectDisplayTextInd rcvd");
+			atk_event.type = SIM_ATK_EVENT_PROACTIVE;
+			ipc_invoke_ril_cb(SIM_ATK_EVENT, (void*)&atk_event);
 
 			/*struct oemSimPacketHeader *oem_header;
 			struct oemSimPacket oem_packet;
@@ -88,6 +97,8 @@ void ipc_parse_sim(struct ipc_client* client, struct modem_io *ipc_frame)
 			break;
 		case 0x24:
 			DEBUG_I("SIM_ATK_interface response");
+			atk_event.type = SIM_ATK_EVENT_RESPONSE;
+			ipc_invoke_ril_cb(SIM_ATK_EVENT, (void*)&atk_event);
 			break;
 		default :
 			DEBUG_I("Unknown SIM subType %d, discarding the packet...", simHeader->subType);
@@ -111,9 +122,13 @@ void ipc_parse_sim(struct ipc_client* client, struct modem_io *ipc_frame)
 					case 2: //in this subtype
 						//TODO: these 2 subtypes are somewhat special - apps does switch some bool if they are used, not sure what way they are special.
 						sim_parse_event(sim_packet.simBuf, simHeader->bufLen);
-						buf[0]=0;
-						buf[1]=0;		
-						sim_atk_send_packet(0x1, 0x31, 0x2, buf);
+						// Acknowledged by the RIL ATK thread when there is one
+						atk_event.type = SIM_ATK_EVENT_ACK;
+						if (ipc_invoke_ril_cb(SIM_ATK_EVENT, (void*)&atk_event) < 0) {
+							buf[0]=0;
+							buf[1]=0;		
+							sim_atk_send_packet(0x1, 0x31, 0x2, buf);
+						}
 
 						break;
 					default:
@@ -128,10 +143,12 @@ void ipc_parse_sim(struct ipc_client* client, struct modem_io *ipc_frame)
 		}
 		else
 		{
-			sim_send_oem_req(sim_packet.simBuf, simHeader->bufLen); //bounceback packet
+			atk_event.type = SIM_ATK_EVENT_OEM_REQUEST;
+			if (ipc_invoke_ril_cb(SIM_ATK_EVENT, (void*)&atk_event) < 0)
+				sim_send_oem_req(sim_packet.simBuf, simHeader->bufLen); //bounceback packet
 		}
 	}
-	ipc_hex_dump(client, ipc_frame->data, ipc_frame->datasize);
+	ipc_log_frame(client, IPC_LOG_SIM, ipc_frame->data, ipc_frame->datasize);
 	DEBUG_I("Leaving ipc_parse_sim");
 }
 void sim_parse_event(uint8_t* buf, uint32_t bufLen)
@@ -38,7 +38,7 @@ void ipc_parse_syssec(struct ipc_client* client, struct modem_io *ipc_frame)
     rx_header = (struct sysSecPacketHeader*)(ipc_frame->data);
 
 	DEBUG_I("Syssec packet type = 0x%x\n  Syssec packet unk1 = 0x%X\n  packet length = 0x%X, unk2= 0x%X", rx_header->type, rx_header->unknown1, rx_header->bufLen, rx_header->unknown2);
-	ipc_hex_dump(client, ipc_frame->data, rx_header->bufLen);
+	ipc_log_frame(client, IPC_LOG_SYSSEC, ipc_frame->data, rx_header->bufLen);
 }
 
 void load_sec_data(void)
@@ -38,6 +38,7 @@
 void tapi_nettext_parser(uint16_t tapiNettextType, uint32_t tapiNettextLength, uint8_t *tapiNettextData)
 {
 	struct tapiPacket tx_packet;
+	tapiNettextCbPage cb_page;
 
 	struct modem_io request;
     uint8_t *frame;
@@ -52,6 +53,11 @@ void tapi_nettext_parser(uint16_t tapiNettextType, uint32_t tapiNettextLength, u
 	case TAPI_NETTEXT_SEND_CALLBACK:
 		ipc_invoke_ril_cb(NETTEXT_SEND_CALLBACK, (void*)tapiNettextData);
 		break;	
+	case TAPI_NETTEXT_CB_INCOMING:
+		cb_page.length = tapiNettextLength;
+		cb_page.data = tapiNettextData;
+		ipc_invoke_ril_cb(NETTEXT_CB_INCOMING, (void*)&cb_page);
+		break;
     	default:
 		DEBUG_I("TapiNettext packet type 0x%X is not yet handled, len = 0x%x", tapiNettextType, tapiNettextLength);
 	    	break;
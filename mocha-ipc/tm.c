@@ -47,7 +47,7 @@ void ipc_parse_tm(struct ipc_client* client, struct modem_io *ipc_frame)
 	{
 		DEBUG_I("Test_Mode Parser");
 		DEBUG_I("Frame type = 0x%x\n Frame length = 0x%x\n", ipc_frame->cmd, ipc_frame->datasize);
-		ipc_hex_dump(client, ipc_frame->data, ipc_frame->datasize);
+		ipc_log_frame(client, IPC_LOG_TM, ipc_frame->data, ipc_frame->datasize);
 	}
 }
 
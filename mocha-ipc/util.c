@@ -29,10 +29,21 @@
 #include <asm/types.h>
 #include <mtd/mtd-abi.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <pthread.h>
 
 #include <radio.h>
 #include "ipc_private.h"
 
+/*
+ * BCD digits as semi-octets, low nibble first (TS 24.008 10.5.4.7).
+ * 0xE and 0xF end the number.
+ */
+static const char bcd_digits[16] = {
+	'0', '1', '2', '3', '4', '5', '6', '7',
+	'8', '9', '*', '#', 'P', '?', 0x00, 0x00,
+};
+
 void imei_bcd2ascii(char* out, const uint8_t* in)
 {
 	char tmp[20];
@@ -51,92 +62,267 @@ void imsi_bcd2ascii(char* out, const uint8_t* in, int len)
 
 char bcddigit2ascii(uint8_t in)
 {
-	if(in < 0xA)
-		return in + 0x30;
-	switch(in)
-	{
-	case 0xA:
-		return '*';
-		break;
-	case 0xB:
-		return '#';
-		break;
-	case 0xC:
-		return 'P';
-		break;
-	case 0xD:
-		return '?';
-		break;
-	default: /* 0xE, 0xF and invalid input */
-		return 0x00;
-		break;
-	}
+	return bcd_digits[in & 0xF];
 }
 
-void bcd2ascii(char* out, const uint8_t* in, int size)
+/*
+ * Decodes size bytes into out, which holds 2 * size + 1 bytes.
+ * Returns the number of digits.
+ */
+int bcd2ascii(char* out, const uint8_t* in, int size)
 {
-	int i;
+	char low, high;
 	int outi = 0;
-	for(i = 0; i < size; i++)
-	{
-		out[outi++] = bcddigit2ascii(in[i] & 0xF);
-		out[outi++] = bcddigit2ascii((in[i] >> 4) & 0xF);
+	int i;
+
+	for (i = 0; i < size; i++) {
+		low = bcd_digits[in[i] & 0xF];
+		if (low == 0x00)
+			break;
+		out[outi++] = low;
+
+		high = bcd_digits[in[i] >> 4];
+		if (high == 0x00)
+			break;
+		out[outi++] = high;
 	}
+
 	out[outi] = 0x00; //terminate string with null
+
+	return outi;
 }
 
-void ipc_hex_dump(struct ipc_client *client, void *data, int size)
+static int ascii2bcddigit(char in)
 {
-    /* dumps size bytes of *data to stdout. Looks like:
-* [0000] 75 6E 6B 6E 6F 77 6E 20
-* 30 FF 00 00 00 00 39 00 unknown 0.....9.
-* (in a single line of course)
-*/
+	if (in >= '0' && in <= '9')
+		return in - '0';
+
+	switch (in) {
+		case '*':
+			return 0xA;
+		case '#':
+			return 0xB;
+		case 'P':
+		case 'p':
+		case ',':
+			return 0xC;
+		case '?':
+		case 'N':
+			return 0xD;
+		default:
+			return -1;
+	}
+}
+
+/*
+ * Encodes length digits as swapped semi-octets, padded with 0xF, into out
+ * which holds size bytes. Returns the number of bytes, or -1 on invalid
+ * digits or when size is too small.
+ */
+int ascii2bcd(uint8_t* out, const char* in, int length, int size)
+{
+	int digit;
+	int outi = 0;
+	int i;
 
+	if ((length + 1) / 2 > size)
+		return -1;
+
+	for (i = 0; i < length; i++) {
+		digit = ascii2bcddigit(in[i]);
+		if (digit < 0)
+			return -1;
+
+		if (i % 2 == 0) {
+			out[outi] = 0xF0 | digit;
+		} else {
+			out[outi] = (out[outi] & 0x0F) | (digit << 4);
+			outi++;
+		}
+	}
+
+	return (length + 1) / 2;
+}
+
+static const char ipc_hex_digits[] = "0123456789ABCDEF";
+
+/*
+ * Dumps size bytes of data to the log handler, 16 bytes per line:
+ * [0000] 75 6E 6B 6E 6F 77 6E 20  30 FF 00 00 00 00 39 00    unknown  0.....9.
+ */
+void ipc_hex_dump(struct ipc_client *client, void *data, int size)
+{
     unsigned char *p = data;
-    unsigned char c;
+    char line[8 + 50 + 1 + 17 + 1];
+    char *hex;
+    char *chars;
+    int offset;
     int n;
-    char bytestr[4] = {0};
-    char addrstr[10] = {0};
-    char hexstr[ 16*3 + 5] = {0};
-    char charstr[16*1 + 5] = {0};
-    for(n=1;n<=size;n++) {
-        if (n%16 == 1) {
-            /* store address for this line */
-            snprintf(addrstr, sizeof(addrstr), "%.4x",
-               ((unsigned int)p-(unsigned int)data) );
-        }
 
-        c = *p;
-        if (isalnum(c) == 0) {
-            c = '.';
+    if (client == NULL || client->log_handler == NULL)
+        return;
+
+    for (offset = 0; offset < size; offset += 16) {
+        memset(line, ' ', sizeof(line));
+
+        line[0] = '[';
+        line[1] = ipc_hex_digits[(offset >> 12) & 0xF];
+        line[2] = ipc_hex_digits[(offset >> 8) & 0xF];
+        line[3] = ipc_hex_digits[(offset >> 4) & 0xF];
+        line[4] = ipc_hex_digits[offset & 0xF];
+        line[5] = ']';
+
+        hex = line + 7;
+        chars = line + 7 + 50 + 1;
+
+        for (n = 0; n < 16 && offset + n < size; n++) {
+            if (n == 8) {
+                hex++;
+                chars++;
+            }
+
+            hex[0] = ipc_hex_digits[p[n] >> 4];
+            hex[1] = ipc_hex_digits[p[n] & 0xF];
+            hex += 3;
+
+            *chars++ = isalnum(p[n]) ? p[n] : '.';
         }
 
-        /* store hex str (for left side) */
-        snprintf(bytestr, sizeof(bytestr), "%02X ", *p);
-        strncat(hexstr, bytestr, sizeof(hexstr)-strlen(hexstr)-1);
-
-        /* store char str (for right side) */
-        snprintf(bytestr, sizeof(bytestr), "%c", c);
-        strncat(charstr, bytestr, sizeof(charstr)-strlen(charstr)-1);
-
-        if(n%16 == 0) {
-            /* line completed */
-            ipc_client_log(client, "[%4.4s] %-50.50s %s", addrstr, hexstr, charstr);
-            hexstr[0] = 0;
-            charstr[0] = 0;
-        } else if(n%8 == 0) {
-            /* half line: add whitespaces */
-            strncat(hexstr, " ", sizeof(hexstr)-strlen(hexstr)-1);
-            strncat(charstr, " ", sizeof(charstr)-strlen(charstr)-1);
+        *chars = '\0';
+        client->log_handler(line, client->log_data);
+
+        p += 16;
+    }
+}
+
+/*
+ * Frames are only formatted for the modules dumping them; the others
+ * keep the last frames raw in a ring buffer, formatted on demand.
+ */
+struct ipc_log_record {
+    int module;
+    int size;
+    uint8_t data[IPC_LOG_RING_DATA];
+};
+
+static const char *ipc_log_modules[IPC_LOG_MODULE_LAST] = {
+    "dispatch", "sim", "drv", "tm", "sound", "syssec",
+};
+
+static int ipc_log_levels[IPC_LOG_MODULE_LAST] = {
+    IPC_LOG_RING, IPC_LOG_RING, IPC_LOG_RING, IPC_LOG_RING, IPC_LOG_RING, IPC_LOG_RING,
+};
+
+static struct ipc_log_record ipc_log_ring[IPC_LOG_RING_SLOTS];
+static int ipc_log_ring_next;
+static int ipc_log_ring_count;
+static pthread_mutex_t ipc_log_ring_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void ipc_log_set_level(int module, int level)
+{
+    if (module < 0 || module >= IPC_LOG_MODULE_LAST)
+        return;
+
+    ipc_log_levels[module] = level;
+}
+
+/*
+ * Sets levels from a "module=level,..." list, "all" matching every
+ * module. Returns the number of levels set.
+ */
+int ipc_log_set_levels(const char *levels)
+{
+    char name[16];
+    const char *p = levels;
+    int count = 0;
+    int level;
+    int i, n;
+
+    if (levels == NULL)
+        return 0;
+
+    while (*p != '\0') {
+        for (n = 0; p[n] != '\0' && p[n] != '=' && p[n] != ','; n++);
+
+        if (p[n] == '=' && n < (int) sizeof(name)) {
+            memcpy(name, p, n);
+            name[n] = '\0';
+            level = atoi(p + n + 1);
+
+            for (i = 0; i < IPC_LOG_MODULE_LAST; i++) {
+                if (strcmp(name, "all") == 0 || strcmp(name, ipc_log_modules[i]) == 0) {
+                    ipc_log_levels[i] = level;
+                    count++;
+                }
+            }
         }
-        p++; /* next byte */
+
+        p = strchr(p, ',');
+        if (p == NULL)
+            break;
+        p++;
     }
 
-    if (strlen(hexstr) > 0) {
-        /* print rest of buffer if not empty */
-        ipc_client_log(client, "[%4.4s] %-50.50s %s\n", addrstr, hexstr, charstr);
+    return count;
+}
+
+void ipc_log_frame(struct ipc_client *client, int module, void *data, int size)
+{
+    struct ipc_log_record *record;
+
+    if (module < 0 || module >= IPC_LOG_MODULE_LAST || data == NULL || size <= 0)
+        return;
+
+    if (ipc_log_levels[module] >= IPC_LOG_DUMP) {
+        ipc_hex_dump(client, data, size);
+        return;
     }
+
+    if (ipc_log_levels[module] < IPC_LOG_RING)
+        return;
+
+    pthread_mutex_lock(&ipc_log_ring_mutex);
+
+    record = &ipc_log_ring[ipc_log_ring_next];
+    record->module = module;
+    record->size = size;
+    memcpy(record->data, data, size < IPC_LOG_RING_DATA ? size : IPC_LOG_RING_DATA);
+
+    ipc_log_ring_next = (ipc_log_ring_next + 1) % IPC_LOG_RING_SLOTS;
+    if (ipc_log_ring_count < IPC_LOG_RING_SLOTS)
+        ipc_log_ring_count++;
+
+    pthread_mutex_unlock(&ipc_log_ring_mutex);
+}
+
+/*
+ * Formats the frames kept in the ring buffer, oldest first, and empties it.
+ */
+void ipc_log_ring_dump(struct ipc_client *client)
+{
+    struct ipc_log_record *record;
+    char header[64];
+    int i;
+
+    if (client == NULL || client->log_handler == NULL)
+        return;
+
+    pthread_mutex_lock(&ipc_log_ring_mutex);
+
+    for (i = ipc_log_ring_count; i > 0; i--) {
+        record = &ipc_log_ring[(ipc_log_ring_next - i + IPC_LOG_RING_SLOTS) % IPC_LOG_RING_SLOTS];
+
+        snprintf(header, sizeof(header), "%s frame, %d bytes%s", ipc_log_modules[record->module],
+            record->size, record->size > IPC_LOG_RING_DATA ? " (truncated)" : "");
+        client->log_handler(header, client->log_data);
+
+        ipc_hex_dump(client, record->data,
+            record->size < IPC_LOG_RING_DATA ? record->size : IPC_LOG_RING_DATA);
+    }
+
+    ipc_log_ring_count = 0;
+
+    pthread_mutex_unlock(&ipc_log_ring_mutex);
 }
 
 void *ipc_mtd_read(struct ipc_client *client, char *mtd_name, int size, int block_size)
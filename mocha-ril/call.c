@@ -86,6 +86,30 @@ void release_ril_call_context(ril_call_context* ptr)
 	ALOGE("Tried to release non registered call context!");
 }
 
+void ril_call_state_changed(void)
+{
+	struct srs_state_call_packet call_state;
+	int i;
+
+	ril_request_unsolicited(RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED, NULL, 0);
+
+	memset(&call_state, 0, sizeof(call_state));
+
+	for(i = 0; i < MAX_CALLS && call_state.count < SRS_CALL_STATE_MAX; i++)
+	{
+		if(!ril_data.calls[i] || ril_data.calls[i]->callId == 0xFF)
+			continue;
+
+		call_state.calls[call_state.count].id = ril_data.calls[i]->callId;
+		call_state.calls[call_state.count].state = ril_data.calls[i]->call_state;
+		call_state.calls[call_state.count].mt = ril_data.calls[i]->bMT;
+		call_state.count++;
+	}
+
+	srs_publish(SRS_TOPIC_CALL_STATE, SRS_STATE_CALL, &call_state,
+		sizeof(call_state.count) + call_state.count * sizeof(struct srs_state_call_entry));
+}
+
 void ipc_call_incoming(void* data)
 {
 	uint8_t newCallState = RIL_CALL_INCOMING;
@@ -114,7 +138,7 @@ void ipc_call_incoming(void* data)
 	callCtxt->bMT = 1;
 	
 	ril_request_unsolicited(RIL_UNSOL_CALL_RING, NULL, 0);
-	ril_request_unsolicited(RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED, NULL, 0);
+	ril_call_state_changed();
 }
 
 void ipc_call_end(void* data)
@@ -135,7 +159,7 @@ void ipc_call_end(void* data)
 		return;
 	}
 	release_ril_call_context(callCtxt);
-	ril_request_unsolicited(RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED, NULL, 0);
+	ril_call_state_changed();
 }
 
 void ipc_call_setup_ind(void* data)
@@ -165,7 +189,7 @@ void ipc_call_alert(void* data)
 	if(!callCtxt)
 		return;
 	callCtxt->call_state = RIL_CALL_ALERTING;
-	ril_request_unsolicited(RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED, NULL, 0);
+	ril_call_state_changed();
 }
 
 void ipc_call_connected(void* data)
@@ -183,7 +207,7 @@ void ipc_call_connected(void* data)
 		callCtxt->token = 0;
 		return;
 	}
-	ril_request_unsolicited(RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED, NULL, 0);
+	ril_call_state_changed();
 }
 
 void ipc_call_dtmf_start(void* data)
@@ -309,7 +333,7 @@ void ipc_call_error(void* data)
 	if(errorCtxt->token != 0)
 		ril_request_complete(errorCtxt->token, RIL_E_GENERIC_FAILURE, NULL, 0);
 	release_ril_call_context(errorCtxt);
-	ril_request_unsolicited(RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED, NULL, 0);
+	ril_call_state_changed();
 }
 
 void ril_request_dial(RIL_Token t, void *data, size_t datalen)
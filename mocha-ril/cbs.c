@@ -0,0 +1,282 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <time.h>
+
+#define LOG_TAG "RIL-Mocha-CBS"
+#include <utils/Log.h>
+
+#include "mocha-ril.h"
+#include "util.h"
+
+/*
+ * Cell broadcast pages are checked against a small set-associative cache
+ * of (serial, message id) pairs delivered in the last
+ * RIL_CBS_SEEN_TIMEOUT seconds on this cell, so that the periodic
+ * repetitions of a broadcast reach the framework only once. Multi-page
+ * messages are held in ril_data.cbs_messages until complete and then
+ * delivered page after page.
+ */
+
+static void ril_cbs_stats_log(void)
+{
+	struct ril_cbs_stats *stats = &ril_data.cbs_stats;
+
+	ALOGD("%s: %u pages, %u duplicates, %u messages delivered, %u dropped",
+		__func__, stats->pages, stats->duplicates, stats->delivered, stats->dropped);
+}
+
+static unsigned int ril_cbs_seen_set(uint32_t key)
+{
+	// Fibonacci hashing, keeping the top bits
+	return ((key * 2654435761U) >> 26) % RIL_CBS_SEEN_SETS;
+}
+
+static int ril_cbs_seen_find(uint16_t serial, uint16_t msgid)
+{
+	uint32_t key = ((uint32_t) serial << 16) | msgid;
+	struct ril_cbs_seen *seen;
+	unsigned int set;
+	time_t now;
+	int i;
+
+	set = ril_cbs_seen_set(key);
+	now = time(NULL);
+
+	for (i = 0; i < RIL_CBS_SEEN_WAYS; i++) {
+		seen = &ril_data.cbs_seen[set][i];
+		if (seen->time == 0 || seen->key != key)
+			continue;
+
+		// The same serial may be reused for a new broadcast later on
+		if (now - seen->time >= RIL_CBS_SEEN_TIMEOUT) {
+			seen->time = 0;
+			return 0;
+		}
+
+		return 1;
+	}
+
+	return 0;
+}
+
+static void ril_cbs_seen_add(uint16_t serial, uint16_t msgid)
+{
+	uint32_t key = ((uint32_t) serial << 16) | msgid;
+	unsigned int set;
+	unsigned int way;
+
+	set = ril_cbs_seen_set(key);
+
+	// Replace the ways of a set in turn
+	way = ril_data.cbs_seen_next[set];
+	ril_data.cbs_seen[set][way].key = key;
+	ril_data.cbs_seen[set][way].time = time(NULL);
+	ril_data.cbs_seen_next[set] = (way + 1) % RIL_CBS_SEEN_WAYS;
+}
+
+/*
+ * Broadcasts are per cell: those of the new cell are delivered even if
+ * the previous one had the same serial and message id.
+ */
+void ril_cbs_cell_changed(void)
+{
+	memset(ril_data.cbs_seen, 0, sizeof(ril_data.cbs_seen));
+	memset(ril_data.cbs_seen_next, 0, sizeof(ril_data.cbs_seen_next));
+}
+
+static void ril_cbs_message_unregister(struct ril_cbs_message *message)
+{
+	struct list_head *list;
+
+	if (message == NULL)
+		return;
+
+	list = ril_data.cbs_messages;
+	while (list != NULL) {
+		if (list->data == (void *) message) {
+			memset(message, 0, sizeof(struct ril_cbs_message));
+			free(message);
+
+			if (list == ril_data.cbs_messages)
+				ril_data.cbs_messages = list->next;
+
+			list_head_free(list);
+
+			break;
+		}
+
+		list = list->next;
+	}
+}
+
+static struct ril_cbs_message *ril_cbs_message_find(uint16_t serial, uint16_t msgid)
+{
+	struct ril_cbs_message *message;
+	struct list_head *list;
+
+	list = ril_data.cbs_messages;
+	while (list != NULL) {
+		message = (struct ril_cbs_message *) list->data;
+		if (message == NULL)
+			goto list_continue;
+
+		if (message->serial == serial && message->msgid == msgid)
+			return message;
+
+list_continue:
+		list = list->next;
+	}
+
+	return NULL;
+}
+
+/*
+ * Drops incomplete messages that timed out, and the oldest one when the
+ * list is full. Broadcasts are repeated by the network, so the message
+ * will get another chance.
+ */
+static void ril_cbs_message_expire(void)
+{
+	struct ril_cbs_message *message;
+	struct list_head *list;
+	time_t now;
+	int count;
+
+	now = time(NULL);
+	count = 0;
+
+	list = ril_data.cbs_messages;
+	while (list != NULL) {
+		message = (struct ril_cbs_message *) list->data;
+		list = list->next;
+
+		if (message == NULL)
+			continue;
+
+		if (now - message->time < RIL_CBS_TIMEOUT) {
+			count++;
+			continue;
+		}
+
+		ALOGD("%s: Dropping message 0x%x/0x%x with %d pages of %d", __func__,
+			message->msgid, message->serial, message->received, message->count);
+		ril_data.cbs_stats.dropped++;
+		ril_cbs_message_unregister(message);
+	}
+
+	if (count >= RIL_CBS_MESSAGES && ril_data.cbs_messages != NULL) {
+		message = (struct ril_cbs_message *) ril_data.cbs_messages->data;
+
+		ALOGD("%s: Dropping message 0x%x/0x%x to make room", __func__,
+			message->msgid, message->serial);
+		ril_data.cbs_stats.dropped++;
+		ril_cbs_message_unregister(message);
+	}
+}
+
+static struct ril_cbs_message *ril_cbs_message_register(uint16_t serial, uint16_t msgid, uint8_t count)
+{
+	struct ril_cbs_message *message;
+	struct list_head *list_end;
+	struct list_head *list;
+
+	ril_cbs_message_expire();
+
+	message = calloc(1, sizeof(struct ril_cbs_message));
+	if (message == NULL)
+		return NULL;
+
+	message->serial = serial;
+	message->msgid = msgid;
+	message->count = count;
+	message->time = time(NULL);
+
+	list_end = ril_data.cbs_messages;
+	while (list_end != NULL && list_end->next != NULL)
+		list_end = list_end->next;
+
+	list = list_head_alloc((void *) message, list_end, NULL);
+
+	if (ril_data.cbs_messages == NULL)
+		ril_data.cbs_messages = list;
+
+	return message;
+}
+
+void ipc_cbs_incoming(void *data)
+{
+	tapiNettextCbPage *page = (tapiNettextCbPage *) data;
+	struct ril_cbs_message *message;
+	uint16_t serial, msgid;
+	uint8_t number, count;
+	int i;
+
+	if (page == NULL || page->data == NULL || page->length < 6)
+		return;
+
+	ril_data.cbs_stats.pages++;
+
+	serial = (page->data[0] << 8) | page->data[1];
+	msgid = (page->data[2] << 8) | page->data[3];
+
+	if (ril_cbs_seen_find(serial, msgid)) {
+		ril_data.cbs_stats.duplicates++;
+		return;
+	}
+
+	number = (page->data[5] >> 4) & 0x0f;
+	count = page->data[5] & 0x0f;
+
+	// Single pages, and anything that isn't a regular GSM page, go as-is
+	if (page->length != RIL_CBS_PAGE_SIZE || count <= 1 || number < 1 || number > count) {
+		ril_request_unsolicited(RIL_UNSOL_RESPONSE_NEW_BROADCAST_SMS, page->data, page->length);
+		ril_cbs_seen_add(serial, msgid);
+		ril_data.cbs_stats.delivered++;
+		ril_cbs_stats_log();
+		return;
+	}
+
+	message = ril_cbs_message_find(serial, msgid);
+	if (message == NULL) {
+		message = ril_cbs_message_register(serial, msgid, count);
+		if (message == NULL)
+			return;
+	}
+
+	// The page parameter byte is never zero for a received page
+	if (message->pages[number - 1][5] != 0) {
+		ril_data.cbs_stats.duplicates++;
+		return;
+	}
+
+	memcpy(message->pages[number - 1], page->data, RIL_CBS_PAGE_SIZE);
+	message->received++;
+
+	if (message->received < message->count)
+		return;
+
+	for (i = 0; i < message->count; i++)
+		ril_request_unsolicited(RIL_UNSOL_RESPONSE_NEW_BROADCAST_SMS, message->pages[i], RIL_CBS_PAGE_SIZE);
+
+	ril_cbs_seen_add(serial, msgid);
+	ril_data.cbs_stats.delivered++;
+	ril_cbs_stats_log();
+
+	ril_cbs_message_unregister(message);
+}
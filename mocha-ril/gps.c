@@ -21,13 +21,69 @@
 
 #define LOG_TAG "RIL-Mocha-GPS"
 #include <time.h>
+#include <sys/mman.h>
 #include <utils/Log.h>
+#include <cutils/ashmem.h>
 
 #include "mocha-ril.h"
 #include "util.h"
 #include <hardware/gps.h>
 #include <lbs.h>
 
+static struct srs_gps_shm *gps_shm = NULL;
+static int gps_shm_fd = -1;
+
+/*
+ * Returns the fd of the shared GPS region, creating it on first use.
+ * Clients can only map it read-only.
+ */
+int ril_gps_shm_fd(void)
+{
+	struct srs_gps_shm *shm;
+	int fd;
+
+	if (gps_shm_fd >= 0)
+		return gps_shm_fd;
+
+	fd = ashmem_create_region("mocha-ril-gps", sizeof(struct srs_gps_shm));
+	if (fd < 0) {
+		ALOGE("%s: Unable to create GPS shared memory", __func__);
+		return -1;
+	}
+
+	shm = mmap(NULL, sizeof(struct srs_gps_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (shm == MAP_FAILED) {
+		ALOGE("%s: Unable to map GPS shared memory", __func__);
+		close(fd);
+		return -1;
+	}
+
+	memset(shm, 0, sizeof(struct srs_gps_shm));
+	shm->magic = SRS_GPS_SHM_MAGIC;
+	shm->version = SRS_GPS_SHM_VERSION;
+	shm->size = sizeof(struct srs_gps_shm);
+	shm->state = GPS_STATUS_SESSION_END;
+
+	ashmem_set_prot_region(fd, PROT_READ);
+
+	gps_shm = shm;
+	gps_shm_fd = fd;
+
+	return fd;
+}
+
+static void ril_gps_shm_write_begin(void)
+{
+	gps_shm->sequence++;
+	__sync_synchronize();
+}
+
+static void ril_gps_shm_write_end(void)
+{
+	__sync_synchronize();
+	gps_shm->sequence++;
+}
+
 void ipc_lbs_get_position_ind(void* data)
 {
 	lbsGetPositionInd* get_pos = (lbsGetPositionInd*)(data);
@@ -56,7 +112,14 @@ void ipc_lbs_get_position_ind(void* data)
 	for(i = 0; i < get_pos->numOfSatToFix; i++)
 		status.used_in_fix_mask |= (1ul << (get_pos->satIdtoFix[i] - 1));
 
-	srs_send(find_srs_gps_client(), SRS_GPS_SV_STATUS, &status, sizeof(GpsSvStatus));
+	if (gps_shm != NULL) {
+		ril_gps_shm_write_begin();
+		memcpy(&gps_shm->sv_status, &status, sizeof(GpsSvStatus));
+		gps_shm->sv_status_count++;
+		ril_gps_shm_write_end();
+	}
+
+	srs_publish(SRS_TOPIC_GPS_SV_STATUS, SRS_GPS_SV_STATUS, &status, sizeof(GpsSvStatus));
 
 	if (get_pos->lbsPositionDataType == LBS_POSITION_DATA_NEW)
 	{
@@ -84,7 +147,14 @@ void ipc_lbs_get_position_ind(void* data)
 		location.flags |= GPS_LOCATION_HAS_ACCURACY;
 		location.accuracy = get_pos->h_accuracy;
 
-		srs_send(find_srs_gps_client(), SRS_GPS_LOCATION, &location, sizeof(GpsLocation));
+		if (gps_shm != NULL) {
+			ril_gps_shm_write_begin();
+			memcpy(&gps_shm->location, &location, sizeof(GpsLocation));
+			gps_shm->location_count++;
+			ril_gps_shm_write_end();
+		}
+
+		srs_publish(SRS_TOPIC_GPS_LOCATION, SRS_GPS_LOCATION, &location, sizeof(GpsLocation));
 	}
 }
 
@@ -107,7 +177,13 @@ void ipc_lbs_state_ind(void* data)
 			break;
 	}
 
-	srs_send(find_srs_gps_client(), SRS_GPS_STATE, &value, sizeof(GpsStatusValue));
+	if (gps_shm != NULL) {
+		ril_gps_shm_write_begin();
+		gps_shm->state = value;
+		ril_gps_shm_write_end();
+	}
+
+	srs_publish(SRS_TOPIC_GPS_LOCATION | SRS_TOPIC_GPS_SV_STATUS, SRS_GPS_STATE, &value, sizeof(GpsStatusValue));
 }
 
 void srs_gps_navigation_mode(struct srs_message *message)
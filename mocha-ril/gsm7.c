@@ -0,0 +1,281 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+
+#define LOG_TAG "RIL-Mocha-GSM7"
+#include <utils/Log.h>
+
+#include "gsm7.h"
+
+/**
+ * GSM 03.38 default alphabet, as unicode code points
+ */
+static const uint16_t gsm7_default_alphabet[128] = {
+	0x0040, 0x00A3, 0x0024, 0x00A5, 0x00E8, 0x00E9, 0x00F9, 0x00EC,
+	0x00F2, 0x00C7, 0x000A, 0x00D8, 0x00F8, 0x000D, 0x00C5, 0x00E5,
+	0x0394, 0x005F, 0x03A6, 0x0393, 0x039B, 0x03A9, 0x03A0, 0x03A8,
+	0x03A3, 0x0398, 0x039E, 0x00A0, 0x00C6, 0x00E6, 0x00DF, 0x00C9,
+	0x0020, 0x0021, 0x0022, 0x0023, 0x00A4, 0x0025, 0x0026, 0x0027,
+	0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F,
+	0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037,
+	0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F,
+	0x00A1, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047,
+	0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F,
+	0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057,
+	0x0058, 0x0059, 0x005A, 0x00C4, 0x00D6, 0x00D1, 0x00DC, 0x00A7,
+	0x00BF, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067,
+	0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F,
+	0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077,
+	0x0078, 0x0079, 0x007A, 0x00E4, 0x00F6, 0x00F1, 0x00FC, 0x00E0,
+};
+
+/**
+ * GSM 03.38 default alphabet extension table, reached with GSM7_ESCAPE
+ */
+static const struct {
+	uint8_t septet;
+	uint16_t code;
+} gsm7_extension_table[] = {
+	{ 0x0A, 0x000C },
+	{ 0x14, 0x005E },
+	{ 0x28, 0x007B },
+	{ 0x29, 0x007D },
+	{ 0x2F, 0x005C },
+	{ 0x3C, 0x005B },
+	{ 0x3D, 0x007E },
+	{ 0x3E, 0x005D },
+	{ 0x40, 0x007C },
+	{ 0x65, 0x20AC },
+};
+
+/**
+ * ASCII to default alphabet septets: 0x80 is set for extension septets
+ * and 0xFF marks characters that can't be represented
+ */
+static const uint8_t gsm7_ascii_table[128] = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x0A, 0xFF, 0x8A, 0x0D, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0x20, 0x21, 0x22, 0x23, 0x02, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F,
+	0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F,
+	0x00, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F,
+	0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0xBC, 0xAF, 0xBE, 0x94, 0x11,
+	0xFF, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F,
+	0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0xA8, 0xC0, 0xA9, 0xBD, 0xFF,
+};
+
+/*
+ * Septet i of a packed stream takes bits 7 * i to 7 * i + 6. Septets are
+ * handled 8 at a time (7 bytes, one 64 bits word) where they are aligned,
+ * one at a time otherwise.
+ */
+
+static inline void gsm7_pack_septet(uint8_t *packed, size_t index, uint8_t septet)
+{
+	size_t bit = index * 7;
+	size_t byte = bit >> 3;
+	int shift = bit & 7;
+
+	packed[byte] = (packed[byte] & ~(0x7f << shift)) | (septet << shift);
+	if (shift > 1)
+		packed[byte + 1] = (packed[byte + 1] & ~(0x7f >> (8 - shift))) | (septet >> (8 - shift));
+}
+
+static inline uint8_t gsm7_unpack_septet(const uint8_t *packed, size_t index)
+{
+	size_t bit = index * 7;
+	size_t byte = bit >> 3;
+	int shift = bit & 7;
+	unsigned int v;
+
+	v = packed[byte] >> shift;
+	if (shift > 1)
+		v |= packed[byte + 1] << (8 - shift);
+
+	return v & 0x7f;
+}
+
+/**
+ * Packs count septets into packed, starting at septet offset: the first
+ * bits of packed (e.g. a user data header) are kept. Returns the packed
+ * size in bytes, or 0 when size is too small.
+ */
+size_t gsm7_pack(const uint8_t *septets, size_t count, size_t offset, uint8_t *packed, size_t size)
+{
+	uint64_t word;
+	size_t length;
+	size_t end;
+	size_t i;
+	int k;
+
+	length = GSM7_PACKED_SIZE(offset + count);
+	if (septets == NULL || packed == NULL || length > size)
+		return 0;
+
+	end = offset + count;
+	i = offset;
+
+	while (i < end && (i & 7) != 0) {
+		gsm7_pack_septet(packed, i, septets[i - offset] & 0x7f);
+		i++;
+	}
+
+	while (i + 8 <= end) {
+		word = 0;
+		for (k = 0; k < 8; k++)
+			word |= (uint64_t) (septets[i - offset + k] & 0x7f) << (7 * k);
+
+		for (k = 0; k < 7; k++)
+			packed[i / 8 * 7 + k] = (word >> (8 * k)) & 0xff;
+
+		i += 8;
+	}
+
+	while (i < end) {
+		gsm7_pack_septet(packed, i, septets[i - offset] & 0x7f);
+		i++;
+	}
+
+	// Clear the bits following the last septet
+	if ((end * 7) & 7)
+		packed[length - 1] &= (1 << ((end * 7) & 7)) - 1;
+
+	return length;
+}
+
+/**
+ * Unpacks count septets from packed, starting at septet offset.
+ * Returns the number of septets, or 0 when packed is too short.
+ */
+size_t gsm7_unpack(const uint8_t *packed, size_t size, size_t offset, uint8_t *septets, size_t count)
+{
+	uint64_t word;
+	size_t end;
+	size_t i;
+	int k;
+
+	end = offset + count;
+	if (packed == NULL || septets == NULL || end * 7 > size * 8)
+		return 0;
+
+	i = offset;
+
+	while (i < end && (i & 7) != 0) {
+		septets[i - offset] = gsm7_unpack_septet(packed, i);
+		i++;
+	}
+
+	while (i + 8 <= end) {
+		word = 0;
+		for (k = 0; k < 7; k++)
+			word |= (uint64_t) packed[i / 8 * 7 + k] << (8 * k);
+
+		for (k = 0; k < 8; k++)
+			septets[i - offset + k] = (word >> (7 * k)) & 0x7f;
+
+		i += 8;
+	}
+
+	while (i < end) {
+		septets[i - offset] = gsm7_unpack_septet(packed, i);
+		i++;
+	}
+
+	return count;
+}
+
+/**
+ * Converts length bytes of UTF-8 to unpacked septets.
+ * Returns the number of septets, or -1 when a character can't be
+ * represented or size is too small.
+ */
+int utf8_to_gsm7(const char *utf8, size_t length, uint8_t *septets, size_t size)
+{
+	const unsigned char *p = (const unsigned char *) utf8;
+	const unsigned char *end = p + length;
+	unsigned int code;
+	size_t count = 0;
+	int septet;
+	int n;
+	size_t j;
+
+	if (utf8 == NULL || septets == NULL)
+		return -1;
+
+	while (p < end) {
+		if (*p < 0x80) {
+			code = *p++;
+		} else {
+			if ((*p & 0xe0) == 0xc0) {
+				code = *p & 0x1f;
+				n = 1;
+			} else if ((*p & 0xf0) == 0xe0) {
+				code = *p & 0x0f;
+				n = 2;
+			} else {
+				return -1;
+			}
+
+			if (end - p <= n)
+				return -1;
+
+			for (p++; n > 0; n--, p++) {
+				if ((*p & 0xc0) != 0x80)
+					return -1;
+				code = (code << 6) | (*p & 0x3f);
+			}
+		}
+
+		septet = -1;
+
+		if (code < 0x80) {
+			if (gsm7_ascii_table[code] != 0xff)
+				septet = gsm7_ascii_table[code];
+		} else {
+			for (j = 0; j < 128; j++) {
+				if (gsm7_default_alphabet[j] == code && j != GSM7_ESCAPE) {
+					septet = j;
+					break;
+				}
+			}
+
+			for (j = 0; septet < 0 && j < sizeof(gsm7_extension_table) / sizeof(gsm7_extension_table[0]); j++) {
+				if (gsm7_extension_table[j].code == code)
+					septet = 0x80 | gsm7_extension_table[j].septet;
+			}
+		}
+
+		if (septet < 0)
+			return -1;
+
+		if (septet & 0x80) {
+			if (count + 2 > size)
+				return -1;
+
+			septets[count++] = GSM7_ESCAPE;
+			septets[count++] = septet & 0x7f;
+		} else {
+			if (count + 1 > size)
+				return -1;
+
+			septets[count++] = septet;
+		}
+	}
+
+	return count;
+}
@@ -0,0 +1,35 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _SAMSUNG_RIL_GSM7_H_
+#define _SAMSUNG_RIL_GSM7_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define GSM7_ESCAPE		0x1B
+
+/* Number of bytes taken by count septets */
+#define GSM7_PACKED_SIZE(count)	(((count) * 7 + 7) / 8)
+
+size_t gsm7_pack(const uint8_t *septets, size_t count, size_t offset, uint8_t *packed, size_t size);
+size_t gsm7_unpack(const uint8_t *packed, size_t size, size_t offset, uint8_t *septets, size_t count);
+
+int utf8_to_gsm7(const char *utf8, size_t length, uint8_t *septets, size_t size);
+
+#endif
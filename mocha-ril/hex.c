@@ -0,0 +1,201 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+
+#include "hex.h"
+
+/**
+ * Hex digit values, 0xFF for anything else
+ */
+static const uint8_t hex_values[256] = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+/**
+ * Both digits of every byte value, so that encoding takes one lookup
+ */
+static const char hex_pairs_lower[512] =
+	"000102030405060708090a0b0c0d0e0f"
+	"101112131415161718191a1b1c1d1e1f"
+	"202122232425262728292a2b2c2d2e2f"
+	"303132333435363738393a3b3c3d3e3f"
+	"404142434445464748494a4b4c4d4e4f"
+	"505152535455565758595a5b5c5d5e5f"
+	"606162636465666768696a6b6c6d6e6f"
+	"707172737475767778797a7b7c7d7e7f"
+	"808182838485868788898a8b8c8d8e8f"
+	"909192939495969798999a9b9c9d9e9f"
+	"a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+	"b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+	"c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+	"d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+	"e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+	"f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+static const char hex_pairs_upper[512] =
+	"000102030405060708090A0B0C0D0E0F"
+	"101112131415161718191A1B1C1D1E1F"
+	"202122232425262728292A2B2C2D2E2F"
+	"303132333435363738393A3B3C3D3E3F"
+	"404142434445464748494A4B4C4D4E4F"
+	"505152535455565758595A5B5C5D5E5F"
+	"606162636465666768696A6B6C6D6E6F"
+	"707172737475767778797A7B7C7D7E7F"
+	"808182838485868788898A8B8C8D8E8F"
+	"909192939495969798999A9B9C9D9E9F"
+	"A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+	"B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+	"C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+	"D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+	"E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+	"F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+/*
+ * Returns the byte value of the two hex digits at string, or -1.
+ */
+int hex_byte(const char *string)
+{
+	unsigned int high, low;
+
+	high = hex_values[(unsigned char) string[0]];
+	if (high > 0x0F)
+		return -1;
+
+	low = hex_values[(unsigned char) string[1]];
+	if (low > 0x0F)
+		return -1;
+
+	return (high << 4) | low;
+}
+
+/*
+ * Returns the number of bytes the hex string decodes to, or -1 when its
+ * length is odd.
+ */
+int hex_decode_size(const char *string)
+{
+	size_t length;
+
+	if (string == NULL)
+		return -1;
+
+	length = strlen(string);
+	if (length % 2 != 0)
+		return -1;
+
+	return length / 2;
+}
+
+/*
+ * Decodes length hex digits into data, four bytes per iteration. Returns
+ * the number of bytes written or -1 on an odd length, an invalid digit
+ * or a too small buffer.
+ */
+int hex_decode(const char *string, size_t length, void *data, size_t size)
+{
+	const unsigned char *s = (const unsigned char *) string;
+	unsigned char *p = (unsigned char *) data;
+	unsigned int bad;
+	size_t count;
+	size_t i;
+
+	if (string == NULL || data == NULL || length % 2 != 0)
+		return -1;
+
+	count = length / 2;
+	if (count > size)
+		return -1;
+
+	bad = 0;
+
+	for (i = 0; i + 4 <= count; i += 4, s += 8) {
+		unsigned int h0 = hex_values[s[0]], l0 = hex_values[s[1]];
+		unsigned int h1 = hex_values[s[2]], l1 = hex_values[s[3]];
+		unsigned int h2 = hex_values[s[4]], l2 = hex_values[s[5]];
+		unsigned int h3 = hex_values[s[6]], l3 = hex_values[s[7]];
+
+		// Invalid digits have their high bits set
+		bad |= h0 | l0 | h1 | l1 | h2 | l2 | h3 | l3;
+
+		p[i] = (h0 << 4) | l0;
+		p[i + 1] = (h1 << 4) | l1;
+		p[i + 2] = (h2 << 4) | l2;
+		p[i + 3] = (h3 << 4) | l3;
+	}
+
+	for (; i < count; i++, s += 2) {
+		unsigned int h = hex_values[s[0]], l = hex_values[s[1]];
+
+		bad |= h | l;
+		p[i] = (h << 4) | l;
+	}
+
+	if (bad > 0x0F)
+		return -1;
+
+	return count;
+}
+
+static int hex_encode_pairs(const char *pairs, const void *data, size_t size, char *string, size_t length)
+{
+	const unsigned char *d = (const unsigned char *) data;
+	char *p = string;
+	size_t i;
+
+	if (data == NULL || string == NULL || length < HEX_LENGTH(size))
+		return -1;
+
+	for (i = 0; i < size; i++) {
+		memcpy(p, &pairs[d[i] * 2], 2);
+		p += 2;
+	}
+
+	*p = '\0';
+
+	return p - string;
+}
+
+/*
+ * Encodes size bytes as a NUL terminated hex string of at most length
+ * characters, including the NUL. Returns the string length or -1.
+ */
+int hex_encode(const void *data, size_t size, char *string, size_t length)
+{
+	return hex_encode_pairs(hex_pairs_lower, data, size, string, length);
+}
+
+int hex_encode_upper(const void *data, size_t size, char *string, size_t length)
+{
+	return hex_encode_pairs(hex_pairs_upper, data, size, string, length);
+}
@@ -0,0 +1,34 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _SAMSUNG_RIL_HEX_H_
+#define _SAMSUNG_RIL_HEX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Length of the hex string for size bytes, with the terminating NUL */
+#define HEX_LENGTH(size)	((size) * 2 + 1)
+
+int hex_byte(const char *string);
+int hex_decode_size(const char *string);
+int hex_decode(const char *string, size_t length, void *data, size_t size);
+int hex_encode(const void *data, size_t size, char *string, size_t length);
+int hex_encode_upper(const void *data, size_t size, char *string, size_t length);
+
+#endif
@@ -21,6 +21,7 @@
 
 #define LOG_TAG "RIL-Mocha-IPC"
 #include <utils/Log.h>
+#include <cutils/properties.h>
 
 #include "mocha-ril.h"
 #include <radio.h>
@@ -119,6 +120,8 @@ int ipc_read_loop(struct ril_client *client)
 			if(ipc_client_recv(ipc_client, &resp) < 0) {
 				RIL_CLIENT_UNLOCK(client);
 				ALOGE("IPC recv failed, aborting!");
+				// Last frames received before the failure
+				ipc_log_ring_dump(ipc_client);
 				return -1;
 			}
 			RIL_CLIENT_UNLOCK(client);
@@ -140,6 +143,7 @@ int ipc_create(struct ril_client *client)
 {
 	struct ipc_client_data *client_object;
 	struct ipc_client *ipc_client;
+	char value[PROPERTY_VALUE_MAX];
 	int ipc_client_fd;
 	int rc;
 
@@ -169,6 +173,11 @@ int ipc_create(struct ril_client *client)
 		return -1;
 	}
 
+	// Frame dump levels, e.g. "sim=2,drv=0"
+	property_get(RIL_IPC_LOG_PROPERTY, value, "");
+	if (value[0] != '\0')
+		ALOGD("%s: %d IPC log levels set", __func__, ipc_log_set_levels(value));
+
 	// ipc_client_set_handlers
 
 	ALOGD("Creating handlers common data");
@@ -33,6 +33,8 @@
 #define ipc_send_exec(command, mseq) \
 	ipc_send(command, IPC_TYPE_EXEC, NULL, 0, mseq)
 
+#define RIL_IPC_LOG_PROPERTY	"persist.ril.ipc.log"
+
 struct ipc_client_data {
 	struct ipc_client *ipc_client;
 	int ipc_client_fd;
@@ -81,3 +81,12 @@ void ril_request_get_imsi(RIL_Token t)
 		ril_data.tokens.get_imsi = t;
 	}
 }
+
+void ipc_drv_battery_status(void* data)
+{
+	struct srs_state_battery_packet battery;
+
+	battery.percentage = *((uint8_t *) data);
+
+	srs_publish(SRS_TOPIC_BATTERY, SRS_STATE_BATTERY, &battery, sizeof(battery));
+}
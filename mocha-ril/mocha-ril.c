@@ -23,6 +23,7 @@
 
 #define LOG_TAG "RIL-Mocha"
 
+#include <string.h>
 #include <time.h>
 #include <pthread.h>
 
@@ -249,6 +250,68 @@ void ril_request_timed_callback(RIL_TimedCallback callback, void *data, const st
 	ril_data.env->RequestTimedCallback(callback, data, time);
 }
 
+/**
+ * RIL state notifications
+ *
+ * SIM and radio state changes are published once per window: the
+ * changes made within RIL_STATE_NOTIFY_DELAY ms are merged, and nothing
+ * is sent for a state the framework already knows.
+ */
+
+static void ril_state_publish(void *data)
+{
+	struct ril_state_stats *stats = &ril_data.state_stats;
+	int sent = 0;
+
+	RIL_LOCK();
+
+	ril_data.state_notify_pending = 0;
+
+	if (ril_data.state.radio_state != ril_data.state_published_radio) {
+		ril_data.state_published_radio = ril_data.state.radio_state;
+		ril_request_unsolicited(RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED, NULL, 0);
+		stats->radio_sent++;
+		sent++;
+	}
+
+	if (ril_data.state.sim_state != ril_data.state_published_sim) {
+		ril_data.state_published_sim = ril_data.state.sim_state;
+		// Ready before the framework asks for it
+		ril_sim_card_status_update();
+		ril_request_unsolicited(RIL_UNSOL_RESPONSE_SIM_STATUS_CHANGED, NULL, 0);
+		stats->sim_sent++;
+		sent++;
+	}
+
+	if (sent == 0)
+		stats->suppressed++;
+
+	ALOGD("%s: radio %d, SIM %d: %u changes, %u merged, %u suppressed, %u radio and %u SIM notifications sent",
+		__func__, ril_data.state.radio_state, ril_data.state.sim_state,
+		stats->changes, stats->coalesced, stats->suppressed,
+		stats->radio_sent, stats->sim_sent);
+
+	RIL_UNLOCK();
+}
+
+void ril_state_notify(void)
+{
+	struct timeval delay;
+
+	ril_data.state_stats.changes++;
+
+	if (ril_data.state_notify_pending) {
+		ril_data.state_stats.coalesced++;
+		return;
+	}
+
+	ril_data.state_notify_pending = 1;
+
+	delay.tv_sec = 0;
+	delay.tv_usec = RIL_STATE_NOTIFY_DELAY * 1000;
+	ril_request_timed_callback(ril_state_publish, NULL, &delay);
+}
+
 /**
  * RIL tokens
  * this should be called after syssec data loading and after receiving system info from modem
@@ -287,8 +350,14 @@ void srs_dispatch(struct srs_client_info *client, struct srs_message *message)
 		case SRS_CONTROL_PING:
 			srs_control_ping(client, message);
 			break;
+		case SRS_CONTROL_SUBSCRIBE:
+			srs_control_subscribe(client, message);
+			break;
+		case SRS_CONTROL_UNSUBSCRIBE:
+			srs_control_unsubscribe(client, message);
+			break;
 		case SRS_GPS_HELLO:
-			client->type = SRS_CLIENT_TYPE_GPS;
+			srs_gps_hello(client, message);
 			break;
 		case SRS_SND_SET_VOLUME:
 			srs_snd_set_volume(message);
@@ -544,9 +613,11 @@ void ril_install_ipc_callbacks(void)
 	ipc_register_ril_cb(SIM_STATUS, ipc_sim_status);
 	ipc_register_ril_cb(SIM_IO_RESPONSE, ipc_sim_io_response);
 	ipc_register_ril_cb(SIM_SMSC_NUMBER, ipc_sim_smsc_number);
+	ipc_register_ril_cb(SIM_ATK_EVENT, ipc_sim_atk_event);
 	ipc_register_ril_cb(LOCK_STATUS, ipc_lock_status);
 	ipc_register_ril_cb(NETTEXT_INCOMING, ipc_incoming_sms);
 	ipc_register_ril_cb(NETTEXT_SEND_CALLBACK, ipc_sms_send_status);
+	ipc_register_ril_cb(NETTEXT_CB_INCOMING, ipc_cbs_incoming);
 	ipc_register_ril_cb(SS_USSD_CALLBACK, ipc_ss_ussd_response);
 	ipc_register_ril_cb(SS_ERROR, ipc_ss_error_response);
 	ipc_register_ril_cb(LBS_GET_POSITION_IND, ipc_lbs_get_position_ind);
@@ -558,17 +629,26 @@ void ril_install_ipc_callbacks(void)
 	ipc_register_ril_cb(PROTO_RECEIVE_DATA_IND, ipc_proto_receive_data_ind);
 	ipc_register_ril_cb(PROTO_SUSPEND_NETWORK_IND, ipc_proto_suspend_network_ind);
 	ipc_register_ril_cb(PROTO_RESUME_NETWORK_IND, ipc_proto_resume_network_ind);
+	ipc_register_ril_cb(DRV_BATTERY_STATUS, ipc_drv_battery_status);
 }
  
-void ril_data_init(void)
+void ril_data_init(const char *data_path)
 {
 	memset(&ril_data, 0, sizeof(ril_data));
 
+	strncpy(ril_data.data_path, data_path, sizeof(ril_data.data_path) - 1);
+
 	pthread_mutex_init(&ril_data.mutex, NULL);
 	ril_data.state.sim_state = SIM_STATE_NOT_READY;
+	ril_data.state_published_radio = -1;
+	ril_data.state_published_sim = -1;
+	ril_data.card_status_state = -1;
 	ril_data.inDevice = SND_INPUT_MAIN_MIC;
 	ril_data.outDevice = SND_OUTPUT_EARPIECE;
 	load_ril_config();
+	ril_sms_init();
+	ril_network_init();
+	ril_stk_init();
 }
 
 /**
@@ -588,13 +668,20 @@ const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc, char **a
 {
 	struct ril_client *ipc_packet_client;
 	struct ril_client *srs_client;
+	const char *data_path = RIL_DATA_PATH;
 	int rc;
+	int i;
     pthread_t networkInit;
 
 	if(env == NULL)
 		return NULL;
 
-	ril_data_init();
+	for (i = 1; i < argc - 1; i++) {
+		if (strcmp(argv[i], "-d") == 0)
+			data_path = argv[++i];
+	}
+
+	ril_data_init(data_path);
 	ril_data.env = (struct RIL_Env *) env;
 
 	RIL_LOCK();
@@ -35,6 +35,7 @@
 
 #include <tapi_network.h>
 #include <tapi_call.h>
+#include <tapi_nettext.h>
 
 /**
  * Defines
@@ -136,7 +137,6 @@ struct ril_tokens {
 	RIL_Token get_imeisv;
 	RIL_Token baseband_version;
 	RIL_Token operator;
-	RIL_Token outgoing_sms;
 	RIL_Token dtmf_start;
 	RIL_Token dtmf_stop;
 	RIL_Token query_avail_networks;
@@ -144,7 +144,6 @@ struct ril_tokens {
 	RIL_Token setup_data_call;
 	RIL_Token set_facility_lock;
 	RIL_Token change_sim_pin;
-	RIL_Token sim_io;
 };
 
 void ril_tokens_check(void);
@@ -189,12 +188,34 @@ struct ril_state {
 	unsigned char dtmf_tone;
 };
 
+/*
+ * The configuration and the SMS outbox are kept in RIL_DATA_PATH, or in
+ * the directory given to RIL_Init with -d.
+ */
+#define RIL_DATA_PATH			"/data/radio"
+#define RIL_DATA_PATH_SIZE		128
+
 typedef struct ril_config {
 	uint32_t bAutoAttach;
 } ril_config;
 
 void ril_state_lpm(void);
 
+/* State notifications, merged over RIL_STATE_NOTIFY_DELAY ms */
+#define RIL_STATE_NOTIFY_DELAY		100
+
+struct ril_state_stats {
+	unsigned int changes;
+	unsigned int coalesced;
+	unsigned int suppressed;
+	unsigned int radio_sent;
+	unsigned int sim_sent;
+	unsigned int card_status_hits;
+	unsigned int card_status_builds;
+};
+
+void ril_state_notify(void);
+
 /**
  * RIL data
  */
@@ -231,29 +252,191 @@ typedef struct ril_net_select {
 	tapiNetSearchCnf net_select_entry;
 } ril_net_select;
 
+struct ril_sms_stats {
+	unsigned int sent;
+	unsigned int failed;
+	unsigned int inflight;
+	unsigned int inflight_max;
+	unsigned int latency_total;
+	unsigned int latency_max;
+	unsigned int received;
+	unsigned int receive_time_total;
+	unsigned int receive_time_max;
+	unsigned int retries;
+	unsigned int replayed;
+};
+
+struct ril_cbs_stats {
+	unsigned int pages;
+	unsigned int duplicates;
+	unsigned int delivered;
+	unsigned int dropped;
+};
+
+struct ril_stk_stats {
+	unsigned int queued;
+	unsigned int processed;
+	unsigned int dropped;
+	unsigned int depth;
+	unsigned int depth_max;
+	unsigned int latency_total;
+	unsigned int latency_max;
+};
+
+#define RIL_CBS_PAGE_SIZE		88
+#define RIL_CBS_PAGES_MAX		15
+#define RIL_CBS_MESSAGES		4
+#define RIL_CBS_TIMEOUT			60
+#define RIL_CBS_SEEN_SETS		64
+#define RIL_CBS_SEEN_WAYS		4
+#define RIL_CBS_SEEN_TIMEOUT		(30 * 60)
+
+/* Delivered (serial, message id) pair, time is 0 for a free way */
+struct ril_cbs_seen {
+	uint32_t key;
+	time_t time;
+};
+
+struct ril_sms_concat_stats {
+	unsigned int parts;
+	unsigned int reassembled;
+	unsigned int duplicates;
+	unsigned int timeouts;
+	unsigned int evictions;
+	unsigned int size_max;
+};
+
+#define RIL_SIM_IO_DATA_SIZE		256
+
+struct ril_request_sim_io_info;
+
+/*
+ * Called with the raw response of SIM I/O requests issued by the RIL
+ * itself, instead of completing a token.
+ */
+typedef void (*ril_sim_io_callback)(struct ril_request_sim_io_info *sim_io,
+	int sw1, int sw2, unsigned char *data, size_t size);
+
 typedef struct ril_request_sim_io_info {
 	int command;
 	int fileid;
 	int p1;
 	int p2;
 	int p3;
-	char *data;
+	unsigned char data[RIL_SIM_IO_DATA_SIZE];
 	int length;
 	int waiting;
 	RIL_Token token;
+	ril_sim_io_callback callback;
+	struct ril_request_sim_io_info *leader;
+	struct timeval queue_time;
+	struct timeval time;
 } ril_request_sim_io_info;
 
+#define RIL_SIM_IO_WINDOW		1
+#define RIL_SIM_IO_WINDOW_PROPERTY	"ro.ril.sim.io_window"
+
+struct ril_sim_io_stats {
+	unsigned int requests;
+	unsigned int coalesced;
+	unsigned int inflight;
+	unsigned int inflight_max;
+	unsigned int queue_total;
+	unsigned int latency_total;
+	unsigned int latency_max;
+};
+
+/* From SIM ready until the RIL loaded its files */
+struct ril_sim_boot_stats {
+	int running;
+	struct timeval start;
+	struct timeval end;
+	unsigned int modem;
+	unsigned int framework;
+	unsigned int local;
+};
+
+#define RIL_SIM_CACHE_ENTRIES		64
+#define RIL_SIM_CACHE_SIZE		8192
+
+struct ril_sim_cache_entry {
+	int command;
+	int fileid;
+	int p1;
+	int p2;
+	int p3;
+	int sw1;
+	int sw2;
+	unsigned char *data;
+	size_t size;
+	unsigned int used;
+};
+
+struct ril_sim_cache_stats {
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int invalidations;
+	unsigned int evictions;
+};
+
+/*
+ * What the framework reads back after a network state change: the
+ * voice and data registration states and the operator.
+ */
+struct ril_network_snapshot {
+	int reg_state;
+	int act;
+	uint32_t cell_id;
+	uint16_t lac_id;
+	uint8_t rac_id;
+	char plmn[9];
+	char name[NET_MAX_NAME_LEN];
+	char SPN[NET_MAX_SPN_LEN];
+};
+
+struct ril_network_stats {
+	unsigned int indications;
+	unsigned int coalesced;
+	unsigned int suppressed;
+	unsigned int sent;
+};
+
 struct ril_data {
 	struct RIL_Env *env;
 
 	struct ril_state state;
+	int state_notify_pending;
+	RIL_RadioState state_published_radio;
+	ril_sim_state state_published_sim;
+	struct ril_state_stats state_stats;
+	struct ril_network_snapshot network_published;
+	int network_published_valid;
+	int network_notify_pending;
+	int network_notify_delay;
+	struct ril_network_stats network_stats;
 	struct ril_tokens tokens;
 	ril_config config;
+	char data_path[RIL_DATA_PATH_SIZE];
 	struct list_head *outgoing_sms;
 	struct list_head *gprs_connections;
 	struct list_head *net_select_list;
 	struct list_head *requests;
 	struct list_head *sim_io;
+	int sim_io_window;
+	int sim_io_barrier;
+	struct ril_sim_io_stats sim_io_stats;
+	struct ril_sim_boot_stats sim_boot_stats;
+	struct list_head *sim_store;
+	struct list_head *sim_cache;
+	int sim_cache_count;
+	size_t sim_cache_size;
+	unsigned int sim_cache_tick;
+	struct ril_sim_cache_stats sim_cache_stats;
+	int sim_prefetch_started;
+	int sim_prefetch_pending;
+	struct timeval sim_prefetch_start;
+	RIL_CardStatus_v6 card_status;
+	ril_sim_state card_status_state;
 
 	char cached_sw_version[33];
 	uint8_t cached_bcd_imsi[14];
@@ -261,6 +444,27 @@ struct ril_data {
 
 	int request_id;
 	char smsc_number[60];
+	int sms_send_window;
+	int sms_ref;
+	struct ril_sms_stats sms_stats;
+	int sms_outbox_fd;
+	uint8_t *sms_outbox;
+	size_t sms_outbox_tail;
+	uint32_t sms_outbox_id;
+	int sms_outbox_compact;
+	int sms_concat_enabled;
+	struct list_head *sms_concat;
+	unsigned int sms_concat_size;
+	struct ril_sms_concat_stats sms_concat_stats;
+	struct list_head *cbs_messages;
+	struct ril_cbs_seen cbs_seen[RIL_CBS_SEEN_SETS][RIL_CBS_SEEN_WAYS];
+	uint8_t cbs_seen_next[RIL_CBS_SEEN_SETS];
+	struct ril_cbs_stats cbs_stats;
+	struct list_head *stk_events;
+	struct ril_stk_stats stk_stats;
+	pthread_t stk_thread;
+	pthread_mutex_t stk_mutex;
+	pthread_cond_t stk_cond;
 	int inDevice;
 	int outDevice;
 	ril_call_context *calls[MAX_CALLS];
@@ -290,8 +494,10 @@ void ril_request_get_imeisv(RIL_Token t);
 void ril_request_baseband_version(RIL_Token t);
 void ril_request_get_imsi(RIL_Token t);
 void ril_request_screen_state(RIL_Token t, void *data, size_t datalen);
+void ipc_drv_battery_status(void* data);
 
 /* CALL */
+void ril_call_state_changed(void);
 void ipc_call_incoming(void* data);
 void ipc_call_end(void* data);
 void ipc_call_setup_ind(void* data);
@@ -337,6 +543,11 @@ void ril_request_data_call_list(RIL_Token t);
 void proto_stop_context(uint8_t type, uint32_t contextId);
 
 /* NETWORK */
+#define RIL_NETWORK_NOTIFY_DELAY		500
+#define RIL_NETWORK_NOTIFY_DELAY_PROPERTY	"ro.ril.network.notify_delay"
+
+void ril_network_init(void);
+void ril_network_notify(void);
 int ril_net_select_register(char *plmn, tapiNetSearchCnf net_select_entry);
 void ril_net_select_unregister(void);
 struct ril_net_select *ril_net_select_find_plmn(char *plmn);
@@ -368,6 +579,10 @@ void ipc_sim_status(void *data);
 void ipc_lock_status(void* data);
 void ipc_sim_smsc_number(void* data);
 void ipc_sim_io_response(void* data);
+void ril_sim_files_load(void);
+void ril_sim_files_clear(void);
+void ril_sim_files_refresh(void);
+void ril_sim_card_status_update(void);
 void ril_request_get_sim_status(RIL_Token t);
 void ril_state_update(ril_sim_state sim_state);
 void ril_request_enter_sim_pin(RIL_Token t, void *data, size_t size);
@@ -381,32 +596,278 @@ int ril_request_sim_io_register(RIL_Token t, int command, int fileid,
 void ril_request_sim_io_unregister(struct ril_request_sim_io_info *sim_io);
 struct ril_request_sim_io_info *ril_request_sim_io_info_find(void);
 struct ril_request_sim_io_info *ril_request_sim_io_info_find_token(RIL_Token t);
+struct ril_request_sim_io_info *ril_request_sim_io_info_find_same(struct ril_request_sim_io_info *sim_io);
+int ril_request_sim_io_update_pending(int fileid);
+struct ril_request_sim_io_info *ril_request_sim_io_info_find_busy(int event, int fileid);
 void ril_request_sim_io_info_clear(struct ril_request_sim_io_info *sim_io);
+void ril_request_sim_io_done(struct ril_request_sim_io_info *sim_io,
+	int sw1, int sw2, unsigned char *data, size_t size);
+void ril_request_sim_io_stats_update(struct ril_request_sim_io_info *sim_io);
 void ril_request_sim_io_next(void);
 void ril_request_sim_io_complete(RIL_Token t, int command, int fileid,
 	int p1, int p2, int p3, void *data, size_t size);
+void ril_request_sim_io_respond(RIL_Token t, int sw1, int sw2, void *data, size_t size);
+int ril_sim_io_request(int command, int fileid, int p1, int p2, int p3,
+	void *data, size_t size, ril_sim_io_callback callback);
 void ril_request_sim_io(RIL_Token t, void *data, size_t size);
 
+/* SIM store */
+#define SIM_EF_ADN			0x6F3A
+#define SIM_EF_FDN			0x6F3B
+#define SIM_EF_SMS			0x6F3C
+
+#define SIM_STORE_LOADING		1
+#define SIM_STORE_READY			2
+
+/* Record reads of a loading file queued at a time */
+#define SIM_STORE_READS			2
+
+/*
+ * Linear fixed EF kept in memory: records are stored back to back in
+ * one arena, with a flag telling which ones were read.
+ */
+struct sim_store_file {
+	int fileid;
+	int state;
+	int record_size;
+	int count;
+	int loaded;
+	int failed;
+	int next;
+	int reading;
+	unsigned char info[15]; /* struct sim_file_response */
+	unsigned char *records;
+	unsigned char *valid;
+	struct timeval start;
+
+	/* Record numbers sorted by content, for SEEK */
+	unsigned char *index;
+	int index_count;
+	int index_dirty;
+
+	unsigned int hits;
+	unsigned int writes;
+	unsigned int seeks;
+};
+
+/* EF_SMS index: records by status (TS 51.011 10.5.3) */
+struct sim_store_sms_index {
+	int free;
+	int read;
+	int unread;
+	int sent;
+	int unsent;
+};
+
+void sim_store_load(int fileid);
+void sim_store_clear(void);
+struct sim_store_file *sim_store_find(int fileid);
+unsigned char *sim_store_record(struct sim_store_file *file, int index);
+int sim_store_request(RIL_Token t, int command, int fileid,
+	int p1, int p2, int p3, void *data, size_t size);
+void sim_store_response(struct ril_request_sim_io_info *sim_io,
+	int sw1, int sw2, unsigned char *data, size_t size);
+void sim_store_sms_index(struct sim_store_sms_index *index);
+int sim_store_loading(void);
+
+/* SIM cache */
+int sim_cache_request(RIL_Token t, int command, int fileid, int p1, int p2, int p3);
+void sim_cache_response(struct ril_request_sim_io_info *sim_io,
+	int sw1, int sw2, unsigned char *data, size_t size);
+void sim_cache_invalidate(int fileid);
+void sim_cache_clear(void);
+
+/* SIM prefetch */
+#define RIL_SIM_PREFETCH_PROPERTY	"ro.ril.sim.prefetch"
+#define RIL_SIM_PREFETCH_FILES		16
+
+struct sim_prefetch_file {
+	int fileid;
+	int records;
+};
+
+void sim_prefetch_start(void);
+void sim_prefetch_reset(void);
+
 /* SMS */
+#define RIL_SMS_SEND_WINDOW		1
+#define RIL_SMS_SEND_WINDOW_PROPERTY	"ro.ril.sms.send_window"
+#define RIL_SMS_PDU_SIZE		512
+#define RIL_SMS_SEPTETS_MAX		(7 + 160)
+#define RIL_SMS_CONCAT_PROPERTY		"ro.ril.sms.concat"
+#define RIL_SMS_CONCAT_ENTRIES		8
+#define RIL_SMS_CONCAT_SIZE		(16 * 1024)
+#define RIL_SMS_CONCAT_TIMEOUT		30
+
+#define SMS_ALPHABET_GSM7		0
+#define SMS_ALPHABET_8BIT		1
+#define SMS_ALPHABET_UCS2		2
+
+/*
+ * Decoded SMS-SUBMIT TPDU. The user data is kept as sent, with ud_offset
+ * (in septets for GSM7, octets otherwise) pointing past the header.
+ */
+struct sms_submit {
+	uint8_t type;
+	uint8_t da_type;
+	uint8_t da_length;
+	uint8_t da[10];
+	uint8_t pid;
+	uint8_t dcs;
+	uint8_t alphabet;
+	uint8_t vp_format;
+	uint8_t vp;
+
+	int concat;
+	uint8_t concat_ref;
+	uint8_t concat_count;
+	uint8_t concat_seq;
+
+	uint8_t udl;
+	uint8_t ud_offset;
+	uint8_t ud_size;
+	uint8_t ud[140];
+
+	uint8_t smsc_type;
+	uint8_t smsc_length;
+	uint8_t smsc[11];
+};
+
 struct ril_request_send_sms_info {
-	unsigned char *pdu;
-	size_t pdu_size;
-	unsigned char *smsc;
-	size_t smsc_size;
+	struct sms_submit submit;
 	RIL_Token token;
+
+	int ref;
+	int inflight;
+	struct timeval time;
+
+	uint32_t journal_id;
+	int retries;
+	struct timeval retry_time;
 };
+
+/*
+ * SMS outbox journal: records appended to a mapped file, ADD with the
+ * struct sms_submit of a queued message and DONE with the id of one
+ * that no longer needs sending.
+ */
+#define RIL_SMS_OUTBOX_FILE		"sms_outbox"
+#define RIL_SMS_OUTBOX_SIZE		(64 * 1024)
+#define RIL_SMS_OUTBOX_MAGIC		0x584f424f
+#define RIL_SMS_OUTBOX_VERSION		1
+
+#define RIL_SMS_OUTBOX_ADD		1
+#define RIL_SMS_OUTBOX_DONE		2
+
+#define RIL_SMS_RETRY_MAX		3
+#define RIL_SMS_RETRY_DELAY		2
+#define RIL_SMS_RP_CAUSE_MAX		127
+
+struct ril_sms_outbox_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	uint32_t reserved;
+};
+
+struct ril_sms_outbox_record {
+	uint32_t checksum;
+	uint16_t type;
+	uint16_t length;
+	uint32_t id;
+	uint8_t data[0];
+};
+void ril_sms_init(void);
 void ipc_sms_send_status(void* data);
-int ril_request_send_sms_register(unsigned char *pdu, size_t pdu_size, unsigned char *smsc, size_t smsc_size, RIL_Token t);
+int sms_submit_decode(struct sms_submit *submit, const char *pdu, const char *smsc);
+int sms_submit_encode(struct sms_submit *submit, tapiNettextInfo *info);
+int ril_request_send_sms_register(struct sms_submit *submit, RIL_Token t,
+	struct ril_request_send_sms_info **send_sms_p);
 void ril_request_send_sms_unregister(struct ril_request_send_sms_info *send_sms);
 struct ril_request_send_sms_info *ril_request_send_sms_info_find(void);
+struct ril_request_send_sms_info *ril_request_send_sms_info_find_inflight(void);
+struct ril_request_send_sms_info *ril_request_send_sms_info_find_ref(uint32_t ref);
 void ril_request_send_sms_next(void);
-void ril_request_send_sms_complete(RIL_Token t, unsigned char *pdu, size_t pdu_size, unsigned char *smsc, size_t smsc_size);
+int ril_request_send_sms_complete(struct ril_request_send_sms_info *send_sms);
 void ril_request_send_sms(RIL_Token t, void *data, size_t length);
+void ril_sms_outbox_open(void);
+void ril_sms_outbox_add(struct ril_request_send_sms_info *send_sms);
+void ril_sms_outbox_done(struct ril_request_send_sms_info *send_sms);
+/*
+ * Parts of a concatenated incoming message, held back until all of them
+ * are received, the timeout expires or the cache is full.
+ */
+struct ril_sms_concat {
+	// szFromNumber is 21 bytes, not always NUL-terminated
+	char originator[22];
+	uint8_t ref;
+	uint8_t count;
+	uint8_t received;
+	char *pdus[255];
+	unsigned int size;
+	struct timeval time;
+};
+
+int sms_deliver_pdu_build(tapiNettextInfo *info, char *pdu, size_t size);
 void ipc_incoming_sms(void* data);
 void ril_request_send_sms_expect_more(RIL_Token t, void *data, size_t length);
 void nettext_cb_setup(void);
 
+/* CBS */
+
+/*
+ * Pages of a multi-page cell broadcast message, held until all of them
+ * are received.
+ */
+struct ril_cbs_message {
+	uint16_t serial;
+	uint16_t msgid;
+	uint8_t count;
+	uint8_t received;
+	uint8_t pages[RIL_CBS_PAGES_MAX][RIL_CBS_PAGE_SIZE];
+	time_t time;
+};
+
+void ipc_cbs_incoming(void *data);
+void ril_cbs_cell_changed(void);
+
+/* STK */
+#define RIL_STK_QUEUE_SIZE		16
+#define RIL_STK_DATA_SIZE		512
+
+/* Proactive command types (TS 102 223 9.4) */
+#define STK_COMMAND_REFRESH		0x01
+
+struct ril_stk_event {
+	int type;
+	int subtype;
+	size_t length;
+	uint8_t data[RIL_STK_DATA_SIZE];
+	struct timeval time;
+};
+
+/*
+ * Proactive command, pointing into the BER-TLV it was parsed from.
+ */
+struct ril_stk_command {
+	int number;
+	int type;
+	int qualifier;
+	int source;
+	int destination;
+	uint8_t *data;
+	size_t length;
+};
+
+void ril_stk_init(void);
+int ril_stk_queue(int type, int subtype, void *data, size_t length);
+int ril_stk_command_parse(struct ril_stk_command *command, uint8_t *data, size_t length);
+void ipc_sim_atk_event(void *data);
+
 /* SS */
+/* Octets of a packed USSD string */
+#define RIL_USSD_SIZE			160
+
 void ril_request_send_ussd(RIL_Token t, void *data, size_t datalen);
 void ril_request_cancel_ussd(RIL_Token t, void *data, size_t datalen);
 void ipc_ss_ussd_response(void* data);
@@ -420,6 +881,7 @@ void srs_snd_1mic_ns_ctrl(struct srs_message *message);
 void srs_snd_pcm_if_ctrl(struct srs_message *message);
 
 /* GPS */
+int ril_gps_shm_fd(void);
 void ipc_lbs_get_position_ind(void* data);
 void ipc_lbs_state_ind(void* data);
 void srs_gps_navigation_mode(struct srs_message *message);
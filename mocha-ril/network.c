@@ -22,6 +22,7 @@
 #define LOG_TAG "RIL-Mocha-NETWORK"
 #include <time.h>
 #include <utils/Log.h>
+#include <cutils/properties.h>
 
 #include "mocha-ril.h"
 #include "util.h"
@@ -30,6 +31,93 @@
 #include <sim.h>
 #include <proto.h>
 
+void ril_network_init(void)
+{
+	char value[PROPERTY_VALUE_MAX];
+	int delay;
+
+	memset(&ril_data.network_stats, 0, sizeof(ril_data.network_stats));
+
+	property_get(RIL_NETWORK_NOTIFY_DELAY_PROPERTY, value, "");
+	delay = value[0] != '\0' ? atoi(value) : RIL_NETWORK_NOTIFY_DELAY;
+	if (delay < 0)
+		delay = RIL_NETWORK_NOTIFY_DELAY;
+
+	ril_data.network_notify_delay = delay;
+	ALOGD("%s: Network notification delay is %d ms", __func__, delay);
+}
+
+/*
+ * Network state indications only reach the framework when what it reads
+ * back changed: indications within the delay are merged, and the state
+ * is compared with the last one published.
+ */
+static void ril_network_publish(void)
+{
+	struct ril_network_stats *stats = &ril_data.network_stats;
+	struct ril_network_snapshot snapshot;
+
+	ril_data.network_notify_pending = 0;
+
+	memset(&snapshot, 0, sizeof(snapshot));
+	snapshot.reg_state = ril_data.state.reg_state;
+	snapshot.act = ril_data.state.act;
+	snapshot.cell_id = ril_data.state.cell_id;
+	snapshot.lac_id = ril_data.state.lac_id;
+	snapshot.rac_id = ril_data.state.rac_id;
+	strncpy(snapshot.plmn, ril_data.state.proper_plmn, sizeof(snapshot.plmn) - 1);
+	strncpy(snapshot.name, ril_data.state.name, sizeof(snapshot.name) - 1);
+	strncpy(snapshot.SPN, ril_data.state.SPN, sizeof(snapshot.SPN) - 1);
+
+	if (ril_data.network_published_valid &&
+		memcmp(&snapshot, &ril_data.network_published, sizeof(snapshot)) == 0) {
+		stats->suppressed++;
+		return;
+	}
+
+	memcpy(&ril_data.network_published, &snapshot, sizeof(snapshot));
+	ril_data.network_published_valid = 1;
+	stats->sent++;
+
+	ril_request_unsolicited(RIL_UNSOL_RESPONSE_VOICE_NETWORK_STATE_CHANGED, NULL, 0);
+}
+
+static void ril_network_publish_callback(void *data)
+{
+	RIL_LOCK();
+	ril_network_publish();
+	RIL_UNLOCK();
+}
+
+void ril_network_notify(void)
+{
+	struct ril_network_stats *stats = &ril_data.network_stats;
+	struct timeval delay;
+
+	stats->indications++;
+
+	if (stats->indications % 32 == 0)
+		ALOGD("%s: %u indications: %u merged, %u suppressed, %u sent",
+			__func__, stats->indications, stats->coalesced,
+			stats->suppressed, stats->sent);
+
+	if (ril_data.network_notify_pending) {
+		stats->coalesced++;
+		return;
+	}
+
+	if (ril_data.network_notify_delay == 0) {
+		ril_network_publish();
+		return;
+	}
+
+	ril_data.network_notify_pending = 1;
+
+	delay.tv_sec = ril_data.network_notify_delay / 1000;
+	delay.tv_usec = (ril_data.network_notify_delay % 1000) * 1000;
+	ril_request_timed_callback(ril_network_publish_callback, NULL, &delay);
+}
+
 int ril_net_select_register(char *plmn, tapiNetSearchCnf net_select_entry)
 {
 	struct ril_net_select *net_select;
@@ -149,6 +237,7 @@ int ril2ipc_plmn_sel(int mode)
 void ipc_network_radio_info(void* data)
 {
 	tapiRadioInfo* radioInfo = (tapiRadioInfo*)(data);
+	struct srs_state_signal_strength_packet signal_strength;
 	RIL_SignalStrength_v6 ss;
 	int rssi,asu;
 
@@ -194,6 +283,11 @@ void ipc_network_radio_info(void* data)
 	ss.GW_SignalStrength.bitErrorRate = 99;
 
 	ril_request_unsolicited(RIL_UNSOL_SIGNAL_STRENGTH, &ss, sizeof(ss));
+
+	signal_strength.signal_strength = ss.GW_SignalStrength.signalStrength;
+	signal_strength.bit_error_rate = ss.GW_SignalStrength.bitErrorRate;
+
+	srs_publish(SRS_TOPIC_SIGNAL_STRENGTH, SRS_STATE_SIGNAL_STRENGTH, &signal_strength, sizeof(signal_strength));
 }
 
 void ipc_network_select(void* data)
@@ -259,7 +353,7 @@ void ipc_network_select(void* data)
 		ril_data.tokens.network_selection = 0;
 	}
 
-	ril_request_unsolicited(RIL_UNSOL_RESPONSE_VOICE_NETWORK_STATE_CHANGED, NULL, 0);
+	ril_network_notify();
 }
 
 void ipc_cell_info(void* data)
@@ -272,6 +366,7 @@ void ipc_cell_info(void* data)
 	if(cellInfo->bCellChanged)
 	{
 		ril_data.state.cell_id = (uint32_t)cellInfo->cellId[0] << 24 | (uint32_t)cellInfo->cellId[1] << 16 | (uint32_t)cellInfo->cellId[2] << 8 | (uint32_t)cellInfo->cellId[3];
+		ril_cbs_cell_changed();
 	}
 	if(cellInfo->bRACChanged)
 	{
@@ -298,7 +393,7 @@ void ipc_cell_info(void* data)
 		}
 		sprintf(ril_data.state.proper_plmn, "%d", plmn_dec);
 	}
-	ril_request_unsolicited(RIL_UNSOL_RESPONSE_VOICE_NETWORK_STATE_CHANGED, NULL, 0);
+	ril_network_notify();
 }
 
 
@@ -0,0 +1,377 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LOG_TAG "RIL-Mocha-Outbox"
+#include <utils/Log.h>
+
+#include "mocha-ril.h"
+#include "util.h"
+
+/*
+ * Queued and in-flight SMS are journaled in RIL_SMS_OUTBOX_FILE, so that
+ * they are sent again after a RIL restart. Records are only appended,
+ * each with a checksum so that a torn record ends the replay. Once half
+ * the journal is used, it is rewritten with only the pending messages in
+ * a new file that replaces the old one.
+ */
+
+#define RIL_SMS_OUTBOX_ALIGN(length)	(((length) + 3) & ~3)
+
+static uint32_t ril_sms_outbox_checksum(struct ril_sms_outbox_record *record)
+{
+	uint8_t *p = (uint8_t *) record + sizeof(record->checksum);
+	size_t size = sizeof(struct ril_sms_outbox_record) - sizeof(record->checksum) + record->length;
+	uint32_t checksum = 2166136261U;
+	size_t i;
+
+	// FNV-1a
+	for (i = 0; i < size; i++) {
+		checksum ^= p[i];
+		checksum *= 16777619U;
+	}
+
+	return checksum;
+}
+
+static void ril_sms_outbox_header_init(uint8_t *map)
+{
+	struct ril_sms_outbox_header *header = (struct ril_sms_outbox_header *) map;
+
+	memset(map, 0, RIL_SMS_OUTBOX_SIZE);
+
+	header->magic = RIL_SMS_OUTBOX_MAGIC;
+	header->version = RIL_SMS_OUTBOX_VERSION;
+	header->size = RIL_SMS_OUTBOX_SIZE;
+}
+
+static uint8_t *ril_sms_outbox_map(int fd)
+{
+	void *map;
+	int rc;
+
+	rc = ftruncate(fd, RIL_SMS_OUTBOX_SIZE);
+	if (rc < 0)
+		return NULL;
+
+	map = mmap(NULL, RIL_SMS_OUTBOX_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	return (uint8_t *) map;
+}
+
+/*
+ * Appends a record at offset in map, returns the offset past it or 0
+ * when it doesn't fit.
+ */
+static size_t ril_sms_outbox_write(uint8_t *map, size_t offset, uint16_t type, uint32_t id, void *data, uint16_t length)
+{
+	struct ril_sms_outbox_record *record;
+	size_t size;
+
+	size = RIL_SMS_OUTBOX_ALIGN(sizeof(struct ril_sms_outbox_record) + length);
+	if (offset + size > RIL_SMS_OUTBOX_SIZE)
+		return 0;
+
+	record = (struct ril_sms_outbox_record *) (map + offset);
+	record->type = type;
+	record->length = length;
+	record->id = id;
+	if (data != NULL && length > 0)
+		memcpy(record->data, data, length);
+
+	// The checksum goes last, making the record valid
+	record->checksum = ril_sms_outbox_checksum(record);
+
+	return offset + size;
+}
+
+/*
+ * Rewrites the journal with only the messages still queued.
+ */
+static int ril_sms_outbox_compact(void)
+{
+	struct ril_request_send_sms_info *send_sms;
+	struct list_head *list;
+	uint8_t *map;
+	size_t tail;
+	size_t offset;
+	char path_new[RIL_DATA_PATH_SIZE];
+	char path[RIL_DATA_PATH_SIZE];
+	int fd;
+	int rc;
+
+	if (ril_data_path(path, sizeof(path), RIL_SMS_OUTBOX_FILE) < 0 ||
+		ril_data_path(path_new, sizeof(path_new), RIL_SMS_OUTBOX_FILE ".new") < 0)
+		return -1;
+
+	fd = open(path_new, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		ALOGE("%s: Unable to create the new journal", __func__);
+		return -1;
+	}
+
+	map = ril_sms_outbox_map(fd);
+	if (map == NULL)
+		goto error;
+
+	ril_sms_outbox_header_init(map);
+	tail = sizeof(struct ril_sms_outbox_header);
+
+	list = ril_data.outgoing_sms;
+	while (list != NULL) {
+		send_sms = (struct ril_request_send_sms_info *) list->data;
+		if (send_sms == NULL || send_sms->journal_id == 0)
+			goto list_continue;
+
+		offset = ril_sms_outbox_write(map, tail, RIL_SMS_OUTBOX_ADD, send_sms->journal_id,
+			&send_sms->submit, sizeof(struct sms_submit));
+		if (offset == 0) {
+			ALOGE("%s: Too many messages to journal", __func__);
+			send_sms->journal_id = 0;
+			goto list_continue;
+		}
+
+		tail = offset;
+
+list_continue:
+		list = list->next;
+	}
+
+	rc = msync(map, RIL_SMS_OUTBOX_SIZE, MS_SYNC);
+	if (rc < 0)
+		goto error;
+
+	rc = rename(path_new, path);
+	if (rc < 0)
+		goto error;
+
+	ALOGD("%s: Journal compacted from %d to %d bytes", __func__, (int) ril_data.sms_outbox_tail, (int) tail);
+
+	munmap(ril_data.sms_outbox, RIL_SMS_OUTBOX_SIZE);
+	close(ril_data.sms_outbox_fd);
+
+	ril_data.sms_outbox = map;
+	ril_data.sms_outbox_fd = fd;
+	ril_data.sms_outbox_tail = tail;
+
+	return 0;
+
+error:
+	ALOGE("%s: Unable to compact the journal", __func__);
+
+	if (map != NULL)
+		munmap(map, RIL_SMS_OUTBOX_SIZE);
+	close(fd);
+	unlink(path_new);
+
+	return -1;
+}
+
+static void ril_sms_outbox_compact_callback(void *data)
+{
+	RIL_LOCK();
+
+	ril_data.sms_outbox_compact = 0;
+	if (ril_data.sms_outbox != NULL)
+		ril_sms_outbox_compact();
+
+	RIL_UNLOCK();
+}
+
+static void ril_sms_outbox_append(uint16_t type, uint32_t id, void *data, uint16_t length)
+{
+	size_t offset;
+
+	if (ril_data.sms_outbox == NULL)
+		return;
+
+	offset = ril_sms_outbox_write(ril_data.sms_outbox, ril_data.sms_outbox_tail, type, id, data, length);
+	if (offset == 0) {
+		if (ril_sms_outbox_compact() < 0)
+			return;
+
+		offset = ril_sms_outbox_write(ril_data.sms_outbox, ril_data.sms_outbox_tail, type, id, data, length);
+		if (offset == 0) {
+			ALOGE("%s: No room left in the journal", __func__);
+			return;
+		}
+	}
+
+	ril_data.sms_outbox_tail = offset;
+	msync(ril_data.sms_outbox, RIL_SMS_OUTBOX_SIZE, MS_ASYNC);
+
+	// Compact from the event loop once half of the journal is used
+	if (ril_data.sms_outbox_tail > RIL_SMS_OUTBOX_SIZE / 2 && !ril_data.sms_outbox_compact) {
+		ril_data.sms_outbox_compact = 1;
+		ril_request_timed_callback(ril_sms_outbox_compact_callback, NULL, NULL);
+	}
+}
+
+void ril_sms_outbox_add(struct ril_request_send_sms_info *send_sms)
+{
+	if (send_sms == NULL || ril_data.sms_outbox == NULL)
+		return;
+
+	ril_data.sms_outbox_id++;
+	if (ril_data.sms_outbox_id == 0)
+		ril_data.sms_outbox_id++;
+
+	send_sms->journal_id = ril_data.sms_outbox_id;
+
+	ril_sms_outbox_append(RIL_SMS_OUTBOX_ADD, send_sms->journal_id, &send_sms->submit, sizeof(struct sms_submit));
+}
+
+void ril_sms_outbox_done(struct ril_request_send_sms_info *send_sms)
+{
+	if (send_sms == NULL || send_sms->journal_id == 0)
+		return;
+
+	ril_sms_outbox_append(RIL_SMS_OUTBOX_DONE, send_sms->journal_id, NULL, 0);
+	send_sms->journal_id = 0;
+}
+
+static struct ril_request_send_sms_info *ril_sms_outbox_find(uint32_t id)
+{
+	struct ril_request_send_sms_info *send_sms;
+	struct list_head *list;
+
+	list = ril_data.outgoing_sms;
+	while (list != NULL) {
+		send_sms = (struct ril_request_send_sms_info *) list->data;
+		if (send_sms == NULL)
+			goto list_continue;
+
+		if (send_sms->journal_id == id)
+			return send_sms;
+
+list_continue:
+		list = list->next;
+	}
+
+	return NULL;
+}
+
+/*
+ * Queues again the messages that were pending when the journal was last
+ * written, without a token: the framework that asked for them is gone.
+ */
+static void ril_sms_outbox_replay(void)
+{
+	struct ril_sms_outbox_record *record;
+	struct ril_request_send_sms_info *send_sms;
+	size_t offset;
+	int rc;
+
+	offset = sizeof(struct ril_sms_outbox_header);
+
+	while (offset + sizeof(struct ril_sms_outbox_record) <= RIL_SMS_OUTBOX_SIZE) {
+		record = (struct ril_sms_outbox_record *) (ril_data.sms_outbox + offset);
+		if (record->type == 0)
+			break;
+
+		if (offset + sizeof(struct ril_sms_outbox_record) + record->length > RIL_SMS_OUTBOX_SIZE ||
+			record->checksum != ril_sms_outbox_checksum(record)) {
+			ALOGE("%s: Journal ends with a torn record", __func__);
+			break;
+		}
+
+		if (record->id > ril_data.sms_outbox_id)
+			ril_data.sms_outbox_id = record->id;
+
+		switch (record->type) {
+			case RIL_SMS_OUTBOX_ADD:
+				if (record->length != sizeof(struct sms_submit))
+					break;
+
+				rc = ril_request_send_sms_register((struct sms_submit *) record->data, RIL_TOKEN_NULL, &send_sms);
+				if (rc < 0)
+					break;
+
+				send_sms->journal_id = record->id;
+				ril_data.sms_stats.replayed++;
+				break;
+			case RIL_SMS_OUTBOX_DONE:
+				send_sms = ril_sms_outbox_find(record->id);
+				if (send_sms == NULL)
+					break;
+
+				send_sms->journal_id = 0;
+				ril_request_send_sms_unregister(send_sms);
+				ril_data.sms_stats.replayed--;
+				break;
+		}
+
+		offset += RIL_SMS_OUTBOX_ALIGN(sizeof(struct ril_sms_outbox_record) + record->length);
+	}
+
+	ril_data.sms_outbox_tail = offset;
+
+	// Clear whatever follows a torn record
+	memset(ril_data.sms_outbox + offset, 0, RIL_SMS_OUTBOX_SIZE - offset);
+
+	if (ril_data.sms_stats.replayed > 0)
+		ALOGD("%s: %u SMS to send again", __func__, ril_data.sms_stats.replayed);
+}
+
+void ril_sms_outbox_open(void)
+{
+	struct ril_sms_outbox_header *header;
+	char path[RIL_DATA_PATH_SIZE];
+	uint8_t *map;
+	int fd;
+
+	ril_data.sms_outbox = NULL;
+	ril_data.sms_outbox_fd = -1;
+
+	if (ril_data_path(path, sizeof(path), RIL_SMS_OUTBOX_FILE) < 0)
+		return;
+
+	fd = open(path, O_RDWR | O_CREAT, 0600);
+	if (fd < 0) {
+		ALOGE("%s: Unable to open %s, SMS won't be journaled", __func__, path);
+		return;
+	}
+
+	map = ril_sms_outbox_map(fd);
+	if (map == NULL) {
+		ALOGE("%s: Unable to map %s, SMS won't be journaled", __func__, path);
+		close(fd);
+		return;
+	}
+
+	ril_data.sms_outbox = map;
+	ril_data.sms_outbox_fd = fd;
+
+	header = (struct ril_sms_outbox_header *) map;
+	if (header->magic != RIL_SMS_OUTBOX_MAGIC || header->version != RIL_SMS_OUTBOX_VERSION ||
+		header->size != RIL_SMS_OUTBOX_SIZE) {
+		ril_sms_outbox_header_init(map);
+		ril_data.sms_outbox_tail = sizeof(struct ril_sms_outbox_header);
+		msync(map, RIL_SMS_OUTBOX_SIZE, MS_SYNC);
+		return;
+	}
+
+	ril_sms_outbox_replay();
+}
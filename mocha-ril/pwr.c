@@ -61,7 +61,7 @@ void ipc_cp_system_start(void* data)
 	lbs_send_init(1);
 	ril_sim_init();
 
-	ril_request_unsolicited(RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED, NULL, 0);
+	ril_state_notify();
 	ril_tokens_check();
 }
 
@@ -96,5 +96,5 @@ void ril_request_radio_power(RIL_Token t, void *data, size_t datalen)
 		network_start();
 		ril_request_complete(t, RIL_E_SUCCESS, NULL, 0);
 	}
-	ril_request_unsolicited(RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED, NULL, 0); 
+	ril_state_notify();
 }
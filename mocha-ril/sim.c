@@ -21,18 +21,77 @@
  */
 
 #define LOG_TAG "RIL-Mocha-SIM"
+#include <sys/time.h>
 #include <utils/Log.h>
+#include <cutils/properties.h>
 
 #include "mocha-ril.h"
 #include "util.h"
+#include "hex.h"
 #include "sim.h"
 #include <sim.h>
 #include <tapi_network.h>
 #include <misc.h>
 
+struct sim_file_id sim_file_ids[] = {
+	{ 0x2F05, SIM_FILE_TYPE_EF },
+	{ 0x2FE2, SIM_FILE_TYPE_EF },
+	{ 0x3F00, SIM_FILE_TYPE_MF },
+	{ 0x4F20, SIM_FILE_TYPE_EF },
+	{ 0x5F3A, SIM_FILE_TYPE_DF },
+	{ 0x6F05, SIM_FILE_TYPE_EF },
+	{ 0x6F06, SIM_FILE_TYPE_EF },
+	{ 0x6F07, SIM_FILE_TYPE_EF },
+	{ 0x6F11, SIM_FILE_TYPE_EF },
+	{ 0x6F13, SIM_FILE_TYPE_EF },
+	{ 0x6F14, SIM_FILE_TYPE_EF },
+	{ 0x6F15, SIM_FILE_TYPE_EF },
+	{ 0x6F16, SIM_FILE_TYPE_EF },
+	{ 0x6F17, SIM_FILE_TYPE_EF },
+	{ 0x6F18, SIM_FILE_TYPE_EF },
+	{ 0x6F38, SIM_FILE_TYPE_EF },
+	{ 0x6F38, SIM_FILE_TYPE_EF },
+	{ 0x6F3A, SIM_FILE_TYPE_EF },
+	{ 0x6F40, SIM_FILE_TYPE_EF },
+	{ 0x6F42, SIM_FILE_TYPE_EF },
+	{ 0x6F45, SIM_FILE_TYPE_EF },
+	{ 0x6F46, SIM_FILE_TYPE_EF },
+	{ 0x6F48, SIM_FILE_TYPE_EF },
+	{ 0x6F49, SIM_FILE_TYPE_EF },
+	{ 0x6F4A, SIM_FILE_TYPE_EF },
+	{ 0x6F4D, SIM_FILE_TYPE_EF },
+	{ 0x6F50, SIM_FILE_TYPE_EF },
+	{ 0x6F56, SIM_FILE_TYPE_EF },
+	{ 0x6FAD, SIM_FILE_TYPE_EF },
+	{ 0x6FAE, SIM_FILE_TYPE_EF },
+	{ 0x6FB7, SIM_FILE_TYPE_EF },
+	{ 0x6FC5, SIM_FILE_TYPE_EF },
+	{ 0x6FC6, SIM_FILE_TYPE_EF },
+	{ 0x6FC7, SIM_FILE_TYPE_EF },
+	{ 0x6FC9, SIM_FILE_TYPE_EF },
+	{ 0x6FCA, SIM_FILE_TYPE_EF },
+	{ 0x6FCB, SIM_FILE_TYPE_EF },
+	{ 0x6FCD, SIM_FILE_TYPE_EF },
+	{ 0x7F10, SIM_FILE_TYPE_DF },
+	{ 0x7F20, SIM_FILE_TYPE_DF },
+};
+
+int sim_file_ids_count = sizeof(sim_file_ids) / sizeof(sim_file_ids[0]);
+
 void ril_sim_init(void)
 {
-	sim_atk_open();	
+	char value[PROPERTY_VALUE_MAX];
+	int window;
+
+	property_get(RIL_SIM_IO_WINDOW_PROPERTY, value, "");
+	window = atoi(value);
+	if (window <= 0)
+		window = RIL_SIM_IO_WINDOW;
+
+	ril_data.sim_io_window = window;
+	ALOGD("%s: SIM I/O window is %d", __func__, window);
+
+	sim_atk_open();
 	sim_open_to_modem(4);
 }
 
@@ -63,6 +122,69 @@ void ipc_sim_open(void *data)
 	ipc_boot8_mode(1);
 }
 
+/*
+ * SIM boot timeline: how long the files take to load once the SIM is
+ * ready, and how many round trips to the modem it took, next to the
+ * framework requests answered without one.
+ */
+static void ril_sim_boot_start(void)
+{
+	struct ril_sim_boot_stats *stats = &ril_data.sim_boot_stats;
+
+	memset(stats, 0, sizeof(struct ril_sim_boot_stats));
+	stats->running = 1;
+	gettimeofday(&stats->start, NULL);
+}
+
+static void ril_sim_boot_check(void)
+{
+	struct ril_sim_boot_stats *stats = &ril_data.sim_boot_stats;
+	unsigned int time;
+
+	if (!stats->running)
+		return;
+
+	if (ril_data.sim_prefetch_pending > 0 || sim_store_loading() > 0)
+		return;
+
+	stats->running = 0;
+
+	gettimeofday(&stats->end, NULL);
+	time = (stats->end.tv_sec - stats->start.tv_sec) * 1000 +
+		(stats->end.tv_usec - stats->start.tv_usec) / 1000;
+
+	ALOGD("%s: SIM files loaded %u ms after SIM ready: %u modem round trips, %u framework requests (%u answered locally)",
+		__func__, time, stats->modem, stats->framework, stats->local);
+}
+
+/*
+ * Files read ahead of the framework, and dropped when the SIM goes away
+ */
+void ril_sim_files_load(void)
+{
+	ril_sim_boot_start();
+	sim_prefetch_start();
+	sim_store_load(SIM_EF_SMS);
+	sim_store_load(SIM_EF_ADN);
+	sim_store_load(SIM_EF_FDN);
+}
+
+void ril_sim_files_clear(void)
+{
+	ril_data.sim_boot_stats.running = 0;
+	sim_prefetch_reset();
+	sim_store_clear();
+	sim_cache_clear();
+}
+
+void ril_sim_files_refresh(void)
+{
+	ril_sim_files_clear();
+
+	if (ril_data.state.sim_state == SIM_STATE_READY)
+		ril_sim_files_load();
+}
+
 void ipc_sim_status(void *data)
 {
 	ALOGE("%s: test me!", __func__);
@@ -80,7 +202,12 @@ void ipc_sim_status(void *data)
 		//request SMSC number
 		sim_get_file_info(0x5, 0x6f42);
 
-	ril_request_unsolicited(RIL_UNSOL_RESPONSE_SIM_STATUS_CHANGED, NULL, 0);	
+	if (sim_state == SIM_STATE_READY)
+		ril_sim_files_load();
+	else
+		ril_sim_files_clear();
+
+	ril_state_notify();
 }
 
 void ipc_lock_status(void* data)
@@ -232,20 +359,74 @@ void ipc_sim_smsc_number(void* data)
 			}
 		ALOGD("%s : SMSC number: %s", __func__, ril_data.smsc_number);
 
-		if (ril_data.tokens.sim_io == RIL_TOKEN_DATA_WAITING)
-			ril_request_sim_io_next();
+		// SIM I/O was held until the SMSC was read
+		ril_request_sim_io_next();
 	}
 }
 
+/*
+ * Completes a framework SIM I/O request with the raw response bytes.
+ */
+void ril_request_sim_io_respond(RIL_Token t, int sw1, int sw2, void *data, size_t size)
+{
+	RIL_SIM_IO_Response response;
+	char sim_response[HEX_LENGTH(RIL_SIM_IO_DATA_SIZE)];
+	int rc;
+
+	memset(&response, 0, sizeof(response));
+	response.sw1 = sw1;
+	response.sw2 = sw2;
+
+	if (data != NULL && size > 0) {
+		rc = hex_encode(data, size, sim_response, sizeof(sim_response));
+		if (rc > 0)
+			response.simResponse = sim_response;
+		else
+			ALOGE("%s: Unable to encode %d bytes of SIM data", __func__, (int) size);
+	}
+
+	ril_request_complete(t, RIL_E_SUCCESS, &response, sizeof(response));
+
+	if (response.simResponse != NULL)
+		ALOGD("%s: SIM response: %s", __func__, response.simResponse);
+}
+
 void ipc_sim_io_response(void* data)
 {
 	struct ril_request_sim_io_info *sim_io_info;
 	struct sim_file_response sim_file_response;
 	uint8_t *buf;
+	uint8_t *response = NULL;
+	size_t response_size = 0;
+	int event = -1;
+	int fileid = -1;
+	int sw1, sw2;
 	int i;
-	RIL_SIM_IO_Response response;
 
-	sim_io_info = ril_request_sim_io_info_find_token(ril_data.tokens.sim_io);
+	simEventPacketHeader* simEvent = (simEventPacketHeader*)(data);
+	buf = (uint8_t *)data + sizeof(simEventPacketHeader);
+
+	switch (simEvent->eventType)
+	{
+		case SIM_EVENT_FILE_INFO:
+			fileid = ((fileInfoEvent *) buf)->fileId;
+			event = simEvent->eventType;
+			break;
+		case SIM_EVENT_READ_FILE:
+			fileid = ((simDataResponse *) buf)->fileId;
+			event = simEvent->eventType;
+			break;
+		case SIM_EVENT_UPDATE_FILE:
+		case SIM_EVENT_SEARCH_RECORD:
+			event = simEvent->eventType;
+			break;
+	}
+
+	sim_io_info = ril_request_sim_io_info_find_busy(event, fileid);
+
+	// With a single request in flight, the response can only be for it
+	if (sim_io_info == NULL && ril_data.sim_io_stats.inflight == 1)
+		sim_io_info = ril_request_sim_io_info_find_busy(event, -1);
 
 	if (sim_io_info == NULL) {
 		ALOGE("%s : Unable to find SIM I/O in the list!", __func__);
@@ -254,9 +435,6 @@ void ipc_sim_io_response(void* data)
 		return;
 	}
 
-	simEventPacketHeader* simEvent = (simEventPacketHeader*)(data);
-	memset(&response, 0, sizeof(response));
-
 	switch(simEvent->eventType)
 	{
 		case SIM_EVENT_FILE_INFO:
@@ -296,128 +474,140 @@ void ipc_sim_io_response(void* data)
 
 			sim_file_response.record_length = fileInfo->recordSize;
 
-			response.simResponse = data2string((void *) &sim_file_response, sizeof(sim_file_response));
+			response = (uint8_t *) &sim_file_response;
+			response_size = sizeof(sim_file_response);
 			break;
 		case SIM_EVENT_READ_FILE:
 			buf = (uint8_t *)data + sizeof(simEventPacketHeader);
 			simDataResponse* simData = (simDataResponse*) buf;
-			response.simResponse = data2string(buf + sizeof(simDataResponse), simData->bufLen);
+
+			if (simData->fileId != sim_io_info->fileid) {
+				simEvent->eventStatus = SIM_NOT_SUPPORTED;
+				break;
+			}
+
+			response = buf + sizeof(simDataResponse);
+			response_size = simData->bufLen;
 			break;
 		case SIM_EVENT_UPDATE_FILE:
 		case SIM_EVENT_SEARCH_RECORD:
 		default:
-			response.simResponse = NULL;
 			break;
 	}
 
 	switch (simEvent->eventStatus)
 	{
 		case SIM_OK:
-			response.sw1 = 0x90;
-			response.sw2 = 0x00;
+			sw1 = 0x90;
+			sw2 = 0x00;
 			break;
 		case SIM_FILE_NOT_FOUND:
-			response.sw1 = 0x94;
-			response.sw2 = 0x04;
+			sw1 = 0x94;
+			sw2 = 0x04;
 			break;
 		case SIM_NOT_SUPPORTED:
 		default:
-			response.sw1 = 0x00;
-			response.sw2 = 0x00;
+			sw1 = 0x00;
+			sw2 = 0x00;
 			break;
 	}
 
-	ril_request_complete(ril_data.tokens.sim_io, RIL_E_SUCCESS, &response, sizeof(response));
+	ALOGD("%s: SIM File = %x, %d bytes", __func__, sim_io_info->fileid, (int) response_size);
 
-	if (response.simResponse != NULL)
-	{
-		ALOGD("%s: SIM File = %x, SIM response: %s", __func__, sim_io_info->fileid, response.simResponse);
-		free(response.simResponse);
-	}
+	// Keep the SIM store in sync, including with framework writes
+	sim_store_response(sim_io_info, sw1, sw2, response, response_size);
+	sim_cache_response(sim_io_info, sw1, sw2, response, response_size);
 
+	ril_request_sim_io_stats_update(sim_io_info);
+	ril_data.sim_boot_stats.modem++;
 
-	ril_request_sim_io_unregister(sim_io_info);
+	ril_request_sim_io_done(sim_io_info, sw1, sw2, response, response_size);
+	ril_sim_boot_check();
 	// Send the next SIM I/O in the list
 	ril_request_sim_io_next();
-	return;
-error:
-	ril_request_complete(ril_data.tokens.sim_io, RIL_E_GENERIC_FAILURE, NULL, 0);
-
 }
 
-void ril_request_get_sim_status(RIL_Token t)
-{
-	ALOGD("%s: test me!", __func__);
+static RIL_AppStatus app_status_array[] = {
+	/* SIM_ABSENT = 0 */
+	{ RIL_APPTYPE_UNKNOWN, RIL_APPSTATE_UNKNOWN, RIL_PERSOSUBSTATE_UNKNOWN,
+	NULL, NULL, 0, RIL_PINSTATE_UNKNOWN, RIL_PINSTATE_UNKNOWN },
+	/* SIM_NOT_READY = 1 */
+	{ RIL_APPTYPE_SIM, RIL_APPSTATE_DETECTED, RIL_PERSOSUBSTATE_UNKNOWN,
+	NULL, NULL, 0, RIL_PINSTATE_UNKNOWN, RIL_PINSTATE_UNKNOWN },
+	/* SIM_READY = 2 */
+	{ RIL_APPTYPE_SIM, RIL_APPSTATE_READY, RIL_PERSOSUBSTATE_READY,
+	NULL, NULL, 0, RIL_PINSTATE_UNKNOWN, RIL_PINSTATE_UNKNOWN },
+	/* SIM_PIN = 3 */
+	{ RIL_APPTYPE_SIM, RIL_APPSTATE_PIN, RIL_PERSOSUBSTATE_UNKNOWN,
+	NULL, NULL, 0, RIL_PINSTATE_ENABLED_NOT_VERIFIED, RIL_PINSTATE_UNKNOWN },
+	/* SIM_PUK = 4 */
+	{ RIL_APPTYPE_SIM, RIL_APPSTATE_PUK, RIL_PERSOSUBSTATE_UNKNOWN,
+	NULL, NULL, 0, RIL_PINSTATE_ENABLED_BLOCKED, RIL_PINSTATE_UNKNOWN },
+	/* SIM_BLOCKED = 4 */
+	{ RIL_APPTYPE_SIM, RIL_APPSTATE_PUK, RIL_PERSOSUBSTATE_UNKNOWN,
+	NULL, NULL, 0, RIL_PINSTATE_ENABLED_PERM_BLOCKED, RIL_PINSTATE_UNKNOWN },
+	/* SIM_NETWORK_PERSO = 6 */
+	{ RIL_APPTYPE_SIM, RIL_APPSTATE_SUBSCRIPTION_PERSO, RIL_PERSOSUBSTATE_SIM_NETWORK,
+	NULL, NULL, 0, RIL_PINSTATE_ENABLED_NOT_VERIFIED, RIL_PINSTATE_UNKNOWN },
+	/* SIM_NETWORK_SUBSET_PERSO = 7 */
+	{ RIL_APPTYPE_SIM, RIL_APPSTATE_SUBSCRIPTION_PERSO, RIL_PERSOSUBSTATE_SIM_NETWORK_SUBSET,
+	NULL, NULL, 0, RIL_PINSTATE_ENABLED_NOT_VERIFIED, RIL_PINSTATE_UNKNOWN },
+	/* SIM_CORPORATE_PERSO = 8 */
+	{ RIL_APPTYPE_SIM, RIL_APPSTATE_SUBSCRIPTION_PERSO, RIL_PERSOSUBSTATE_SIM_CORPORATE,
+	NULL, NULL, 0, RIL_PINSTATE_ENABLED_NOT_VERIFIED, RIL_PINSTATE_UNKNOWN },
+	/* SIM_SERVICE_PROVIDER_PERSO = 9 */
+	{ RIL_APPTYPE_SIM, RIL_APPSTATE_SUBSCRIPTION_PERSO, RIL_PERSOSUBSTATE_SIM_SERVICE_PROVIDER,
+	NULL, NULL, 0, RIL_PINSTATE_ENABLED_NOT_VERIFIED, RIL_PINSTATE_UNKNOWN },
+};
 
-	RIL_CardStatus_v6 card_status;
+/*
+ * The card status only depends on the SIM state: it is built when the
+ * state is published and served as is until the state changes.
+ */
+void ril_sim_card_status_update(void)
+{
+	RIL_CardStatus_v6 *card_status = &ril_data.card_status;
 	ril_sim_state sim_state;
-	int app_status_array_length;
-	int app_index;
 	int i;
 
-	static RIL_AppStatus app_status_array[] = {
-		/* SIM_ABSENT = 0 */
-		{ RIL_APPTYPE_UNKNOWN, RIL_APPSTATE_UNKNOWN, RIL_PERSOSUBSTATE_UNKNOWN,
-		NULL, NULL, 0, RIL_PINSTATE_UNKNOWN, RIL_PINSTATE_UNKNOWN },
-		/* SIM_NOT_READY = 1 */
-		{ RIL_APPTYPE_SIM, RIL_APPSTATE_DETECTED, RIL_PERSOSUBSTATE_UNKNOWN,
-		NULL, NULL, 0, RIL_PINSTATE_UNKNOWN, RIL_PINSTATE_UNKNOWN },
-		/* SIM_READY = 2 */
-		{ RIL_APPTYPE_SIM, RIL_APPSTATE_READY, RIL_PERSOSUBSTATE_READY,
-		NULL, NULL, 0, RIL_PINSTATE_UNKNOWN, RIL_PINSTATE_UNKNOWN },
-		/* SIM_PIN = 3 */
-		{ RIL_APPTYPE_SIM, RIL_APPSTATE_PIN, RIL_PERSOSUBSTATE_UNKNOWN,
-		NULL, NULL, 0, RIL_PINSTATE_ENABLED_NOT_VERIFIED, RIL_PINSTATE_UNKNOWN },
-		/* SIM_PUK = 4 */
-		{ RIL_APPTYPE_SIM, RIL_APPSTATE_PUK, RIL_PERSOSUBSTATE_UNKNOWN,
-		NULL, NULL, 0, RIL_PINSTATE_ENABLED_BLOCKED, RIL_PINSTATE_UNKNOWN },
-		/* SIM_BLOCKED = 4 */
-		{ RIL_APPTYPE_SIM, RIL_APPSTATE_PUK, RIL_PERSOSUBSTATE_UNKNOWN,
-		NULL, NULL, 0, RIL_PINSTATE_ENABLED_PERM_BLOCKED, RIL_PINSTATE_UNKNOWN },
-		/* SIM_NETWORK_PERSO = 6 */
-		{ RIL_APPTYPE_SIM, RIL_APPSTATE_SUBSCRIPTION_PERSO, RIL_PERSOSUBSTATE_SIM_NETWORK,
-		NULL, NULL, 0, RIL_PINSTATE_ENABLED_NOT_VERIFIED, RIL_PINSTATE_UNKNOWN },
-		/* SIM_NETWORK_SUBSET_PERSO = 7 */
-		{ RIL_APPTYPE_SIM, RIL_APPSTATE_SUBSCRIPTION_PERSO, RIL_PERSOSUBSTATE_SIM_NETWORK_SUBSET,
-		NULL, NULL, 0, RIL_PINSTATE_ENABLED_NOT_VERIFIED, RIL_PINSTATE_UNKNOWN },
-		/* SIM_CORPORATE_PERSO = 8 */
-		{ RIL_APPTYPE_SIM, RIL_APPSTATE_SUBSCRIPTION_PERSO, RIL_PERSOSUBSTATE_SIM_CORPORATE,
-		NULL, NULL, 0, RIL_PINSTATE_ENABLED_NOT_VERIFIED, RIL_PINSTATE_UNKNOWN },
-		/* SIM_SERVICE_PROVIDER_PERSO = 9 */
-		{ RIL_APPTYPE_SIM, RIL_APPSTATE_SUBSCRIPTION_PERSO, RIL_PERSOSUBSTATE_SIM_SERVICE_PROVIDER,
-		NULL, NULL, 0, RIL_PINSTATE_ENABLED_NOT_VERIFIED, RIL_PINSTATE_UNKNOWN },
-		};
-
 	sim_state = ril_data.state.sim_state;
 
 	/* Card is assumed to be present if not explicitly absent */
-	if(ril_data.state.sim_state == SIM_STATE_ABSENT) {
-		card_status.card_state = RIL_CARDSTATE_ABSENT;
+	if(sim_state == SIM_STATE_ABSENT) {
+		card_status->card_state = RIL_CARDSTATE_ABSENT;
 	} else {
-		card_status.card_state = RIL_CARDSTATE_PRESENT;
-	}
-		
-	// Initialize the apps
-	for (i = 0 ; i < RIL_CARD_MAX_APPS ; i++) {
-		card_status.applications[i] = app_status_array[0];
+		card_status->card_state = RIL_CARDSTATE_PRESENT;
 	}
 
 	// FIXME: How do we know that?
-	card_status.universal_pin_state = RIL_PINSTATE_UNKNOWN;
-
+	card_status->universal_pin_state = RIL_PINSTATE_UNKNOWN;
 
 	/* Initialize apps */
 	for (i = 0; i < RIL_CARD_MAX_APPS; i++) {
-	card_status.applications[i] = app_status_array[i];
+		card_status->applications[i] = app_status_array[i];
 	}
 
 	// sim_state corresponds to the app index on the table
-	card_status.gsm_umts_subscription_app_index = (int) sim_state;
-	card_status.cdma_subscription_app_index = (int) sim_state;
-	card_status.num_applications = RIL_CARD_MAX_APPS;
+	card_status->gsm_umts_subscription_app_index = (int) sim_state;
+	card_status->cdma_subscription_app_index = (int) sim_state;
+	card_status->num_applications = RIL_CARD_MAX_APPS;
 
-	ril_request_complete(t, RIL_E_SUCCESS, &card_status, sizeof(card_status));
-	
+	ril_data.card_status_state = sim_state;
+	ril_data.state_stats.card_status_builds++;
+}
+
+void ril_request_get_sim_status(RIL_Token t)
+{
+	if (ril_data.card_status_state != ril_data.state.sim_state)
+		ril_sim_card_status_update();
+	else
+		ril_data.state_stats.card_status_hits++;
+
+	DEBUG_I("%s: SIM state %d, %u built, %u from cache", __func__,
+		ril_data.state.sim_state, ril_data.state_stats.card_status_builds,
+		ril_data.state_stats.card_status_hits);
+
+	ril_request_complete(t, RIL_E_SUCCESS, &ril_data.card_status, sizeof(ril_data.card_status));
 }
 
 void ril_state_update(ril_sim_state sim_state)
@@ -435,6 +625,8 @@ void ril_state_update(ril_sim_state sim_state)
 			radio_state = RADIO_STATE_SIM_READY;
 			tapi_set_subscription_mode(0x1);
 			nettext_cb_setup();
+			// SMS replayed from the outbox were waiting for the SIM
+			ril_request_send_sms_next();
 			break;
 		case SIM_STATE_NOT_READY:
 			radio_state = RADIO_STATE_SIM_NOT_READY;
@@ -455,7 +647,7 @@ void ril_state_update(ril_sim_state sim_state)
 	}
 	ril_data.state.radio_state = radio_state;
 	ril_tokens_check();
-	ril_request_unsolicited(RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED, NULL, 0);
+	ril_state_notify();
 }
 
 void ril_request_enter_sim_pin(RIL_Token t, void *data, size_t size)
@@ -592,10 +784,28 @@ int ril_request_sim_io_register(RIL_Token t, int command, int fileid,
 	sim_io->p1 = p1;
 	sim_io->p2 = p2;
 	sim_io->p3 = p3;
-	sim_io->data = data;
-	sim_io->length = size;
+	if (data != NULL && size > 0) {
+		if (size > sizeof(sim_io->data)) {
+			free(sim_io);
+			return -1;
+		}
+
+		memcpy(sim_io->data, data, size);
+		sim_io->length = size;
+	}
 	sim_io->waiting = 1;
 	sim_io->token = t;
+	gettimeofday(&sim_io->queue_time, NULL);
+
+	// Identical reads share the answer of the first one
+	if (command == SIM_COMMAND_GET_RESPONSE || command == SIM_COMMAND_READ_BINARY ||
+		command == SIM_COMMAND_READ_RECORD) {
+		sim_io->leader = ril_request_sim_io_info_find_same(sim_io);
+		if (sim_io->leader != NULL) {
+			ALOGD("%s: Coalesced with a pending request", __func__);
+			ril_data.sim_io_stats.coalesced++;
+		}
+	}
 
 	list_end = ril_data.sim_io;
 	while (list_end != NULL && list_end->next != NULL)
@@ -613,11 +823,26 @@ int ril_request_sim_io_register(RIL_Token t, int command, int fileid,
 
 void ril_request_sim_io_unregister(struct ril_request_sim_io_info *sim_io)
 {
+	struct ril_request_sim_io_info *follower;
 	struct list_head *list;
 
 	if (sim_io == NULL)
 		return;
 
+	if (!sim_io->waiting && ril_data.sim_io_stats.inflight > 0) {
+		ril_data.sim_io_stats.inflight--;
+		ril_data.sim_io_barrier = 0;
+	}
+
+	// Requests waiting on this one are sent on their own
+	list = ril_data.sim_io;
+	while (list != NULL) {
+		follower = (struct ril_request_sim_io_info *) list->data;
+		if (follower != NULL && follower->leader == sim_io)
+			follower->leader = NULL;
+		list = list->next;
+	}
+
 	list = ril_data.sim_io;
 	while (list != NULL) {
 		if (list->data == (void *) sim_io) {
@@ -644,7 +869,7 @@ struct ril_request_sim_io_info *ril_request_sim_io_info_find(void)
 	list = ril_data.sim_io;
 	while (list != NULL) {
 		sim_io = (struct ril_request_sim_io_info *) list->data;
-		if (sim_io == NULL)
+		if (sim_io == NULL || !sim_io->waiting || sim_io->leader != NULL)
 			goto list_continue;
 
 		return sim_io;
@@ -654,6 +879,114 @@ list_continue:
 	return NULL;
 }
 
+/*
+ * Returns the oldest pending request reading the same thing, that is
+ * either sent or going to be, with no update or seek of the file queued
+ * after it: the new request must see their effect.
+ */
+struct ril_request_sim_io_info *ril_request_sim_io_info_find_same(struct ril_request_sim_io_info *sim_io)
+{
+	struct ril_request_sim_io_info *leader = NULL;
+	struct ril_request_sim_io_info *same;
+	struct list_head *list;
+
+	list = ril_data.sim_io;
+	while (list != NULL) {
+		same = (struct ril_request_sim_io_info *) list->data;
+		if (same == NULL || same == sim_io || same->fileid != sim_io->fileid)
+			goto list_continue;
+
+		if (same->command == SIM_COMMAND_UPDATE_BINARY ||
+			same->command == SIM_COMMAND_UPDATE_RECORD ||
+			same->command == SIM_COMMAND_SEEK) {
+			leader = NULL;
+			goto list_continue;
+		}
+
+		if (leader == NULL && same->leader == NULL && same->command == sim_io->command &&
+			same->p1 == sim_io->p1 && same->p2 == sim_io->p2 && same->p3 == sim_io->p3)
+			leader = same;
+
+list_continue:
+		list = list->next;
+	}
+	return leader;
+}
+
+/*
+ * Returns whether an update of the file is queued or in flight: what is
+ * kept in memory about it is stale until the update completes.
+ */
+int ril_request_sim_io_update_pending(int fileid)
+{
+	struct ril_request_sim_io_info *sim_io;
+	struct list_head *list;
+
+	list = ril_data.sim_io;
+	while (list != NULL) {
+		sim_io = (struct ril_request_sim_io_info *) list->data;
+		if (sim_io == NULL)
+			goto list_continue;
+
+		if (sim_io->fileid == fileid && (sim_io->command == SIM_COMMAND_UPDATE_BINARY ||
+			sim_io->command == SIM_COMMAND_UPDATE_RECORD))
+			return 1;
+
+list_continue:
+		list = list->next;
+	}
+
+	return 0;
+}
+
+static int ril_request_sim_io_event(int command)
+{
+	switch (command) {
+		case SIM_COMMAND_GET_RESPONSE:
+			return SIM_EVENT_FILE_INFO;
+		case SIM_COMMAND_READ_BINARY:
+		case SIM_COMMAND_READ_RECORD:
+			return SIM_EVENT_READ_FILE;
+		case SIM_COMMAND_UPDATE_BINARY:
+		case SIM_COMMAND_UPDATE_RECORD:
+			return SIM_EVENT_UPDATE_FILE;
+		case SIM_COMMAND_SEEK:
+			return SIM_EVENT_SEARCH_RECORD;
+		default:
+			return -1;
+	}
+}
+
+/*
+ * Returns the oldest request sent to the modem that a response of the
+ * given event and fileid answers. Responses carry no record index, so
+ * requests on the same file are answered in the order they were sent.
+ * An event or fileid of -1 matches any.
+ */
+struct ril_request_sim_io_info *ril_request_sim_io_info_find_busy(int event, int fileid)
+{
+	struct ril_request_sim_io_info *sim_io;
+	struct list_head *list;
+
+	list = ril_data.sim_io;
+	while (list != NULL) {
+		sim_io = (struct ril_request_sim_io_info *) list->data;
+		if (sim_io == NULL || sim_io->waiting)
+			goto list_continue;
+
+		if (event >= 0 && ril_request_sim_io_event(sim_io->command) != event)
+			goto list_continue;
+
+		if (fileid < 0 || sim_io->fileid == fileid)
+			return sim_io;
+
+list_continue:
+		list = list->next;
+	}
+
+	return NULL;
+}
+
 struct ril_request_sim_io_info *ril_request_sim_io_info_find_token(RIL_Token t)
 {
 	struct ril_request_sim_io_info *sim_io;
@@ -675,31 +1008,114 @@ list_continue:
 	return NULL;
 }
 
+/*
+ * Answers a request and the ones coalesced with it, then drops them.
+ */
+void ril_request_sim_io_done(struct ril_request_sim_io_info *sim_io,
+	int sw1, int sw2, unsigned char *data, size_t size)
+{
+	struct ril_request_sim_io_info *follower;
+	struct list_head *list;
+	struct list_head *next;
+
+	list = ril_data.sim_io;
+	while (list != NULL) {
+		next = list->next;
+
+		follower = (struct ril_request_sim_io_info *) list->data;
+		if (follower == NULL || follower->leader != sim_io)
+			goto list_continue;
+
+		if (follower->callback != NULL)
+			follower->callback(follower, sw1, sw2, data, size);
+		else
+			ril_request_sim_io_respond(follower->token, sw1, sw2, data, size);
+
+		ril_request_sim_io_unregister(follower);
+
+list_continue:
+		list = next;
+	}
+
+	if (sim_io->callback != NULL)
+		sim_io->callback(sim_io, sw1, sw2, data, size);
+	else
+		ril_request_sim_io_respond(sim_io->token, sw1, sw2, data, size);
+
+	ril_request_sim_io_unregister(sim_io);
+}
+
+void ril_request_sim_io_stats_update(struct ril_request_sim_io_info *sim_io)
+{
+	struct ril_sim_io_stats *stats = &ril_data.sim_io_stats;
+	struct timeval now;
+	unsigned int latency;
+
+	gettimeofday(&now, NULL);
+	latency = (now.tv_sec - sim_io->time.tv_sec) * 1000 +
+		(now.tv_usec - sim_io->time.tv_usec) / 1000;
+
+	stats->requests++;
+	stats->latency_total += latency;
+	if (latency > stats->latency_max)
+		stats->latency_max = latency;
+
+	if (stats->requests % 32 == 0)
+		ALOGD("%s: %u requests (%u coalesced), %u ms queued, %u ms average, %u ms max, %u in flight max",
+			__func__, stats->requests, stats->coalesced,
+			stats->queue_total / stats->requests,
+			stats->latency_total / stats->requests,
+			stats->latency_max, stats->inflight_max);
+}
+
+/*
+ * Sends queued requests while the window allows. Updates and seeks go
+ * out alone: they wait for the modem to be idle and nothing follows
+ * them until they are answered, so the requests queued after them see
+ * their effect.
+ */
 void ril_request_sim_io_next(void)
 {
+	struct ril_sim_io_stats *stats = &ril_data.sim_io_stats;
 	struct ril_request_sim_io_info *sim_io;
-	int rc;
-
-	ril_data.tokens.sim_io = RIL_TOKEN_NULL;
+	struct timeval now;
+	int exclusive;
 
-	sim_io = ril_request_sim_io_info_find();
-	if (sim_io == NULL)
+	// The SMSC is read first, outside of the list
+	if (ril_data.smsc_number[0] == 0)
 		return;
 
-	ALOGD("%s: fileid 0x%x", __func__, sim_io->fileid);
+	while (!ril_data.sim_io_barrier &&
+		stats->inflight < (unsigned int) (ril_data.sim_io_window > 0 ? ril_data.sim_io_window : RIL_SIM_IO_WINDOW)) {
+		sim_io = ril_request_sim_io_info_find();
+		if (sim_io == NULL)
+			return;
+
+		exclusive = sim_io->command != SIM_COMMAND_GET_RESPONSE &&
+			sim_io->command != SIM_COMMAND_READ_BINARY &&
+			sim_io->command != SIM_COMMAND_READ_RECORD;
 
-	sim_io->waiting = 0;
-	ril_data.tokens.sim_io = sim_io->token;
+		if (exclusive && stats->inflight > 0)
+			return;
 
+		ALOGD("%s: fileid 0x%x", __func__, sim_io->fileid);
 
+		sim_io->waiting = 0;
+		gettimeofday(&now, NULL);
+		sim_io->time = now;
 
-	ril_request_sim_io_complete(sim_io->token, sim_io->command, sim_io->fileid,
-		sim_io->p1, sim_io->p2, sim_io->p3, sim_io->data, sim_io->length);
+		stats->queue_total += (now.tv_sec - sim_io->queue_time.tv_sec) * 1000 +
+			(now.tv_usec - sim_io->queue_time.tv_usec) / 1000;
+		stats->inflight++;
+		if (stats->inflight > stats->inflight_max)
+			stats->inflight_max = stats->inflight;
 
-	if (sim_io->data != NULL)
-		free(sim_io->data);
-	sim_io->data = NULL;
-	sim_io->length = 0;
+		if (exclusive)
+			ril_data.sim_io_barrier = 1;
+
+		ril_request_sim_io_complete(sim_io->token, sim_io->command, sim_io->fileid,
+			sim_io->p1, sim_io->p2, sim_io->p3, sim_io->length > 0 ? sim_io->data : NULL, sim_io->length);
+	}
 }
 
 void ril_request_sim_io_complete(RIL_Token t, int command, int fileid,
@@ -776,16 +1192,35 @@ int p1, int p2, int p3, void *data, size_t size)
 	}
 }
 
-void ril_request_sim_io(RIL_Token t, void *data, size_t size)
+/*
+ * Queues a SIM I/O request on behalf of the RIL, answered to callback.
+ */
+int ril_sim_io_request(int command, int fileid, int p1, int p2, int p3,
+	void *data, size_t size, ril_sim_io_callback callback)
 {
+	struct ril_request_sim_io_info *sim_io_info = NULL;
+	int rc;
+
+	rc = ril_request_sim_io_register(RIL_TOKEN_NULL, command, fileid,
+		p1, p2, p3, data, size, &sim_io_info);
+	if (rc < 0 || sim_io_info == NULL)
+		return -1;
 
+	sim_io_info->callback = callback;
+
+	ril_request_sim_io_next();
+
+	return 0;
+}
+
+void ril_request_sim_io(RIL_Token t, void *data, size_t size)
+{
 	struct ril_request_sim_io_info *sim_io_info = NULL;
 	RIL_SIM_IO_v6 *sim_io = NULL;
 
-	void *sim_io_data = NULL;
+	unsigned char sim_io_data[RIL_SIM_IO_DATA_SIZE];
 	int sim_io_size = 0;
-	int result = 0;
-	int rc, i;
+	int rc;
 
 	if (data == NULL || size < sizeof(RIL_SIM_IO_v6))
 		goto error;
@@ -801,11 +1236,8 @@ void ril_request_sim_io(RIL_Token t, void *data, size_t size)
 			goto error;
 		else
 		{
-			sim_io_size = string2data_size(sim_io->data);
-			if (sim_io_size == 0)
-				goto error;
-			sim_io_data = string2data(sim_io->data);
-				if (sim_io_data == NULL)
+			sim_io_size = hex_decode(sim_io->data, strlen(sim_io->data), sim_io_data, sizeof(sim_io_data));
+			if (sim_io_size <= 0)
 				goto error;
 		}
 	}
@@ -816,6 +1248,22 @@ void ril_request_sim_io(RIL_Token t, void *data, size_t size)
 		goto error;
 	}
 
+	ril_data.sim_boot_stats.framework++;
+
+	rc = sim_store_request(t, sim_io->command, sim_io->fileid,
+		sim_io->p1, sim_io->p2, sim_io->p3, sim_io_data, sim_io_size);
+	if (rc == 0)
+		goto local;
+
+	if (sim_io->command == SIM_COMMAND_UPDATE_BINARY ||
+		sim_io->command == SIM_COMMAND_UPDATE_RECORD)
+		sim_cache_invalidate(sim_io->fileid);
+
+	rc = sim_cache_request(t, sim_io->command, sim_io->fileid,
+		sim_io->p1, sim_io->p2, sim_io->p3);
+	if (rc == 0)
+		goto local;
+
 	rc = ril_request_sim_io_register(t, sim_io->command, sim_io->fileid,
 		sim_io->p1, sim_io->p2, sim_io->p3, sim_io_data, sim_io_size,
 		&sim_io_info);
@@ -823,37 +1271,17 @@ void ril_request_sim_io(RIL_Token t, void *data, size_t size)
 	if (rc < 0 || sim_io_info == NULL) {
 		ALOGE("%s: Unable to add the request to the list", __func__);
 		ril_request_complete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
-		if (sim_io_data != NULL)
-			free(sim_io_data);
-
-		// Send the next SIM I/O in the list
-		ril_request_sim_io_next();
-	}
-
-	if (ril_data.tokens.sim_io != RIL_TOKEN_NULL) {
-		ALOGD("%s: Another SIM I/O is being processed, adding to the list", __func__);
 		return;
 	}
 
-	if  (ril_data.smsc_number[0] == 0)
-	{
-		ril_data.tokens.sim_io = RIL_TOKEN_DATA_WAITING;
-		return;
-	}
-
-	sim_io_info->waiting = 0;
-	ril_data.tokens.sim_io = t;
-
-	ril_request_sim_io_complete(t, sim_io->command, sim_io->fileid,
-		sim_io->p1, sim_io->p2, sim_io->p3, sim_io_data, sim_io_size);
-
-	if (sim_io_data != NULL)
-		free(sim_io_data);
+	ril_request_sim_io_next();
 
-	sim_io_info->data = NULL;
-	sim_io_info->length = 0;
+	return;
 
+local:
+	ril_data.sim_boot_stats.local++;
 	return;
+
 error:
 	ril_request_complete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
 
@@ -42,50 +42,8 @@ struct sim_file_id {
 	unsigned char type;
 };
 
-struct sim_file_id sim_file_ids[] = {
-	{ 0x2F05, SIM_FILE_TYPE_EF },
-	{ 0x2FE2, SIM_FILE_TYPE_EF },
-	{ 0x3F00, SIM_FILE_TYPE_MF },
-	{ 0x4F20, SIM_FILE_TYPE_EF },
-	{ 0x5F3A, SIM_FILE_TYPE_DF },
-	{ 0x6F05, SIM_FILE_TYPE_EF },
-	{ 0x6F06, SIM_FILE_TYPE_EF },
-	{ 0x6F07, SIM_FILE_TYPE_EF },
-	{ 0x6F11, SIM_FILE_TYPE_EF },
-	{ 0x6F13, SIM_FILE_TYPE_EF },
-	{ 0x6F14, SIM_FILE_TYPE_EF },
-	{ 0x6F15, SIM_FILE_TYPE_EF },
-	{ 0x6F16, SIM_FILE_TYPE_EF },
-	{ 0x6F17, SIM_FILE_TYPE_EF },
-	{ 0x6F18, SIM_FILE_TYPE_EF },
-	{ 0x6F38, SIM_FILE_TYPE_EF },
-	{ 0x6F38, SIM_FILE_TYPE_EF },
-	{ 0x6F3A, SIM_FILE_TYPE_EF },
-	{ 0x6F40, SIM_FILE_TYPE_EF },
-	{ 0x6F42, SIM_FILE_TYPE_EF },
-	{ 0x6F45, SIM_FILE_TYPE_EF },
-	{ 0x6F46, SIM_FILE_TYPE_EF },
-	{ 0x6F48, SIM_FILE_TYPE_EF },
-	{ 0x6F49, SIM_FILE_TYPE_EF },
-	{ 0x6F4A, SIM_FILE_TYPE_EF },
-	{ 0x6F4D, SIM_FILE_TYPE_EF },
-	{ 0x6F50, SIM_FILE_TYPE_EF },
-	{ 0x6F56, SIM_FILE_TYPE_EF },
-	{ 0x6FAD, SIM_FILE_TYPE_EF },
-	{ 0x6FAE, SIM_FILE_TYPE_EF },
-	{ 0x6FB7, SIM_FILE_TYPE_EF },
-	{ 0x6FC5, SIM_FILE_TYPE_EF },
-	{ 0x6FC6, SIM_FILE_TYPE_EF },
-	{ 0x6FC7, SIM_FILE_TYPE_EF },
-	{ 0x6FC9, SIM_FILE_TYPE_EF },
-	{ 0x6FCA, SIM_FILE_TYPE_EF },
-	{ 0x6FCB, SIM_FILE_TYPE_EF },
-	{ 0x6FCD, SIM_FILE_TYPE_EF },
-	{ 0x7F10, SIM_FILE_TYPE_DF },
-	{ 0x7F20, SIM_FILE_TYPE_DF },
-};
-
-int sim_file_ids_count = sizeof(sim_file_ids) / sizeof(sim_file_ids[0]);
+extern struct sim_file_id sim_file_ids[];
+extern int sim_file_ids_count;
 
 struct sim_file_response {
 	unsigned char rfu12[2];
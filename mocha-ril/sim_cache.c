@@ -0,0 +1,277 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define LOG_TAG "RIL-Mocha-SIM-Cache"
+#include <utils/Log.h>
+
+#include "mocha-ril.h"
+#include "util.h"
+#include "sim.h"
+
+static int sim_cache_command(int command)
+{
+	switch (command) {
+		case SIM_COMMAND_GET_RESPONSE:
+		case SIM_COMMAND_READ_BINARY:
+		case SIM_COMMAND_READ_RECORD:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+static void sim_cache_stats_log(void)
+{
+	struct ril_sim_cache_stats *stats = &ril_data.sim_cache_stats;
+
+	ALOGD("%s: %u hits, %u misses, %u invalidations, %u evictions, %d entries (%d bytes)",
+		__func__, stats->hits, stats->misses, stats->invalidations,
+		stats->evictions, ril_data.sim_cache_count, (int) ril_data.sim_cache_size);
+}
+
+static struct list_head *sim_cache_find(int command, int fileid, int p1, int p2, int p3)
+{
+	struct ril_sim_cache_entry *entry;
+	struct list_head *list;
+
+	list = ril_data.sim_cache;
+	while (list != NULL) {
+		entry = (struct ril_sim_cache_entry *) list->data;
+		if (entry == NULL)
+			goto list_continue;
+
+		if (entry->command == command && entry->fileid == fileid &&
+			entry->p1 == p1 && entry->p2 == p2 && entry->p3 == p3)
+			return list;
+
+list_continue:
+		list = list->next;
+	}
+
+	return NULL;
+}
+
+static void sim_cache_remove(struct list_head *list)
+{
+	struct ril_sim_cache_entry *entry;
+
+	entry = (struct ril_sim_cache_entry *) list->data;
+	if (entry != NULL) {
+		ril_data.sim_cache_count--;
+		ril_data.sim_cache_size -= entry->size;
+
+		if (entry->data != NULL)
+			free(entry->data);
+
+		memset(entry, 0, sizeof(struct ril_sim_cache_entry));
+		free(entry);
+	}
+
+	if (list == ril_data.sim_cache)
+		ril_data.sim_cache = list->next;
+
+	list_head_free(list);
+}
+
+/*
+ * Drops the least recently used entry, returns -1 when empty.
+ */
+static int sim_cache_evict(void)
+{
+	struct ril_sim_cache_entry *entry;
+	struct list_head *oldest = NULL;
+	struct list_head *list;
+	unsigned int used = 0;
+
+	list = ril_data.sim_cache;
+	while (list != NULL) {
+		entry = (struct ril_sim_cache_entry *) list->data;
+		if (entry != NULL && (oldest == NULL || ril_data.sim_cache_tick - entry->used > used)) {
+			oldest = list;
+			used = ril_data.sim_cache_tick - entry->used;
+		}
+		list = list->next;
+	}
+
+	if (oldest == NULL)
+		return -1;
+
+	sim_cache_remove(oldest);
+	ril_data.sim_cache_stats.evictions++;
+
+	return 0;
+}
+
+/*
+ * Answers a framework SIM I/O request from the cache, returns 0 when done.
+ */
+int sim_cache_request(RIL_Token t, int command, int fileid, int p1, int p2, int p3)
+{
+	struct ril_sim_cache_entry *entry;
+	struct list_head *list;
+
+	if (!sim_cache_command(command))
+		return -1;
+
+	// The entries for the file are stale until the update completes
+	if (ril_request_sim_io_update_pending(fileid))
+		return -1;
+
+	list = sim_cache_find(command, fileid, p1, p2, p3);
+	if (list == NULL)
+		ril_data.sim_cache_stats.misses++;
+	else
+		ril_data.sim_cache_stats.hits++;
+
+	if ((ril_data.sim_cache_stats.hits + ril_data.sim_cache_stats.misses) % 64 == 0)
+		sim_cache_stats_log();
+
+	if (list == NULL)
+		return -1;
+
+	entry = (struct ril_sim_cache_entry *) list->data;
+	entry->used = ++ril_data.sim_cache_tick;
+
+	DEBUG_I("%s: fileid 0x%x command 0x%x %d %d %d from cache", __func__,
+		fileid, command, p1, p2, p3);
+
+	ril_request_sim_io_respond(t, entry->sw1, entry->sw2, entry->data, entry->size);
+
+	return 0;
+}
+
+/*
+ * Called with every SIM I/O response: successful reads are kept and
+ * updates drop everything known about the file.
+ */
+void sim_cache_response(struct ril_request_sim_io_info *sim_io,
+	int sw1, int sw2, unsigned char *data, size_t size)
+{
+	struct ril_sim_cache_entry *entry;
+	struct list_head *list_end;
+	struct list_head *list;
+
+	if (sim_io == NULL)
+		return;
+
+	if (sim_io->command == SIM_COMMAND_UPDATE_BINARY ||
+		sim_io->command == SIM_COMMAND_UPDATE_RECORD) {
+		sim_cache_invalidate(sim_io->fileid);
+		return;
+	}
+
+	if (!sim_cache_command(sim_io->command) || sw1 != 0x90)
+		return;
+
+	// A read sent before a queued update would bring back the old data
+	if (ril_request_sim_io_update_pending(sim_io->fileid))
+		return;
+
+	// The SIM store already keeps these records
+	if (sim_store_find(sim_io->fileid) != NULL)
+		return;
+
+	if (size > RIL_SIM_CACHE_SIZE)
+		return;
+
+	list = sim_cache_find(sim_io->command, sim_io->fileid,
+		sim_io->p1, sim_io->p2, sim_io->p3);
+	if (list != NULL)
+		sim_cache_remove(list);
+
+	while (ril_data.sim_cache_count >= RIL_SIM_CACHE_ENTRIES ||
+		ril_data.sim_cache_size + size > RIL_SIM_CACHE_SIZE) {
+		if (sim_cache_evict() < 0)
+			break;
+	}
+
+	entry = calloc(1, sizeof(struct ril_sim_cache_entry));
+	if (entry == NULL)
+		return;
+
+	if (data != NULL && size > 0) {
+		entry->data = malloc(size);
+		if (entry->data == NULL) {
+			free(entry);
+			return;
+		}
+
+		memcpy(entry->data, data, size);
+		entry->size = size;
+	}
+
+	entry->command = sim_io->command;
+	entry->fileid = sim_io->fileid;
+	entry->p1 = sim_io->p1;
+	entry->p2 = sim_io->p2;
+	entry->p3 = sim_io->p3;
+	entry->sw1 = sw1;
+	entry->sw2 = sw2;
+	entry->used = ++ril_data.sim_cache_tick;
+
+	list_end = ril_data.sim_cache;
+	while (list_end != NULL && list_end->next != NULL)
+		list_end = list_end->next;
+
+	list = list_head_alloc((void *) entry, list_end, NULL);
+
+	if (ril_data.sim_cache == NULL)
+		ril_data.sim_cache = list;
+
+	ril_data.sim_cache_count++;
+	ril_data.sim_cache_size += entry->size;
+}
+
+void sim_cache_invalidate(int fileid)
+{
+	struct ril_sim_cache_entry *entry;
+	struct list_head *list;
+	struct list_head *next;
+	int count = 0;
+
+	list = ril_data.sim_cache;
+	while (list != NULL) {
+		next = list->next;
+
+		entry = (struct ril_sim_cache_entry *) list->data;
+		if (entry != NULL && entry->fileid == fileid) {
+			sim_cache_remove(list);
+			count++;
+		}
+
+		list = next;
+	}
+
+	if (count > 0) {
+		ril_data.sim_cache_stats.invalidations++;
+		DEBUG_I("%s: fileid 0x%x: %d entries dropped", __func__, fileid, count);
+	}
+}
+
+void sim_cache_clear(void)
+{
+	if (ril_data.sim_cache == NULL)
+		return;
+
+	sim_cache_stats_log();
+
+	while (ril_data.sim_cache != NULL)
+		sim_cache_remove(ril_data.sim_cache);
+
+	ril_data.sim_cache_stats.invalidations++;
+}
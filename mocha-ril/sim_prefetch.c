@@ -0,0 +1,260 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <sys/time.h>
+
+#define LOG_TAG "RIL-Mocha-SIM-Prefetch"
+#include <utils/Log.h>
+#include <cutils/properties.h>
+
+#include "mocha-ril.h"
+#include "util.h"
+#include "sim.h"
+
+/*
+ * Files read as soon as the SIM is ready, with the same requests the
+ * framework issues, so that the SIM cache answers them. Transparent
+ * files are read whole, linear fixed files up to the given number of
+ * records (0 only reads the header).
+ *
+ * EF_SMSP (0x6F42) is left out: the modem glue takes over its responses
+ * to read the SMSC. EF_ADN, EF_FDN and EF_SMS are loaded whole by the
+ * SIM store.
+ */
+static struct sim_prefetch_file sim_prefetch_defaults[] = {
+	{ 0x2FE2, 0 },	/* EF_ICCID */
+	{ 0x6F07, 0 },	/* EF_IMSI */
+	{ 0x6FAD, 0 },	/* EF_AD */
+	{ 0x6F46, 0 },	/* EF_SPN */
+	{ 0x6F38, 0 },	/* EF_SST / EF_UST */
+	{ 0x6F40, 1 },	/* EF_MSISDN */
+	{ 0x6F4A, 0 },	/* EF_EXT1 */
+};
+
+static struct sim_prefetch_file sim_prefetch_files[RIL_SIM_PREFETCH_FILES];
+static int sim_prefetch_files_count = -1;
+
+static void sim_prefetch_info_callback(struct ril_request_sim_io_info *sim_io,
+	int sw1, int sw2, unsigned char *data, size_t size);
+static void sim_prefetch_data_callback(struct ril_request_sim_io_info *sim_io,
+	int sw1, int sw2, unsigned char *data, size_t size);
+
+/*
+ * The list is "fileid[:records],...", in hex for the file IDs, or
+ * "none" to disable prefetching.
+ */
+static void sim_prefetch_config(void)
+{
+	char value[PROPERTY_VALUE_MAX];
+	char *p;
+	int count = 0;
+
+	property_get(RIL_SIM_PREFETCH_PROPERTY, value, "");
+
+	if (value[0] == '\0') {
+		count = sizeof(sim_prefetch_defaults) / sizeof(sim_prefetch_defaults[0]);
+		memcpy(sim_prefetch_files, sim_prefetch_defaults, sizeof(sim_prefetch_defaults));
+		goto complete;
+	}
+
+	if (strcmp(value, "none") == 0)
+		goto complete;
+
+	p = value;
+	while (*p != '\0' && count < RIL_SIM_PREFETCH_FILES) {
+		sim_prefetch_files[count].fileid = strtol(p, &p, 16);
+		sim_prefetch_files[count].records = 0;
+
+		if (*p == ':')
+			sim_prefetch_files[count].records = strtol(p + 1, &p, 10);
+
+		if (sim_prefetch_files[count].fileid > 0)
+			count++;
+
+		while (*p != '\0' && *p != ',')
+			p++;
+		if (*p == ',')
+			p++;
+	}
+
+complete:
+	sim_prefetch_files_count = count;
+	ALOGD("%s: %d files to prefetch", __func__, count);
+}
+
+static struct sim_prefetch_file *sim_prefetch_file_find(int fileid)
+{
+	int i;
+
+	for (i = 0 ; i < sim_prefetch_files_count ; i++)
+		if (sim_prefetch_files[i].fileid == fileid)
+			return &sim_prefetch_files[i];
+
+	return NULL;
+}
+
+static unsigned int sim_prefetch_time(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+
+	return (now.tv_sec - ril_data.sim_prefetch_start.tv_sec) * 1000 +
+		(now.tv_usec - ril_data.sim_prefetch_start.tv_usec) / 1000;
+}
+
+static void sim_prefetch_queue(int command, int fileid, int p1, int p2, int p3,
+	ril_sim_io_callback callback)
+{
+	int rc;
+
+	rc = ril_sim_io_request(command, fileid, p1, p2, p3, NULL, 0, callback);
+	if (rc < 0) {
+		ALOGE("%s: Unable to queue fileid 0x%x", __func__, fileid);
+		return;
+	}
+
+	ril_data.sim_prefetch_pending++;
+}
+
+static void sim_prefetch_done(void)
+{
+	ril_data.sim_prefetch_pending--;
+
+	if (ril_data.sim_prefetch_pending == 0)
+		ALOGD("%s: Prefetch complete at +%u ms", __func__, sim_prefetch_time());
+}
+
+static void sim_prefetch_drop_callback(struct ril_request_sim_io_info *sim_io,
+	int sw1, int sw2, unsigned char *data, size_t size)
+{
+	ALOGD("%s: Dropped response for fileid 0x%x", __func__, sim_io->fileid);
+}
+
+void sim_prefetch_start(void)
+{
+	int i;
+
+	if (ril_data.sim_prefetch_started)
+		return;
+
+	if (sim_prefetch_files_count < 0)
+		sim_prefetch_config();
+
+	ril_data.sim_prefetch_started = 1;
+	ril_data.sim_prefetch_pending = 0;
+	gettimeofday(&ril_data.sim_prefetch_start, NULL);
+
+	for (i = 0 ; i < sim_prefetch_files_count ; i++)
+		sim_prefetch_queue(SIM_COMMAND_GET_RESPONSE, sim_prefetch_files[i].fileid,
+			0, 0, sizeof(struct sim_file_response), sim_prefetch_info_callback);
+}
+
+void sim_prefetch_reset(void)
+{
+	struct ril_request_sim_io_info *sim_io;
+	struct list_head *list;
+	struct list_head *next;
+
+	if (!ril_data.sim_prefetch_started)
+		return;
+
+	// Drop the requests not sent yet, the others complete unnoticed
+	// (their responses still go to the SIM cache)
+	list = ril_data.sim_io;
+	while (list != NULL) {
+		next = list->next;
+
+		sim_io = (struct ril_request_sim_io_info *) list->data;
+		if (sim_io == NULL)
+			goto list_continue;
+
+		if (sim_io->callback != sim_prefetch_info_callback &&
+			sim_io->callback != sim_prefetch_data_callback)
+			goto list_continue;
+
+		if (sim_io->waiting)
+			ril_request_sim_io_unregister(sim_io);
+		else
+			sim_io->callback = sim_prefetch_drop_callback;
+
+list_continue:
+		list = next;
+	}
+
+	ril_data.sim_prefetch_started = 0;
+	ril_data.sim_prefetch_pending = 0;
+}
+
+static void sim_prefetch_info_callback(struct ril_request_sim_io_info *sim_io,
+	int sw1, int sw2, unsigned char *data, size_t size)
+{
+	struct sim_prefetch_file *file;
+	int file_size;
+	int record_size;
+	int i;
+
+	if (!ril_data.sim_prefetch_started)
+		return;
+
+	ALOGD("%s: fileid 0x%x header at +%u ms (%02x %02x)", __func__,
+		sim_io->fileid, sim_prefetch_time(), sw1, sw2);
+
+	file = sim_prefetch_file_find(sim_io->fileid);
+	if (file == NULL || sw1 != 0x90 || data == NULL || size < sizeof(struct sim_file_response))
+		goto complete;
+
+	file_size = (data[2] << 8) | data[3];
+	record_size = data[14];
+
+	switch (data[13]) {
+		case SIM_FILE_STRUCTURE_TRANSPARENT:
+			if (file_size <= 0)
+				break;
+			if (file_size > RIL_SIM_IO_DATA_SIZE)
+				file_size = RIL_SIM_IO_DATA_SIZE;
+
+			sim_prefetch_queue(SIM_COMMAND_READ_BINARY, sim_io->fileid,
+				0, 0, file_size, sim_prefetch_data_callback);
+			break;
+		case SIM_FILE_STRUCTURE_LINEAR_FIXED:
+		case SIM_FILE_STRUCTURE_CYCLIC:
+			if (record_size <= 0)
+				break;
+
+			for (i = 1 ; i <= file->records && i <= file_size / record_size ; i++)
+				sim_prefetch_queue(SIM_COMMAND_READ_RECORD, sim_io->fileid,
+					i, 0x04, record_size, sim_prefetch_data_callback);
+			break;
+	}
+
+complete:
+	sim_prefetch_done();
+}
+
+static void sim_prefetch_data_callback(struct ril_request_sim_io_info *sim_io,
+	int sw1, int sw2, unsigned char *data, size_t size)
+{
+	if (!ril_data.sim_prefetch_started)
+		return;
+
+	ALOGD("%s: fileid 0x%x record %d at +%u ms (%02x %02x, %d bytes)", __func__,
+		sim_io->fileid, sim_io->p1, sim_prefetch_time(), sw1, sw2, (int) size);
+
+	sim_prefetch_done();
+}
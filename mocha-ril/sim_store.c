@@ -0,0 +1,563 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define LOG_TAG "RIL-Mocha-SIM-Store"
+#include <utils/Log.h>
+
+#include "mocha-ril.h"
+#include "util.h"
+#include "sim.h"
+
+// Records are addressed with P2 = 0x04 (absolute mode, TS 51.011 9.2.5)
+#define SIM_RECORD_MODE_ABSOLUTE	0x04
+#define SIM_RECORD_COUNT_MAX		255
+
+static void sim_store_info_callback(struct ril_request_sim_io_info *sim_io,
+	int sw1, int sw2, unsigned char *data, size_t size);
+static void sim_store_record_callback(struct ril_request_sim_io_info *sim_io,
+	int sw1, int sw2, unsigned char *data, size_t size);
+
+struct sim_store_file *sim_store_find(int fileid)
+{
+	struct sim_store_file *file;
+	struct list_head *list;
+
+	list = ril_data.sim_store;
+	while (list != NULL) {
+		file = (struct sim_store_file *) list->data;
+		if (file == NULL)
+			goto list_continue;
+
+		if (file->fileid == fileid)
+			return file;
+
+list_continue:
+		list = list->next;
+	}
+
+	return NULL;
+}
+
+unsigned char *sim_store_record(struct sim_store_file *file, int index)
+{
+	if (file == NULL || file->records == NULL)
+		return NULL;
+
+	if (index < 1 || index > file->count || !file->valid[index - 1])
+		return NULL;
+
+	return file->records + (index - 1) * file->record_size;
+}
+
+static void sim_store_file_free(struct sim_store_file *file)
+{
+	struct list_head *list;
+
+	list = ril_data.sim_store;
+	while (list != NULL) {
+		if (list->data == (void *) file) {
+			if (list == ril_data.sim_store)
+				ril_data.sim_store = list->next;
+
+			list_head_free(list);
+			break;
+		}
+		list = list->next;
+	}
+
+	if (file->records != NULL)
+		free(file->records);
+	if (file->valid != NULL)
+		free(file->valid);
+	if (file->index != NULL)
+		free(file->index);
+
+	memset(file, 0, sizeof(struct sim_store_file));
+	free(file);
+}
+
+/*
+ * Internal request whose file was dropped while it was with the modem.
+ */
+static void sim_store_drop_callback(struct ril_request_sim_io_info *sim_io,
+	int sw1, int sw2, unsigned char *data, size_t size)
+{
+	ALOGD("%s: Dropped response for fileid 0x%x", __func__, sim_io->fileid);
+}
+
+void sim_store_load(int fileid)
+{
+	struct sim_store_file *file;
+	struct list_head *list_end;
+	struct list_head *list;
+	int rc;
+
+	if (sim_store_find(fileid) != NULL)
+		return;
+
+	file = calloc(1, sizeof(struct sim_store_file));
+	if (file == NULL)
+		return;
+
+	file->fileid = fileid;
+	file->state = SIM_STORE_LOADING;
+	gettimeofday(&file->start, NULL);
+
+	list_end = ril_data.sim_store;
+	while (list_end != NULL && list_end->next != NULL)
+		list_end = list_end->next;
+
+	list = list_head_alloc((void *) file, list_end, NULL);
+
+	if (ril_data.sim_store == NULL)
+		ril_data.sim_store = list;
+
+	rc = ril_sim_io_request(SIM_COMMAND_GET_RESPONSE, fileid, 0, 0,
+		sizeof(struct sim_file_response), NULL, 0, sim_store_info_callback);
+	if (rc < 0) {
+		ALOGE("%s: Unable to request fileid 0x%x info", __func__, fileid);
+		sim_store_file_free(file);
+	}
+}
+
+void sim_store_clear(void)
+{
+	struct ril_request_sim_io_info *sim_io;
+	struct list_head *list;
+	struct list_head *next;
+
+	if (ril_data.sim_store == NULL)
+		return;
+
+	// Drop the loading requests still queued
+	list = ril_data.sim_io;
+	while (list != NULL) {
+		next = list->next;
+
+		sim_io = (struct ril_request_sim_io_info *) list->data;
+		if (sim_io == NULL)
+			goto list_continue;
+
+		if (sim_io->callback != sim_store_info_callback &&
+			sim_io->callback != sim_store_record_callback)
+			goto list_continue;
+
+		if (sim_io->waiting)
+			ril_request_sim_io_unregister(sim_io);
+		else
+			sim_io->callback = sim_store_drop_callback;
+
+list_continue:
+		list = next;
+	}
+
+	while (ril_data.sim_store != NULL) {
+		if (ril_data.sim_store->data == NULL) {
+			list_head_free(ril_data.sim_store);
+			ril_data.sim_store = NULL;
+			break;
+		}
+
+		sim_store_file_free((struct sim_store_file *) ril_data.sim_store->data);
+	}
+}
+
+static void sim_store_loaded(struct sim_store_file *file)
+{
+	struct sim_store_sms_index index;
+	struct timeval now;
+	unsigned int time;
+
+	if (file->loaded + file->failed < file->count)
+		return;
+
+	file->state = SIM_STORE_READY;
+
+	gettimeofday(&now, NULL);
+	time = (now.tv_sec - file->start.tv_sec) * 1000 +
+		(now.tv_usec - file->start.tv_usec) / 1000;
+
+	ALOGD("%s: fileid 0x%x: %d/%d records loaded in %u ms (%u records/s)",
+		__func__, file->fileid, file->loaded, file->count, time,
+		time > 0 ? file->loaded * 1000 / time : 0);
+
+	if (file->fileid == SIM_EF_SMS) {
+		sim_store_sms_index(&index);
+		ALOGD("%s: SMS: %d free, %d read, %d unread, %d sent, %d unsent",
+			__func__, index.free, index.read, index.unread,
+			index.sent, index.unsent);
+	}
+}
+
+/*
+ * Only SIM_STORE_READS records of the file are queued at a time, the
+ * next ones as they complete: framework requests queued meanwhile don't
+ * wait behind the whole file. Records they read are not read again.
+ */
+static void sim_store_read_next(struct sim_store_file *file)
+{
+	int rc;
+
+	while (file->next <= file->count && file->reading < SIM_STORE_READS) {
+		// Read meanwhile by the framework
+		if (file->valid[file->next - 1]) {
+			file->loaded++;
+			file->next++;
+			continue;
+		}
+
+		rc = ril_sim_io_request(SIM_COMMAND_READ_RECORD, file->fileid, file->next,
+			SIM_RECORD_MODE_ABSOLUTE, file->record_size, NULL, 0,
+			sim_store_record_callback);
+		file->next++;
+
+		if (rc < 0)
+			file->failed++;
+		else
+			file->reading++;
+	}
+}
+
+static void sim_store_info_callback(struct ril_request_sim_io_info *sim_io,
+	int sw1, int sw2, unsigned char *data, size_t size)
+{
+	struct sim_store_file *file;
+	int file_size;
+
+	file = sim_store_find(sim_io->fileid);
+	if (file == NULL || file->records != NULL)
+		return;
+
+	if (sw1 != 0x90 || data == NULL || size < sizeof(file->info)) {
+		ALOGE("%s: Unable to get fileid 0x%x info", __func__, file->fileid);
+		goto error;
+	}
+
+	memcpy(file->info, data, sizeof(file->info));
+
+	file_size = (data[2] << 8) | data[3];
+	file->record_size = data[14];
+
+	if (file->record_size == 0 || file_size < file->record_size) {
+		ALOGE("%s: fileid 0x%x is not a record file", __func__, file->fileid);
+		goto error;
+	}
+
+	file->count = file_size / file->record_size;
+	if (file->count > SIM_RECORD_COUNT_MAX)
+		file->count = SIM_RECORD_COUNT_MAX;
+
+	file->records = calloc(file->count, file->record_size);
+	file->valid = calloc(file->count, 1);
+	file->index = calloc(file->count, 1);
+	if (file->records == NULL || file->valid == NULL || file->index == NULL)
+		goto error;
+
+	file->index_dirty = 1;
+
+	ALOGD("%s: fileid 0x%x: loading %d records of %d bytes", __func__,
+		file->fileid, file->count, file->record_size);
+
+	file->next = 1;
+	sim_store_read_next(file);
+
+	sim_store_loaded(file);
+
+	return;
+
+error:
+	sim_store_file_free(file);
+}
+
+static void sim_store_record_callback(struct ril_request_sim_io_info *sim_io,
+	int sw1, int sw2, unsigned char *data, size_t size)
+{
+	struct sim_store_file *file;
+
+	file = sim_store_find(sim_io->fileid);
+	if (file == NULL || file->state != SIM_STORE_LOADING || file->records == NULL)
+		return;
+
+	file->reading--;
+
+	// The record itself was stored by sim_store_response
+	if (sim_store_record(file, sim_io->p1) != NULL)
+		file->loaded++;
+	else
+		file->failed++;
+
+	sim_store_read_next(file);
+	sim_store_loaded(file);
+}
+
+static void sim_store_index_build(struct sim_store_file *file)
+{
+	unsigned char *record;
+	int i, j;
+
+	file->index_count = 0;
+
+	// Insertion sort, files hold at most 255 records
+	for (i = 1 ; i <= file->count ; i++) {
+		record = sim_store_record(file, i);
+		if (record == NULL)
+			continue;
+
+		for (j = file->index_count ; j > 0 ; j--) {
+			if (memcmp(sim_store_record(file, file->index[j - 1]), record, file->record_size) <= 0)
+				break;
+			file->index[j] = file->index[j - 1];
+		}
+
+		file->index[j] = i;
+		file->index_count++;
+	}
+
+	file->index_dirty = 0;
+}
+
+/*
+ * Returns the first (or last, when backward) record starting with the
+ * pattern, or 0 when none does.
+ */
+static int sim_store_seek(struct sim_store_file *file,
+	unsigned char *pattern, size_t length, int backward)
+{
+	int low, high, middle;
+	int found = 0;
+	int i;
+
+	if (file->index_dirty)
+		sim_store_index_build(file);
+
+	low = 0;
+	high = file->index_count;
+	while (low < high) {
+		middle = (low + high) / 2;
+		if (memcmp(sim_store_record(file, file->index[middle]), pattern, length) < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	for (i = low ; i < file->index_count ; i++) {
+		if (memcmp(sim_store_record(file, file->index[i]), pattern, length) != 0)
+			break;
+
+		if (found == 0 || (backward ? file->index[i] > found : file->index[i] < found))
+			found = file->index[i];
+	}
+
+	return found;
+}
+
+/*
+ * Answers type 2 SEEK from the beginning or the end of the file (TS 51.011
+ * 9.2.6), which only needs every record to be in memory. Type 1 SEEK sets
+ * the record pointer on the SIM, so it goes to the SIM along with searches
+ * relative to that pointer.
+ */
+static int sim_store_seek_request(RIL_Token t, struct sim_store_file *file,
+	int p2, unsigned char *pattern, size_t length)
+{
+	unsigned char response;
+	int type = p2 & 0xF0;
+	int mode = p2 & 0x0F;
+	int record;
+
+	if (type != 0x10 || mode > 1)
+		return -1;
+
+	if (file->failed > 0 || file->loaded < file->count)
+		return -1;
+
+	if (pattern == NULL || length == 0 || length > (size_t) file->record_size)
+		return -1;
+
+	record = sim_store_seek(file, pattern, length, mode == 1);
+
+	// 94 04: pattern not found (TS 51.011 9.4.4), as the modem answers
+	if (record == 0) {
+		ril_request_sim_io_respond(t, 0x94, 0x04, NULL, 0);
+	} else {
+		response = record;
+		ril_request_sim_io_respond(t, 0x90, 0x00, &response, sizeof(response));
+	}
+
+	file->seeks++;
+
+	ALOGD("%s: fileid 0x%x: record %d, %u SIM searches saved", __func__,
+		file->fileid, record, file->seeks);
+
+	return 0;
+}
+
+/*
+ * Serves a framework SIM I/O request from memory, returns 0 when done.
+ */
+int sim_store_request(RIL_Token t, int command, int fileid,
+	int p1, int p2, int p3, void *data, size_t size)
+{
+	struct sim_store_file *file;
+	unsigned char *record;
+
+	// Records already read are served while the file is loading
+	file = sim_store_find(fileid);
+	if (file == NULL || file->records == NULL)
+		return -1;
+
+	// A queued update must reach the SIM before the record is served again
+	if (ril_request_sim_io_update_pending(fileid))
+		return -1;
+
+	switch (command) {
+		case SIM_COMMAND_GET_RESPONSE:
+			ril_request_sim_io_respond(t, 0x90, 0x00, file->info, sizeof(file->info));
+			break;
+		case SIM_COMMAND_READ_RECORD:
+			if (p2 != SIM_RECORD_MODE_ABSOLUTE || p3 != file->record_size)
+				return -1;
+
+			record = sim_store_record(file, p1);
+			if (record == NULL)
+				return -1;
+
+			ril_request_sim_io_respond(t, 0x90, 0x00, record, file->record_size);
+			break;
+		case SIM_COMMAND_SEEK:
+			if (file->state != SIM_STORE_READY)
+				return -1;
+
+			return sim_store_seek_request(t, file, p2, data, size);
+		default:
+			return -1;
+	}
+
+	file->hits++;
+
+	return 0;
+}
+
+/*
+ * Called with every SIM I/O response to keep the stored records in sync.
+ */
+void sim_store_response(struct ril_request_sim_io_info *sim_io,
+	int sw1, int sw2, unsigned char *data, size_t size)
+{
+	struct sim_store_file *file;
+	unsigned char *record;
+	int index;
+
+	if (sim_io == NULL || sw1 != 0x90)
+		return;
+
+	file = sim_store_find(sim_io->fileid);
+	if (file == NULL || file->records == NULL)
+		return;
+
+	index = sim_io->p1;
+	if (sim_io->p2 != SIM_RECORD_MODE_ABSOLUTE || index < 1 || index > file->count)
+		return;
+
+	record = file->records + (index - 1) * file->record_size;
+
+	switch (sim_io->command) {
+		case SIM_COMMAND_READ_RECORD:
+			if (data == NULL || size != (size_t) file->record_size)
+				return;
+
+			if (!file->valid[index - 1] || memcmp(record, data, file->record_size) != 0)
+				file->index_dirty = 1;
+
+			memcpy(record, data, file->record_size);
+			file->valid[index - 1] = 1;
+			break;
+		case SIM_COMMAND_UPDATE_RECORD:
+			if (sim_io->length != file->record_size)
+				return;
+
+			memcpy(record, sim_io->data, file->record_size);
+			file->valid[index - 1] = 1;
+			file->index_dirty = 1;
+			file->writes++;
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * Returns the number of files still loading.
+ */
+int sim_store_loading(void)
+{
+	struct sim_store_file *file;
+	struct list_head *list;
+	int count = 0;
+
+	list = ril_data.sim_store;
+	while (list != NULL) {
+		file = (struct sim_store_file *) list->data;
+		if (file != NULL && file->state == SIM_STORE_LOADING)
+			count++;
+
+		list = list->next;
+	}
+
+	return count;
+}
+
+void sim_store_sms_index(struct sim_store_sms_index *index)
+{
+	struct sim_store_file *file;
+	unsigned char *record;
+	int i;
+
+	if (index == NULL)
+		return;
+
+	memset(index, 0, sizeof(struct sim_store_sms_index));
+
+	file = sim_store_find(SIM_EF_SMS);
+	if (file == NULL)
+		return;
+
+	for (i = 1 ; i <= file->count ; i++) {
+		record = sim_store_record(file, i);
+		if (record == NULL)
+			continue;
+
+		switch (record[0] & 0x07) {
+			case 0x01:
+				index->read++;
+				break;
+			case 0x03:
+				index->unread++;
+				break;
+			case 0x05:
+				index->sent++;
+				break;
+			case 0x07:
+				index->unsent++;
+				break;
+			default:
+				index->free++;
+				break;
+		}
+	}
+}
@@ -21,36 +21,225 @@
  */
 
 #define LOG_TAG "RIL-Mocha-SMS"
+#include <sys/time.h>
 #include <utils/Log.h>
+#include <cutils/properties.h>
 
 #include "mocha-ril.h"
 #include "util.h"
+#include "gsm7.h"
+#include "hex.h"
 #include <tapi_nettext.h>
 
+/*
+ * Outgoing SMS are sent with up to ril_data.sms_send_window messages in
+ * flight. Each one gets a reference passed to the modem as hNetTextInfo,
+ * which the send callback is matched against, falling back to the oldest
+ * message in flight. That fallback is only safe with a single message in
+ * flight, which is why the window defaults to 1.
+ */
+
+void ril_sms_init(void)
+{
+	char value[PROPERTY_VALUE_MAX];
+	int window;
+
+	memset(&ril_data.sms_stats, 0, sizeof(ril_data.sms_stats));
+
+	property_get(RIL_SMS_SEND_WINDOW_PROPERTY, value, "");
+	window = atoi(value);
+	if (window <= 0)
+		window = RIL_SMS_SEND_WINDOW;
+
+	ril_data.sms_send_window = window;
+	ALOGD("%s: SMS send window is %d", __func__, window);
+
+	memset(&ril_data.sms_concat_stats, 0, sizeof(ril_data.sms_concat_stats));
+
+	property_get(RIL_SMS_CONCAT_PROPERTY, value, "0");
+	ril_data.sms_concat_enabled = atoi(value) > 0;
+	ALOGD("%s: SMS reassembly is %s", __func__, ril_data.sms_concat_enabled ? "enabled" : "disabled");
+
+	ril_sms_outbox_open();
+}
+
+static void ril_sms_stats_update(struct ril_request_send_sms_info *send_sms, int success)
+{
+	struct ril_sms_stats *stats = &ril_data.sms_stats;
+	struct timeval now;
+	unsigned int latency;
+
+	gettimeofday(&now, NULL);
+	latency = (now.tv_sec - send_sms->time.tv_sec) * 1000 +
+		(now.tv_usec - send_sms->time.tv_usec) / 1000;
+
+	if (success)
+		stats->sent++;
+	else
+		stats->failed++;
+
+	stats->latency_total += latency;
+	if (latency > stats->latency_max)
+		stats->latency_max = latency;
+
+	ALOGD("%s: SMS ref %d %s in %ums (%u sent, %u failed, %u retries, avg %ums, max %ums, max in flight %u)",
+		__func__, send_sms->ref, success ? "sent" : "failed", latency,
+		stats->sent, stats->failed, stats->retries,
+		stats->latency_total / (stats->sent + stats->failed),
+		stats->latency_max, stats->inflight_max);
+}
+
+/*
+ * Messages replayed from the outbox journal have no token to complete.
+ */
+static void ril_sms_complete(struct ril_request_send_sms_info *send_sms, RIL_Errno e, void *data, size_t length)
+{
+	if (send_sms->token == RIL_TOKEN_NULL) {
+		ALOGD("%s: Replayed SMS %s", __func__, e == RIL_E_SUCCESS ? "sent" : "failed");
+		return;
+	}
+
+	ril_request_complete(send_sms->token, e, data, length);
+}
+
+static void ril_sms_retry_callback(void *data)
+{
+	RIL_LOCK();
+	ril_request_send_sms_next();
+	RIL_UNLOCK();
+}
+
+/*
+ * The modem reports the TS 24.011 RP-cause (8.2.5.4) the network gave
+ * for a failed message. Only the causes the spec marks temporary may go
+ * away by sending again. Statuses above the RP-cause range come from the
+ * modem itself, out of service for instance, and are retried as well.
+ */
+static int ril_sms_failure_temporary(uint32_t status)
+{
+	switch (status) {
+		case 38: // Network out of order
+		case 41: // Temporary failure
+		case 42: // Congestion
+		case 47: // Resources unavailable, unspecified
+			return 1;
+		default:
+			return status > RIL_SMS_RP_CAUSE_MAX;
+	}
+}
+
+/*
+ * Puts a failed message back in the queue after an exponential backoff,
+ * returns -1 when it ran out of retries. It stays at the head of the
+ * queue, the messages after it wait for it to be sent.
+ */
+static int ril_sms_retry(struct ril_request_send_sms_info *send_sms)
+{
+	struct timeval delay;
+
+	if (send_sms->retries >= RIL_SMS_RETRY_MAX)
+		return -1;
+
+	delay.tv_sec = RIL_SMS_RETRY_DELAY << send_sms->retries;
+	delay.tv_usec = 0;
+
+	send_sms->retries++;
+	send_sms->inflight = 0;
+	ril_data.sms_stats.inflight--;
+	ril_data.sms_stats.retries++;
+
+	gettimeofday(&send_sms->retry_time, NULL);
+	send_sms->retry_time.tv_sec += delay.tv_sec;
+
+	ALOGD("%s: Retrying SMS ref %d in %lds", __func__, send_sms->ref, (long) delay.tv_sec);
+	ril_request_timed_callback(ril_sms_retry_callback, NULL, &delay);
+
+	return 0;
+}
+
+/*
+ * Accounts the time spent turning an incoming modem message into its PDU
+ * and handing it over, in microseconds.
+ */
+static void ril_sms_stats_received(struct timeval *start)
+{
+	struct ril_sms_stats *stats = &ril_data.sms_stats;
+	struct timeval now;
+	unsigned int time;
+
+	gettimeofday(&now, NULL);
+	time = (now.tv_sec - start->tv_sec) * 1000000 + (now.tv_usec - start->tv_usec);
+
+	stats->received++;
+	stats->receive_time_total += time;
+	if (time > stats->receive_time_max)
+		stats->receive_time_max = time;
+
+	ALOGD("%s: SMS handled in %uus (%u received, avg %uus, max %uus)",
+		__func__, time, stats->received,
+		stats->receive_time_total / stats->received, stats->receive_time_max);
+}
+
 void ipc_sms_send_status(void* data)
 {
 	tapiNettextCallBack* callBack = (tapiNettextCallBack*)(data);
+	struct ril_request_send_sms_info *send_sms;
 
 	RIL_SMS_Response response;
 
+	send_sms = ril_request_send_sms_info_find_ref(callBack->unknown1);
+	if (send_sms == NULL) {
+		send_sms = ril_request_send_sms_info_find_inflight();
+		if (send_sms != NULL)
+			ALOGW("%s: No SMS with reference %u, completing the oldest one in flight (%d)",
+				__func__, callBack->unknown1, send_sms->ref);
+	}
+	if (send_sms == NULL) {
+		ALOGE("%s: No SMS in flight for this callback", __func__);
+		return;
+	}
+
 	memset(&response, 0, sizeof(response));
-	response.messageRef = 0;
+	response.messageRef = send_sms->ref;
 	response.ackPDU = NULL;
 
 	switch(callBack->status){
 		case 0:
 			DEBUG_I("%s : Message sent  ", __func__);
 			response.errorCode = -1;
-			ril_request_complete(ril_data.tokens.outgoing_sms, RIL_E_SUCCESS, &response, sizeof(response));
+			ril_sms_complete(send_sms, RIL_E_SUCCESS, &response, sizeof(response));
+			ril_sms_stats_update(send_sms, 1);
 			break;
 
 		default:
-			DEBUG_I("%s : Message sending error  ", __func__);
-			response.errorCode = 500;
-			ril_request_complete(ril_data.tokens.outgoing_sms, RIL_E_GENERIC_FAILURE, &response, sizeof(response));
+			DEBUG_I("%s : Message sending error %u", __func__, callBack->status);
+
+			// TS 27.005 3.2.5: RP-causes are reported as is, 500 is unknown
+			if (callBack->status <= RIL_SMS_RP_CAUSE_MAX)
+				response.errorCode = callBack->status;
+			else
+				response.errorCode = 500;
+
+			if (!ril_sms_failure_temporary(callBack->status)) {
+				ALOGE("%s: SMS ref %d rejected with cause %u, not retrying",
+					__func__, send_sms->ref, callBack->status);
+				ril_sms_complete(send_sms, RIL_E_GENERIC_FAILURE, &response, sizeof(response));
+				ril_sms_stats_update(send_sms, 0);
+				break;
+			}
+
+			if (ril_sms_retry(send_sms) == 0) {
+				ril_request_send_sms_next();
+				return;
+			}
+
+			ril_sms_complete(send_sms, RIL_E_SMS_SEND_FAIL_RETRY, &response, sizeof(response));
+			ril_sms_stats_update(send_sms, 0);
 			break;
 	}
 
+	ril_request_send_sms_unregister(send_sms);
+
 	// Send the next SMS in the list
 	ril_request_send_sms_next();
 }
@@ -59,7 +248,8 @@ void ipc_sms_send_status(void* data)
  * Outgoing SMS functions
  */
 
-int ril_request_send_sms_register(unsigned char *pdu, size_t pdu_size, unsigned char *smsc, size_t smsc_size, RIL_Token t)
+int ril_request_send_sms_register(struct sms_submit *submit, RIL_Token t,
+	struct ril_request_send_sms_info **send_sms_p)
 {
 	struct ril_request_send_sms_info *send_sms;
 	struct list_head *list_end;
@@ -69,10 +259,7 @@ int ril_request_send_sms_register(unsigned char *pdu, size_t pdu_size, unsigned
 	if (send_sms == NULL)
 		return -1;
 
-	send_sms->pdu = pdu;
-	send_sms->pdu_size = pdu_size;
-	send_sms->smsc = smsc;
-	send_sms->smsc_size = smsc_size;
+	memcpy(&send_sms->submit, submit, sizeof(struct sms_submit));
 	send_sms->token = t;
 
 	list_end = ril_data.outgoing_sms;
@@ -84,6 +271,8 @@ int ril_request_send_sms_register(unsigned char *pdu, size_t pdu_size, unsigned
 	if (ril_data.outgoing_sms == NULL)
 		ril_data.outgoing_sms = list;
 
+	if (send_sms_p != NULL)
+		*send_sms_p = send_sms;
 	return 0;
 }
 
@@ -97,6 +286,11 @@ void ril_request_send_sms_unregister(struct ril_request_send_sms_info *send_sms)
 	list = ril_data.outgoing_sms;
 	while (list != NULL) {
 		if (list->data == (void *) send_sms) {
+			if (send_sms->inflight)
+				ril_data.sms_stats.inflight--;
+
+			ril_sms_outbox_done(send_sms);
+
 			memset(send_sms, 0, sizeof(struct ril_request_send_sms_info));
 			free(send_sms);
 
@@ -116,13 +310,20 @@ struct ril_request_send_sms_info *ril_request_send_sms_info_find(void)
 {
 	struct ril_request_send_sms_info *send_sms;
 	struct list_head *list;
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
 
 	list = ril_data.outgoing_sms;
 	while (list != NULL) {
 		send_sms = (struct ril_request_send_sms_info *) list->data;
-		if (send_sms == NULL)
+		if (send_sms == NULL || send_sms->inflight)
 			goto list_continue;
 
+		// Still backing off, the messages after it keep their order
+		if (send_sms->retries > 0 && timercmp(&now, &send_sms->retry_time, <))
+			return NULL;
+
 		return send_sms;
 
 list_continue:
@@ -132,481 +333,879 @@ list_continue:
 	return NULL;
 }
 
-void ril_request_send_sms_next(void)
+struct ril_request_send_sms_info *ril_request_send_sms_info_find_inflight(void)
 {
 	struct ril_request_send_sms_info *send_sms;
-	RIL_Token t;
-	unsigned char *pdu;
-	unsigned char *smsc;
-	size_t pdu_size;
-	size_t smsc_size;
+	struct list_head *list;
 
-	ril_data.tokens.outgoing_sms = RIL_TOKEN_NULL;
+	list = ril_data.outgoing_sms;
+	while (list != NULL) {
+		send_sms = (struct ril_request_send_sms_info *) list->data;
+		if (send_sms == NULL || !send_sms->inflight)
+			goto list_continue;
 
-	send_sms = ril_request_send_sms_info_find();
-	if (send_sms == NULL)
-		return;
+		return send_sms;
 
-	t = send_sms->token;
-	pdu = send_sms->pdu;
-	pdu_size = send_sms->pdu_size;
-	smsc = send_sms->smsc;
-	smsc_size = send_sms->smsc_size;
+list_continue:
+		list = list->next;
+	}
 
-	ril_request_send_sms_unregister(send_sms);
+	return NULL;
+}
 
-	if (pdu == NULL) {
-		ALOGE("SMS send request has no valid PDU");
-		if (smsc != NULL)
-			free(smsc);
-		return;
+struct ril_request_send_sms_info *ril_request_send_sms_info_find_ref(uint32_t ref)
+{
+	struct ril_request_send_sms_info *send_sms;
+	struct list_head *list;
+
+	list = ril_data.outgoing_sms;
+	while (list != NULL) {
+		send_sms = (struct ril_request_send_sms_info *) list->data;
+		if (send_sms == NULL || !send_sms->inflight)
+			goto list_continue;
+
+		if ((uint32_t) send_sms->ref == ref)
+			return send_sms;
+
+list_continue:
+		list = list->next;
 	}
 
-	ril_data.tokens.outgoing_sms = t;
-	ril_request_send_sms_complete(t, pdu, pdu_size, smsc, smsc_size);
-	if (pdu != NULL && pdu_size > 0)
-		free(pdu);
-	if (smsc != NULL && smsc_size > 0)
-		free(smsc);
+	return NULL;
 }
 
-void ril_request_send_sms_complete(RIL_Token t, unsigned char *pdu, size_t pdu_size, unsigned char *smsc, size_t smsc_size)
+/*
+ * Sends queued messages until the in-flight window is full.
+ */
+void ril_request_send_sms_next(void)
 {
-	tapiNettextInfo* mess;
-	char *message = NULL;
-	int pdu_type, pdu_tp_da_index, pdu_tp_da_len, pdu_tp_udl_index, pdu_tp_ud_len, pdu_tp_ud_index, send_msg_type;
+	struct ril_request_send_sms_info *send_sms;
+	int rc;
 
-	if (pdu == NULL || pdu_size <= 0 || smsc == NULL || smsc_size <= 0)
-		goto error;
+	while (ril_data.sms_stats.inflight < (unsigned int) ril_data.sms_send_window) {
+		send_sms = ril_request_send_sms_info_find();
+		if (send_sms == NULL)
+			return;
 
-	if ((pdu_size / 2 + smsc_size) > 0xfe) {
-		ALOGE("PDU or SMSC too large, aborting");
-		goto error;
+		ril_data.sms_ref = (ril_data.sms_ref + 1) & 0xff;
+		if (ril_data.sms_ref == 0)
+			ril_data.sms_ref++;
+
+		send_sms->ref = ril_data.sms_ref;
+		send_sms->inflight = 1;
+		gettimeofday(&send_sms->time, NULL);
+
+		ril_data.sms_stats.inflight++;
+		if (ril_data.sms_stats.inflight > ril_data.sms_stats.inflight_max)
+			ril_data.sms_stats.inflight_max = ril_data.sms_stats.inflight;
+
+		rc = ril_request_send_sms_complete(send_sms);
+		if (rc < 0) {
+			ril_sms_complete(send_sms, RIL_E_SMS_SEND_FAIL_RETRY, NULL, 0);
+			ril_sms_stats_update(send_sms, 0);
+			ril_request_send_sms_unregister(send_sms);
+			continue;
+		}
 	}
+}
 
-	/* PDU parsing */
-	pdu_type = pdu[0];
-	ALOGD("%s: PDU Type is 0x%x", __func__, pdu_type);
+int ril_request_send_sms_complete(struct ril_request_send_sms_info *send_sms)
+{
+	tapiNettextInfo mess;
+	int rc;
 
-	pdu_tp_da_index = 2;
-	pdu_tp_da_len = pdu[pdu_tp_da_index];
-	ALOGD("%s: PDU TP-DA Len is 0x%x", __func__, pdu_tp_da_len);
+	if (send_sms == NULL)
+		return -1;
+
+	rc = sms_submit_encode(&send_sms->submit, &mess);
+	if (rc < 0)
+		return -1;
 
-	pdu_tp_udl_index = pdu_tp_da_index + pdu_tp_da_len / 2 + 4;
-	if (pdu_tp_da_len % 2 > 0)
-		pdu_tp_udl_index += 1;
-	pdu_tp_ud_len = pdu[pdu_tp_udl_index];
-	ALOGD("%s: PDU TP-UD Len is 0x%x", __func__, pdu_tp_ud_len);
+	if (mess.nUDH)
+		ALOGD("%s: Sending message %d on %d", __func__,
+			send_sms->submit.concat_seq, send_sms->submit.concat_count);
 
-	pdu_tp_ud_index = pdu_tp_udl_index + 1;
+	mess.hNetTextInfo = send_sms->ref;
 
-	if (pdu_type == 0x41 || pdu_type == 0x61) {
-		ALOGD("%s: We are sending a multi-part message!",  __func__);
-		ALOGD("%s: We are sending message %d on %d", __func__, pdu[pdu_tp_ud_index + 5], pdu[pdu_tp_ud_index + 4]);
-		send_msg_type = 1; //multi-part
+	// Keep the link up while more messages are waiting
+	tapi_nettext_set_net_burst(ril_request_send_sms_info_find() != NULL);
+	tapi_nettext_send((uint8_t *) &mess);
+
+	return 0;
+}
+
+void ril_request_send_sms(RIL_Token t, void *data, size_t size)
+{
+	struct ril_request_send_sms_info *send_sms;
+	struct sms_submit submit;
+	char **values = NULL;
+	int rc;
+
+	if (data == NULL || size < 2 * sizeof(char *))
+		goto error;
+
+	values = (char **) data;
+	if (values[1] == NULL)
+		goto error;
+
+	ALOGD("%s: PDU: %s", __func__, values[1]);
+
+	rc = sms_submit_decode(&submit, values[1], values[0] != NULL ? values[0] : ril_data.smsc_number);
+	if (rc < 0) {
+		ALOGE("%s: Unable to decode the PDU", __func__);
+		goto error;
 	}
-	else
-		send_msg_type = 0;
 
-	/* Convert PDU to tapiNettextInfo structure */
+	rc = ril_request_send_sms_register(&submit, t, &send_sms);
+	if (rc < 0) {
+		ALOGE("%s: Unable to add the request to the list", __func__);
+		goto error;
+	}
 
-	mess = (tapiNettextInfo *)calloc(1, sizeof(*mess));
+	ril_sms_outbox_add(send_sms);
 
-	mess->NPI_ToNumber = 0x01;
+	ril_request_send_sms_next();
 
-	if (pdu[pdu_tp_da_index + 1] == 0x91)
-		mess->TON_ToNumber= 0x01;
+	return;
 
-	mess->lengthToNumber = pdu_tp_da_len;
+error:
+	ril_request_complete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
+}
 
-	if (pdu_tp_da_len % 2 > 0)
-		pdu_tp_da_len = pdu_tp_da_len + 1;
+/*
+ * Outgoing SMS PDU decoder: reads the hex SMSC and SMS-SUBMIT PDU from the
+ * framework straight into a struct sms_submit, in a single pass.
+ */
 
-	bcd2ascii(mess->szToNumber, pdu + pdu_tp_da_index + 2, pdu_tp_da_len / 2);
+struct sms_pdu_reader {
+	const char *p;
+	int error;
+};
 
-	mess->scTime = time(NULL);
+static uint8_t sms_pdu_get_byte(struct sms_pdu_reader *r)
+{
+	int byte;
 
-	mess->NPI_SMSC = 0x01;
+	if (r->error)
+		return 0;
 
-	if (smsc[1] == 0x91)
-		mess->TON_SMSC = 0x01;
+	byte = hex_byte(r->p);
+	if (byte < 0) {
+		r->error = 1;
+		return 0;
+	}
 
-	mess->lengthSMSC = (smsc[0] - 1) * 2;
+	r->p += 2;
 
-	bcd2ascii(mess->SMSC, smsc + 2, smsc[0] - 1);
+	return byte;
+}
 
-	if (pdu_type == 0x21 || pdu_type == 0x61)
-		mess->bSRR = 0x01;
+static void sms_pdu_get_data(struct sms_pdu_reader *r, uint8_t *data, size_t size)
+{
+	size_t i;
 
-	mess->validityValue = 0xFF;
-	mess->classType = 0x04;
+	for (i = 0; i < size; i++)
+		data[i] = sms_pdu_get_byte(r);
+}
 
-	if (send_msg_type == 1) {
-		mess->nUDH = 0x01; //multipart SMS
-		mess->bUDHI = 0x01;
-		mess->messageLength = pdu_tp_ud_len - 1;
+static int sms_dcs_alphabet(uint8_t dcs)
+{
+	switch (dcs & 0xf0) {
+		case 0xc0:
+		case 0xd0:
+			return SMS_ALPHABET_GSM7;
+		case 0xe0:
+			return SMS_ALPHABET_UCS2;
+		case 0xf0:
+			return (dcs & 0x04) ? SMS_ALPHABET_8BIT : SMS_ALPHABET_GSM7;
 	}
-	else
-		mess->messageLength = pdu_tp_ud_len;
 
-	if (pdu[pdu_tp_udl_index - 1] == 8) {
-		DEBUG_I("%s : DCS - Unicode", __func__);
-		mess->alphabetType = 0x03; //Unicode
-		if (send_msg_type == 0)
-			memcpy(mess->messageBody, pdu + pdu_tp_ud_index, pdu_tp_ud_len);
-		else
-			memcpy(mess->messageBody, pdu + pdu_tp_ud_index + 1, pdu_tp_ud_len - 1);
-	} else {
-		DEBUG_I("%s : DCS - GSM7", __func__);
-		mess->alphabetType = 0x00; //GSM7
-		gsm72ascii(pdu + pdu_tp_ud_index, &message, pdu_size - pdu_tp_ud_index);
-		if (send_msg_type == 0)	{
-			memcpy(mess->messageBody, message, pdu_tp_ud_len);
-		} else {
-			mess->messageLength = mess->messageLength - 1;
-			memcpy(mess->messageBody, pdu + pdu_tp_ud_index + 1, 5);
-			memcpy(mess->messageBody + 5, message + 7, pdu_tp_ud_len - 7);
+	// General data coding and automatic deletion groups
+	if ((dcs & 0x80) == 0) {
+		switch ((dcs >> 2) & 0x03) {
+			case 1:
+				return SMS_ALPHABET_8BIT;
+			case 2:
+				return SMS_ALPHABET_UCS2;
 		}
 	}
 
-	tapi_nettext_set_net_burst(0);
-	tapi_nettext_send((uint8_t *)mess);
+	return SMS_ALPHABET_GSM7;
+}
 
-	if (mess != NULL)
-		free(mess);
-	if (message != NULL)
-		free(message);
+/*
+ * Picks the concatenation element out of the user data header, either
+ * with an 8 or 16 bit reference. Other elements cannot be passed to the
+ * modem and are dropped.
+ */
+static void sms_submit_udh_parse(struct sms_submit *submit, const uint8_t *udh, size_t length)
+{
+	size_t i;
+	uint8_t iei, iel;
 
-	return;
+	i = 0;
+	while (i + 2 <= length) {
+		iei = udh[i];
+		iel = udh[i + 1];
+		i += 2;
 
-error:
-	ril_request_complete(t, RIL_E_SMS_SEND_FAIL_RETRY, NULL, 0);
-	if (pdu != NULL && pdu_size > 0)
-		free(pdu);
-	if (smsc != NULL && smsc_size > 0)
-		free(smsc);
-	// Send the next SMS in the list
-	ril_request_send_sms_next();
+		if (i + iel > length)
+			break;
+
+		if (iei == 0x00 && iel == 3) {
+			submit->concat = 1;
+			submit->concat_ref = udh[i];
+			submit->concat_count = udh[i + 1];
+			submit->concat_seq = udh[i + 2];
+		} else if (iei == 0x08 && iel == 4) {
+			submit->concat = 1;
+			submit->concat_ref = udh[i + 1];
+			submit->concat_count = udh[i + 2];
+			submit->concat_seq = udh[i + 3];
+		} else {
+			ALOGD("%s: Dropping UDH element 0x%x", __func__, iei);
+		}
+
+		i += iel;
+	}
 }
 
-void ril_request_send_sms(RIL_Token t, void *data, size_t size)
+int sms_submit_decode(struct sms_submit *submit, const char *pdu, const char *smsc)
 {
-	char **values = NULL;
-	unsigned char *smsc = NULL;
-	unsigned char *pdu = NULL;
-	size_t pdu_size;
-	size_t smsc_size;
-	int rc;
+	struct sms_pdu_reader r;
+	size_t udh_length;
+	size_t size;
 
-	if (data == NULL || size < 2 * sizeof(char *))
+	if (submit == NULL || pdu == NULL || smsc == NULL)
+		return -1;
+
+	memset(submit, 0, sizeof(struct sms_submit));
+
+	// SMSC address: length of the type and digits octets
+	r.p = smsc;
+	r.error = 0;
+
+	size = sms_pdu_get_byte(&r);
+	if (r.error || size < 1 || size > sizeof(submit->smsc) + 1)
 		goto error;
 
-	values = (char **) data;
-	if (values[1] == NULL)
+	submit->smsc_type = sms_pdu_get_byte(&r);
+	submit->smsc_length = size - 1;
+	sms_pdu_get_data(&r, submit->smsc, submit->smsc_length);
+	if (r.error)
 		goto error;
 
-	ALOGD("%s: PDU: %s", __func__, values[1]);
+	r.p = pdu;
 
-	pdu_size = string2data_size(values[1]);
-	if (pdu_size == 0)
+	submit->type = sms_pdu_get_byte(&r);
+	if ((submit->type & 0x03) != 0x01) {
+		ALOGE("%s: Not a SMS-SUBMIT PDU: 0x%x", __func__, submit->type);
 		goto error;
+	}
+
+	// TP-MR is ours to set
+	sms_pdu_get_byte(&r);
 
-	pdu = string2data(values[1]);
-	if (pdu == NULL)
+	submit->da_length = sms_pdu_get_byte(&r);
+	if (submit->da_length > sizeof(submit->da) * 2)
 		goto error;
 
-	if (values[0] != NULL) {
-		smsc = string2data(values[0]);
-		if (smsc == NULL)
-			goto error;
+	submit->da_type = sms_pdu_get_byte(&r);
+	sms_pdu_get_data(&r, submit->da, (submit->da_length + 1) / 2);
+
+	submit->pid = sms_pdu_get_byte(&r);
+	submit->dcs = sms_pdu_get_byte(&r);
+	submit->alphabet = sms_dcs_alphabet(submit->dcs);
+
+	submit->vp_format = (submit->type >> 3) & 0x03;
+	switch (submit->vp_format) {
+		case 0x02:
+			submit->vp = sms_pdu_get_byte(&r);
+			break;
+		case 0x01:
+		case 0x03:
+			// Enhanced and absolute formats are not passed on
+			sms_pdu_get_data(&r, submit->ud, 7);
+			break;
+	}
+
+	submit->udl = sms_pdu_get_byte(&r);
+	if (r.error)
+		goto error;
 
-		smsc_size = string2data_size(values[0]);
-		if (smsc_size == 0)
+	if (submit->alphabet == SMS_ALPHABET_GSM7) {
+		if (submit->udl > 160)
 			goto error;
+		size = GSM7_PACKED_SIZE(submit->udl);
 	} else {
-		smsc = string2data(ril_data.smsc_number);
-		if (smsc == NULL)
+		if (submit->udl > sizeof(submit->ud))
 			goto error;
+		size = submit->udl;
+	}
 
-		smsc_size = string2data_size(ril_data.smsc_number);
-		if (smsc_size == 0)
-			goto error;
+	submit->ud_size = size;
+	sms_pdu_get_data(&r, submit->ud, size);
+	if (r.error) {
+		ALOGE("%s: PDU is shorter than its TP-UDL", __func__);
+		goto error;
 	}
 
-	if (ril_data.tokens.outgoing_sms != RIL_TOKEN_NULL) {
-		ALOGD("%s: Another outgoing SMS is being processed, adding to the list", __func__);
-		rc = ril_request_send_sms_register(pdu, pdu_size, smsc, smsc_size, t);
-		if (rc < 0) {
-			ALOGE("%s: Unable to add the request to the list", __func__);
+	if (submit->type & 0x40) {
+		if (size < 1)
 			goto error;
-		}
-		return;
-	}
 
-	ril_data.tokens.outgoing_sms = t;
-	ril_request_send_sms_complete(t, pdu, pdu_size, smsc, smsc_size);
-	if (pdu != NULL && pdu_size > 0)
-		free(pdu);
-	if (smsc != NULL && smsc_size > 0)
-		free(smsc);
+		udh_length = submit->ud[0];
+		if (udh_length + 1 > size)
+			goto error;
 
-	return;
+		sms_submit_udh_parse(submit, submit->ud + 1, udh_length);
 
-error:
-	ril_request_complete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
+		if (submit->alphabet == SMS_ALPHABET_GSM7)
+			submit->ud_offset = ((udh_length + 1) * 8 + 6) / 7;
+		else
+			submit->ud_offset = udh_length + 1;
 
-	if (pdu != NULL && pdu_size > 0)
-		free(pdu);
-	if (smsc != NULL && smsc_size > 0)
-		free(smsc);
+		if (submit->ud_offset > submit->udl)
+			goto error;
+	}
 
-	// Send the next SMS in the list
-	ril_request_send_sms_next();
+	return 0;
+
+error:
+	return -1;
 }
 
-void ipc_incoming_sms(void* data)
+/*
+ * Fills a modem message from a decoded SMS-SUBMIT. Concatenated messages
+ * carry their header in the first 5 bytes of the body, with an 8 bit
+ * reference.
+ */
+int sms_submit_encode(struct sms_submit *submit, tapiNettextInfo *info)
 {
-	tapiNettextInfo* nettextInfo = (tapiNettextInfo*)(data);
-	char *number_smsc, *number_oa, *number, *a, *b;
-	char *tp_pid, *tp_ud, *message;
-	char tp_scts[15], tp_dcs[3], tp_udl[3];
-	char pdu[400], buf[50], c[3];
-	char *message_tmp, *number_tmp;
-	unsigned int i , len, message_length, dcs;
-	time_t l_time;
-
-	number_smsc = a = b = number = number_oa = tp_pid =
-	tp_ud = message = message_tmp = number_tmp = NULL;
-
-	memset(tp_scts, 0, sizeof(tp_scts));
-	memset(tp_dcs, 0, sizeof(tp_dcs));
-	memset(tp_udl, 0, sizeof(tp_udl));
-	memset(pdu, 0, sizeof(pdu));
-	memset(c, 0, sizeof(c));
-
-	/* Convert sms packet to SMS-DELIVER PDU type  format
-	SMS = SCA + TPDU */
-
-	//SCA
-	//Convert nettextInfo->serviceCenter to SCA
-
-	number_smsc = nettextInfo->SMSC;
-	if ((strlen(number_smsc) % 2) > 0)
-		strcat(number_smsc, "F");
-
-	if (strlen(number_smsc) > 0)
-	{
-		len =  (strlen(number_smsc) / 2 ) + 1;
-		sprintf(c, "%02x", len);
-		strcat(pdu, c);
-		strcat(pdu, "91");
-
-		i = 0;
-		while (i < strlen(number_smsc)) {
-			a = &(number_smsc[i+1]);
-			strncat(pdu, a, 1);
-			b = &(number_smsc[i]);
-			strncat(pdu, b, 1);
-			i = i + 2;
-		}
+	uint8_t *body;
+	size_t length;
+	size_t size;
+
+	if (submit == NULL || info == NULL)
+		return -1;
+
+	memset(info, 0, sizeof(tapiNettextInfo));
+
+	info->NPI_ToNumber = submit->da_type & 0x0f;
+	info->TON_ToNumber = (submit->da_type >> 4) & 0x07;
+	info->lengthToNumber = submit->da_length;
+	bcd2ascii(info->szToNumber, submit->da, (submit->da_length + 1) / 2);
+
+	info->scTime = time(NULL);
+
+	info->NPI_SMSC = submit->smsc_type & 0x0f;
+	info->TON_SMSC = (submit->smsc_type >> 4) & 0x07;
+	info->lengthSMSC = submit->smsc_length * 2;
+	bcd2ascii(info->SMSC, submit->smsc, submit->smsc_length);
+
+	if (submit->type & 0x20)
+		info->bSRR = 0x01;
+
+	info->validityValue = submit->vp_format == 0x02 ? submit->vp : 0xFF;
+	info->classType = 0x04;
+
+	body = info->messageBody;
+	size = sizeof(info->messageBody);
+
+	if (submit->concat) {
+		info->nUDH = 0x01;
+		info->bUDHI = 0x01;
+
+		body[0] = 0x00;
+		body[1] = 0x03;
+		body[2] = submit->concat_ref;
+		body[3] = submit->concat_count;
+		body[4] = submit->concat_seq;
+		body += 5;
+		size -= 5;
+	} else if (submit->type & 0x40) {
+		ALOGD("%s: Sending without the UDH", __func__);
 	}
-	else
-		strcat(pdu, "00");
 
-	DEBUG_I("%s : sca = %s", __func__, pdu);
+	length = submit->udl - submit->ud_offset;
+	if (length > size)
+		length = size;
 
-	//TPDU
+	switch (submit->alphabet) {
+		case SMS_ALPHABET_GSM7:
+			DEBUG_I("%s : DCS - GSM7", __func__);
+			info->alphabetType = 0x00;
+			gsm7_unpack(submit->ud, submit->ud_size, submit->ud_offset, body, length);
+			break;
+		case SMS_ALPHABET_UCS2:
+			DEBUG_I("%s : DCS - Unicode", __func__);
+			info->alphabetType = 0x03;
+			memcpy(body, submit->ud + submit->ud_offset, length);
+			break;
+		case SMS_ALPHABET_8BIT:
+			DEBUG_I("%s : DCS - 8 bit", __func__);
+			memcpy(body, submit->ud + submit->ud_offset, length);
+			break;
+	}
 
-	/* Protocol Data Unit Type (PDU Type) */
+	info->messageLength = (body - info->messageBody) + length;
 
-	if (nettextInfo->dischargeTime == 0x00)
-		if (nettextInfo->nUDH == 1 || nettextInfo->msgType == 0x10)
-			strcat(pdu, "44");
-		else
-			strcat(pdu, "04");
-	else
-		strcat(pdu, "0600");
+	return 0;
+}
+
+/*
+ * Incoming SMS PDU builder: writes the hex SMS-DELIVER (or SMS-STATUS-REPORT)
+ * PDU for a modem message straight into the caller buffer, in a single pass.
+ */
 
-	/* TP-OA: TP- Originating-Address
-		Convert nettextInfo->phoneNumber to TP-OA */
+struct sms_pdu_writer {
+	char *p;
+	char *end;
+	int overflow;
+};
 
-	number_oa = nettextInfo->szFromNumber;
+static void sms_pdu_put_data(struct sms_pdu_writer *w, const unsigned char *data, size_t size)
+{
+	int rc;
 
-	if (nettextInfo->TON_FromNumber == 5 ) {
-		len = ascii2gsm7(number_oa, (unsigned char **)&number_tmp, strlen(number_oa));
-		number = data2string((unsigned char *)number_tmp, len);
+	// The NUL lands on w->end at most, which is kept for it
+	rc = hex_encode_upper(data, size, w->p, w->end - w->p + 1);
+	if (rc < 0) {
+		w->overflow = 1;
+		return;
+	}
 
-		len = (strlen(number_oa) * 7 * 2) / 8;
-		len += (strlen(number_oa) * 7 * 2) % 8 > 0 ? 1 : 0;
+	w->p += rc;
+}
 
-		sprintf(c, "%02x", len);
-		strcat(pdu, c);
-		strcat(pdu, "D0");
-		strcat(pdu, number);
-	} else {
-		len = strlen(number_oa);
+static void sms_pdu_put_byte(struct sms_pdu_writer *w, unsigned char byte)
+{
+	sms_pdu_put_data(w, &byte, 1);
+}
 
-		if ((len % 2) > 0)
-			strcat(number_oa, "F");
+/*
+ * Copies the digits of an address of up to size characters, without the
+ * '+' that belongs to the type of number and without the characters that
+ * have no semi-octet. Returns the number of digits.
+ */
+static size_t sms_pdu_address_digits(const char *address, size_t size, char *digits)
+{
+	unsigned char bcd;
+	size_t length = 0;
+	size_t i;
 
-		sprintf(c, "%02x", len);
-		strcat(pdu, c);
-		if (nettextInfo->TON_FromNumber == 1 )
-			strcat(pdu, "91");
-		else
-			strcat(pdu, "81");
-
-		i = 0;
-		while (i < len) {
-			a = &(number_oa[i+1]);
-			strncat(pdu, a, 1);
-			b = &(number_oa[i]);
-			strncat(pdu, b, 1);
-			i = i + 2;
+	for (i = 0; i < size && address[i] != '\0'; i++) {
+		if (address[i] == '+')
+			continue;
+
+		if (ascii2bcd(&bcd, address + i, 1, 1) < 0) {
+			ALOGE("%s: Dropping '%c' from the address", __func__, address[i]);
+			continue;
 		}
-	}
 
-	DEBUG_I("%s : sca + pdu_type + tp_oa = %s", __func__, pdu);
+		digits[length++] = address[i];
+	}
 
-	if (number != NULL)
-		 free (number);
+	return length;
+}
 
-	/* TP-PID : TP-Protocol-Identifier */
+/*
+ * Writes digits as swapped semi-octets, padded with F.
+ */
+static void sms_pdu_put_semi_octets(struct sms_pdu_writer *w, const char *digits, size_t length)
+{
+	unsigned char bcd[32];
+	int rc;
 
-	if (nettextInfo->dischargeTime == 0x00) {
-		tp_pid = "00";
-		strcat (pdu, tp_pid);
+	rc = ascii2bcd(bcd, digits, length, sizeof(bcd));
+	if (rc < 0) {
+		w->overflow = 1;
+		return;
 	}
 
-	/* TP-SCTS: TP-Service-Centre-Time-Stamp
-		Convert nettextInfo->timestamp and nettextInfo->time_zone to TP-SCTS */
+	sms_pdu_put_data(w, bcd, rc);
+}
 
-	l_time = nettextInfo->scTime;
+/*
+ * Packs count septets after offset septets taken by a user data header,
+ * already written: output starts at the octet holding the first septet,
+ * its fill bits cleared.
+ */
+static void sms_pdu_put_septets(struct sms_pdu_writer *w, const unsigned char *septets, size_t count, size_t offset)
+{
+	uint8_t packed[GSM7_PACKED_SIZE(RIL_SMS_SEPTETS_MAX)];
+	size_t start = offset * 7 / 8;
+	size_t length;
 
-	strftime(buf, sizeof(buf), "%y%m%d%H%M%S", gmtime(&l_time));
-	sprintf(c, "%02d", nettextInfo->time_zone);
-	strcat(buf, c);
+	if (count == 0 && offset == 0)
+		return;
 
-	i = 0;
-	while (i < 14) {
-		a = &(buf[i+1]);
-		strncat(tp_scts, a, 1);
-		b = &(buf[i]);
-		strncat(tp_scts, b, 1);
-		i = i + 2;
+	memset(packed, 0, sizeof(packed));
+
+	length = gsm7_pack(septets, count, offset, packed, sizeof(packed));
+	if (length <= start) {
+		w->overflow = 1;
+		return;
 	}
 
-	DEBUG_I("%s : scTime = %s", __func__, tp_scts);
+	sms_pdu_put_data(w, packed + start, length - start);
+}
 
-	if (nettextInfo->dischargeTime != 0x00) {
-		strcat(pdu, tp_scts);
+static void sms_pdu_put_timestamp(struct sms_pdu_writer *w, uint32_t timestamp, uint32_t time_zone)
+{
+	char digits[15];
+	time_t t = timestamp;
 
-		memset(tp_scts, 0, 15);
+	strftime(digits, sizeof(digits), "%y%m%d%H%M%S", gmtime(&t));
+	digits[12] = '0' + (time_zone / 10) % 10;
+	digits[13] = '0' + time_zone % 10;
 
-		l_time = nettextInfo->dischargeTime;
-		strftime(buf, sizeof(buf), "%y%m%d%H%M%S", gmtime(&l_time));
-		sprintf(c, "%02d", nettextInfo->time_zone);
-		strcat(buf, c);
+	sms_pdu_put_semi_octets(w, digits, 14);
+}
 
-		i = 0;
-		while (i < 14) {
-			a = &(buf[i+1]);
-			strncat(tp_scts, a, 1);
-			b = &(buf[i]);
-			strncat(tp_scts, b, 1);
-			i = i + 2;
-		}
+/*
+ * Returns the PDU hex string length, or -1 when the message is invalid
+ * or does not fit in size bytes, including the terminating NUL.
+ */
+int sms_deliver_pdu_build(tapiNettextInfo *info, char *pdu, size_t size)
+{
+	struct sms_pdu_writer w;
+	char digits[sizeof(info->SMSC)];
+	size_t length;
+	size_t body_length;
+	int dcs;
 
-		DEBUG_I("%s : dischargeTime = %s", __func__, tp_scts);
+	if (info == NULL || pdu == NULL || size == 0)
+		return -1;
 
-		strcat (pdu, tp_scts);
+	w.p = pdu;
+	w.end = pdu + size - 1;
+	w.overflow = 0;
 
-		if (nettextInfo->statusReport == 0)
-			strcat (pdu, "00");
-		else
-			strcat (pdu, "01");
+	// SCA
+	length = sms_pdu_address_digits(info->SMSC, sizeof(info->SMSC), digits);
+	if (length > 0) {
+		sms_pdu_put_byte(&w, (length + 1) / 2 + 1);
+		sms_pdu_put_byte(&w, 0x91);
+		sms_pdu_put_semi_octets(&w, digits, length);
+	} else {
+		sms_pdu_put_byte(&w, 0x00);
+	}
 
-		DEBUG_I("%s : pdu = %s", __func__, pdu);
+	// PDU type
+	if (info->dischargeTime != 0x00) {
+		sms_pdu_put_byte(&w, 0x06);
+		sms_pdu_put_byte(&w, 0x00);
+	} else if (info->nUDH == 1 || info->msgType == 0x10) {
+		sms_pdu_put_byte(&w, 0x44);
+	} else {
+		sms_pdu_put_byte(&w, 0x04);
+	}
 
-		ril_request_unsolicited(RIL_UNSOL_RESPONSE_NEW_SMS_STATUS_REPORT, pdu, strlen(pdu));
-		return;
+	// TP-OA
+	if (info->TON_FromNumber == 5) {
+		length = strnlen(info->szFromNumber, sizeof(info->szFromNumber));
+		sms_pdu_put_byte(&w, (length * 7 + 3) / 4);
+		sms_pdu_put_byte(&w, 0xD0);
+		sms_pdu_put_septets(&w, (unsigned char *) info->szFromNumber, length, 0);
+	} else {
+		length = sms_pdu_address_digits(info->szFromNumber, sizeof(info->szFromNumber), digits);
+		sms_pdu_put_byte(&w, length);
+		sms_pdu_put_byte(&w, info->TON_FromNumber == 1 ? 0x91 : 0x81);
+		sms_pdu_put_semi_octets(&w, digits, length);
 	}
 
-	/* TP-UD: TP-User Data
-		Convert nettextInfo->messageBody to TP-UD */
+	if (info->dischargeTime != 0x00) {
+		// TP-SCTS, TP-DT and TP-ST
+		sms_pdu_put_timestamp(&w, info->scTime, info->time_zone);
+		sms_pdu_put_timestamp(&w, info->dischargeTime, info->time_zone);
+		sms_pdu_put_byte(&w, info->statusReport == 0 ? 0x00 : 0x01);
+		goto done;
+	}
 
-	message_length = nettextInfo->messageLength;
+	// TP-PID
+	sms_pdu_put_byte(&w, 0x00);
 
-	if (nettextInfo->alphabetType == 3 || nettextInfo->msgType == 0x10) {
-		/*TP-DCS: TP-Data-Coding-Scheme */
-		if (nettextInfo->msgType == 0x10) {
-			DEBUG_I("%s : TP-DCS = ASCII (MMS receiving)", __func__);
-			dcs = 0x04;
+	body_length = info->messageLength;
+	if (body_length > sizeof(info->messageBody))
+		return -1;
+
+	if (info->alphabetType == 3 || info->msgType == 0x10) {
+		dcs = info->msgType == 0x10 ? 0x04 : 0x08;
+		if (info->bFlash == 1 && info->classType == 0)
+			dcs += 0x10;
+
+		sms_pdu_put_byte(&w, dcs);
+		sms_pdu_put_timestamp(&w, info->scTime, info->time_zone);
+
+		if (info->nUDH == 1) {
+			sms_pdu_put_byte(&w, body_length + 1);
+			sms_pdu_put_byte(&w, 0x05);
 		} else {
-			DEBUG_I("%s : TP-DCS = Unicode", __func__);
-			dcs = 0x08;
-		}
-		message = data2string((char *)nettextInfo->messageBody,message_length);
-		tp_ud = calloc(message_length * 2 + 3, sizeof(*message));
-		if (nettextInfo->nUDH == 1) {
-			strcat(tp_ud, "05");
-			message_length += 1;
-			strcat(tp_ud, message);
+			sms_pdu_put_byte(&w, body_length);
 		}
-		else
-			strcat(tp_ud, message);
+
+		sms_pdu_put_data(&w, info->messageBody, body_length);
 	} else {
-		/*TP-DCS: TP-Data-Coding-Scheme */
-		dcs = 0x00; //gsm7
-		DEBUG_I("%s : TP-DCS = GSM7", __func__);
-
-		if (nettextInfo->nUDH == 1) {
-			message = calloc(message_length + 3, sizeof(*tp_ud));
-			message_length += 2;
-			strcat(message, "0000000");
-			strncat(message, (char *)(nettextInfo->messageBody + 5), message_length);
-			len = ascii2gsm7(message, (unsigned char **)&message_tmp, message_length);
-			message_tmp[0] = 0x05;
-			i = 0;
-			while (i < 5) {
-				message_tmp[i + 1] = nettextInfo->messageBody[i];
-				i++;
-			}
-			tp_ud = data2string((unsigned char *)message_tmp, len);
+		dcs = 0x00;
+		if (info->bFlash == 1 && info->classType == 0)
+			dcs += 0x10;
+
+		sms_pdu_put_byte(&w, dcs);
+		sms_pdu_put_timestamp(&w, info->scTime, info->time_zone);
+
+		if (info->nUDH == 1) {
+			if (body_length < 5)
+				return -1;
+
+			// 6 UDH octets take 7 septets, the text starts after a fill bit
+			sms_pdu_put_byte(&w, body_length + 2);
+			sms_pdu_put_byte(&w, 0x05);
+			sms_pdu_put_data(&w, info->messageBody, 5);
+			sms_pdu_put_septets(&w, info->messageBody + 5, body_length - 5, 7);
 		} else {
-			len = ascii2gsm7((char *)nettextInfo->messageBody, (unsigned char **)&message_tmp, message_length);
-			tp_ud = data2string((unsigned char *)message_tmp, len);
+			sms_pdu_put_byte(&w, body_length);
+			sms_pdu_put_septets(&w, info->messageBody, body_length, 0);
 		}
 	}
 
-	DEBUG_I("%s : tp_ud = %s", __func__, tp_ud);
+done:
+	if (w.overflow)
+		return -1;
 
-	if (nettextInfo->bFlash == 1 && nettextInfo->classType == 0)
-		dcs += 0x10;
+	*w.p = '\0';
 
-	sprintf(tp_dcs, "%02x", dcs);
+	return w.p - pdu;
+}
 
-	/* TP-UDL:TP-User-Data-Length */
-	sprintf(tp_udl, "%02x", message_length);
-	DEBUG_I("%s : tp_udl = %s", __func__, tp_udl);
+/*
+ * Incoming concatenated SMS reassembly: when enabled, parts are kept in
+ * ril_data.sms_concat, keyed by originator and reference, and delivered
+ * together in order. The modem acknowledges parts on its own, so holding
+ * them back does not delay the network.
+ */
 
-	strcat (pdu, tp_dcs);
-	strcat (pdu, tp_scts);
-	strcat (pdu, tp_udl);
-	strcat (pdu, tp_ud);
+static void ril_sms_concat_stats_log(void)
+{
+	struct ril_sms_concat_stats *stats = &ril_data.sms_concat_stats;
 
-	DEBUG_I("%s : pdu = %s", __func__, pdu);
+	ALOGD("%s: %u parts, %u reassembled, %u duplicates, %u timeouts, %u evictions, max %u bytes",
+		__func__, stats->parts, stats->reassembled, stats->duplicates,
+		stats->timeouts, stats->evictions, stats->size_max);
+}
+
+static void ril_sms_concat_flush(struct ril_sms_concat *concat)
+{
+	struct list_head *list;
+	int i;
+
+	if (concat == NULL)
+		return;
+
+	for (i = 0; i < concat->count; i++) {
+		if (concat->pdus[i] == NULL)
+			continue;
+
+		ril_request_unsolicited(RIL_UNSOL_RESPONSE_NEW_SMS, concat->pdus[i], strlen(concat->pdus[i]));
+		free(concat->pdus[i]);
+	}
+
+	ril_data.sms_concat_size -= concat->size;
+
+	list = ril_data.sms_concat;
+	while (list != NULL) {
+		if (list->data == (void *) concat) {
+			if (list == ril_data.sms_concat)
+				ril_data.sms_concat = list->next;
+
+			list_head_free(list);
+			break;
+		}
+		list = list->next;
+	}
+
+	memset(concat, 0, sizeof(struct ril_sms_concat));
+	free(concat);
+}
+
+static struct ril_sms_concat *ril_sms_concat_find(char *originator, uint8_t ref, uint8_t count)
+{
+	struct ril_sms_concat *concat;
+	struct list_head *list;
+
+	list = ril_data.sms_concat;
+	while (list != NULL) {
+		concat = (struct ril_sms_concat *) list->data;
+		if (concat == NULL)
+			goto list_continue;
+
+		if (concat->ref == ref && concat->count == count && strncmp(concat->originator, originator, sizeof(concat->originator) - 1) == 0)
+			return concat;
+
+list_continue:
+		list = list->next;
+	}
+
+	return NULL;
+}
+
+/*
+ * Delivers what was received of the oldest message, to make room.
+ */
+static void ril_sms_concat_evict(void)
+{
+	struct ril_sms_concat *concat;
+	struct list_head *list;
+
+	list = ril_data.sms_concat;
+	if (list == NULL)
+		return;
+
+	concat = (struct ril_sms_concat *) list->data;
+
+	ALOGD("%s: Evicting %d parts of %d from %s", __func__, concat->received, concat->count, concat->originator);
+	ril_data.sms_concat_stats.evictions++;
+	ril_sms_concat_flush(concat);
+}
+
+static void ril_sms_concat_timeout(void *data)
+{
+	struct ril_sms_concat *concat;
+	struct list_head *list;
+	struct timeval now;
+
+	RIL_LOCK();
 
-	ril_request_unsolicited(RIL_UNSOL_RESPONSE_NEW_SMS, pdu, strlen(pdu));
+	gettimeofday(&now, NULL);
 
-	if (message != NULL)
-		free (message);
+	list = ril_data.sms_concat;
+	while (list != NULL) {
+		concat = (struct ril_sms_concat *) list->data;
+		list = list->next;
+
+		if (concat == NULL || now.tv_sec - concat->time.tv_sec < RIL_SMS_CONCAT_TIMEOUT)
+			continue;
+
+		ALOGD("%s: Timed out with %d parts of %d from %s", __func__, concat->received, concat->count, concat->originator);
+		ril_data.sms_concat_stats.timeouts++;
+		ril_sms_concat_flush(concat);
+	}
+
+	ril_sms_concat_stats_log();
+
+	RIL_UNLOCK();
+}
+
+/*
+ * Returns 0 when the part was taken by the cache, -1 when it should be
+ * delivered right away.
+ */
+static int ril_sms_concat_add(tapiNettextInfo *info, char *pdu, int length)
+{
+	struct ril_sms_concat *concat;
+	struct list_head *list_end;
+	struct list_head *list;
+	struct timeval timeout;
+	uint8_t ref, count, seq;
+	unsigned int count_entries;
+
+	if (!ril_data.sms_concat_enabled || info->nUDH != 1)
+		return -1;
+
+	if (info->messageBody[0] != 0x00 || info->messageBody[1] != 0x03)
+		return -1;
+
+	ref = info->messageBody[2];
+	count = info->messageBody[3];
+	seq = info->messageBody[4];
+	if (count < 2 || seq < 1 || seq > count)
+		return -1;
+
+	ril_data.sms_concat_stats.parts++;
+
+	concat = ril_sms_concat_find(info->szFromNumber, ref, count);
+	if (concat == NULL) {
+		count_entries = 0;
+		for (list = ril_data.sms_concat; list != NULL; list = list->next)
+			count_entries++;
+
+		if (count_entries >= RIL_SMS_CONCAT_ENTRIES)
+			ril_sms_concat_evict();
+
+		concat = calloc(1, sizeof(struct ril_sms_concat));
+		if (concat == NULL)
+			return -1;
+
+		strncpy(concat->originator, info->szFromNumber, sizeof(info->szFromNumber));
+		concat->ref = ref;
+		concat->count = count;
+		gettimeofday(&concat->time, NULL);
+
+		list_end = ril_data.sms_concat;
+		while (list_end != NULL && list_end->next != NULL)
+			list_end = list_end->next;
+
+		list = list_head_alloc((void *) concat, list_end, NULL);
+		if (ril_data.sms_concat == NULL)
+			ril_data.sms_concat = list;
+
+		timeout.tv_sec = RIL_SMS_CONCAT_TIMEOUT;
+		timeout.tv_usec = 0;
+		ril_request_timed_callback(ril_sms_concat_timeout, NULL, &timeout);
+	}
+
+	if (concat->pdus[seq - 1] != NULL) {
+		ALOGD("%s: Dropping duplicate part %d of %d from %s", __func__, seq, count, concat->originator);
+		ril_data.sms_concat_stats.duplicates++;
+		return 0;
+	}
+
+	while (ril_data.sms_concat_size + length > RIL_SMS_CONCAT_SIZE && ril_data.sms_concat != NULL &&
+		ril_data.sms_concat->data != (void *) concat)
+		ril_sms_concat_evict();
+
+	concat->pdus[seq - 1] = strdup(pdu);
+	if (concat->pdus[seq - 1] == NULL)
+		return -1;
+
+	concat->received++;
+	concat->size += length;
+	ril_data.sms_concat_size += length;
+	if (ril_data.sms_concat_size > ril_data.sms_concat_stats.size_max)
+		ril_data.sms_concat_stats.size_max = ril_data.sms_concat_size;
+
+	if (concat->received == concat->count) {
+		ril_data.sms_concat_stats.reassembled++;
+		ril_sms_concat_flush(concat);
+		ril_sms_concat_stats_log();
+	}
+
+	return 0;
+}
+
+void ipc_incoming_sms(void* data)
+{
+	tapiNettextInfo* nettextInfo = (tapiNettextInfo*)(data);
+	char pdu[RIL_SMS_PDU_SIZE];
+	struct timeval start;
+	int length;
+
+	gettimeofday(&start, NULL);
+
+	length = sms_deliver_pdu_build(nettextInfo, pdu, sizeof(pdu));
+	if (length < 0) {
+		ALOGE("%s: Unable to build the PDU", __func__);
+		return;
+	}
+
+	DEBUG_I("%s : pdu = %s", __func__, pdu);
 
-	if (tp_ud != NULL)
-		free (tp_ud);
+	if (nettextInfo->dischargeTime != 0x00)
+		ril_request_unsolicited(RIL_UNSOL_RESPONSE_NEW_SMS_STATUS_REPORT, pdu, length);
+	else if (ril_sms_concat_add(nettextInfo, pdu, length) < 0)
+		ril_request_unsolicited(RIL_UNSOL_RESPONSE_NEW_SMS, pdu, length);
 
-	if (message_tmp != NULL)
-		free (message_tmp);
+	ril_sms_stats_received(&start);
 }
 
 void ril_request_send_sms_expect_more(RIL_Token t, void *data, size_t length)
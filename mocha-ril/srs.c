@@ -18,6 +18,7 @@
  *
  */
 
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -203,36 +204,86 @@ list_continue:
 	return -1;
 }
 
-int srs_client_send_message(struct srs_client_info *client, struct srs_message *message)
+struct srs_buffer *srs_buffer_new(unsigned short command, unsigned int seq, void *data, int length)
 {
+	struct srs_buffer *buffer;
 	struct srs_header header;
-	void *data;
+	struct srs_header_seq header_seq;
+	unsigned char *p;
+
+	if (length < 0 || (length > 0 && data == NULL))
+		return NULL;
+
+	memset(&header, 0, sizeof(header));
+	header.length = length + sizeof(header);
+	header.group = SRS_GROUP(command);
+	header.index = SRS_INDEX(command);
+
+	if (seq != 0) {
+		header.length += sizeof(header_seq);
+		header.group |= SRS_GROUP_SEQ;
+		header_seq.seq = seq;
+	}
+
+	if (header.length > SRS_DATA_MAX_SIZE)
+		return NULL;
+
+	buffer = calloc(1, sizeof(struct srs_buffer) + header.length);
+	if (buffer == NULL)
+		return NULL;
+
+	buffer->refcount = 1;
+	buffer->length = header.length;
+
+	p = buffer->data;
+	memcpy(p, &header, sizeof(header));
+	p += sizeof(header);
+
+	if (seq != 0) {
+		memcpy(p, &header_seq, sizeof(header_seq));
+		p += sizeof(header_seq);
+	}
+
+	if (length > 0)
+		memcpy(p, data, length);
+
+	return buffer;
+}
+
+struct srs_buffer *srs_buffer_ref(struct srs_buffer *buffer)
+{
+	if (buffer == NULL)
+		return NULL;
+
+	__sync_fetch_and_add(&buffer->refcount, 1);
 
+	return buffer;
+}
+
+void srs_buffer_unref(struct srs_buffer *buffer)
+{
+	if (buffer == NULL)
+		return;
+
+	if (__sync_sub_and_fetch(&buffer->refcount, 1) == 0)
+		free(buffer);
+}
+
+int srs_client_send_buffer(struct srs_client_info *client, struct srs_buffer *buffer)
+{
 	struct timeval timeout;
 	fd_set fds;
 	int rc;
 
-	if (client == NULL || message == NULL)
-		return -1;
-
-	memset(&header, 0, sizeof(header));
-	header.length = message->length + sizeof(header);
-	header.group = SRS_GROUP(message->command);
-	header.index = SRS_INDEX(message->command);
-
-	data = calloc(1, header.length);
-	if (data == NULL)
+	if (client == NULL || buffer == NULL)
 		return -1;
 
-	memcpy(data, &header, sizeof(header));
-	memcpy((void *) ((char *) data + sizeof(header)), message->data, message->length);
+	if (client->fd < 0)
+		return 0;
 
 	memset(&timeout, 0, sizeof(timeout));
 	timeout.tv_usec = 300;
 
-	if (client->fd < 0)
-		goto error;
-
 	FD_ZERO(&fds);
 	FD_SET(client->fd, &fds);
 
@@ -240,24 +291,38 @@ int srs_client_send_message(struct srs_client_info *client, struct srs_message *
 
 	if (!FD_ISSET(client->fd, &fds)) {
 		ALOGE("SRS write select failed on fd %d", client->fd);
-		goto error;
+		return 0;
 	}
 
-	rc = write(client->fd, data, header.length);
+	rc = write(client->fd, buffer->data, buffer->length);
 	if (rc < (int) sizeof(struct srs_header)) {
 		ALOGE("SRS write failed on fd %d with %d bytes", client->fd, rc);
-		goto error;
+		return 0;
 	}
 
-	free(data);
 	return rc;
+}
 
-error:
-	free(data);
-	return 0;
+int srs_client_send_message(struct srs_client_info *client, struct srs_message *message)
+{
+	struct srs_buffer *buffer;
+	int rc;
+
+	if (client == NULL || message == NULL)
+		return -1;
+
+	buffer = srs_buffer_new(message->command, message->seq, message->data, message->length);
+	if (buffer == NULL)
+		return -1;
+
+	rc = srs_client_send_buffer(client, buffer);
+
+	srs_buffer_unref(buffer);
+
+	return rc;
 }
 
-int srs_client_send(struct srs_client_data *client_data, struct srs_client_info *client, unsigned short command, void *data, int length)
+int srs_client_send(struct srs_client_data *client_data, struct srs_client_info *client, unsigned short command, unsigned int seq, void *data, int length)
 {
 	struct srs_message message;
 	int rc;
@@ -267,6 +332,7 @@ int srs_client_send(struct srs_client_data *client_data, struct srs_client_info
 
 	memset(&message, 0, sizeof(message));
 	message.command = command;
+	message.seq = seq;
 	message.data = data;
 	message.length = length;
 
@@ -285,9 +351,14 @@ int srs_client_send(struct srs_client_data *client_data, struct srs_client_info
 	return rc;
 }
 
+/*
+ * Sends the message to a single client. The first message sent to a client
+ * while one of its sequenced messages is dispatched answers it.
+ */
 int srs_send(struct srs_client_info *client, unsigned short command, void *data, int length)
 {
 	struct srs_client_data *client_data;
+	unsigned int seq;
 	int rc;
 
 	if (ril_data.srs_client == NULL || ril_data.srs_client->data == NULL || client == NULL)
@@ -302,65 +373,229 @@ int srs_send(struct srs_client_info *client, unsigned short command, void *data,
 		ALOGD("=======================");
 	} */
 
-	return srs_client_send(client_data, client, command, data, length);
+	seq = client->seq;
+	client->seq = 0;
+
+	return srs_client_send(client_data, client, command, seq, data, length);
 }
 
-int srs_client_recv(struct srs_client_info *client, struct srs_message *message)
+/*
+ * Sends the message with fd attached as SCM_RIGHTS ancillary data.
+ */
+int srs_send_fd(struct srs_client_info *client, unsigned short command, void *data, int length, int fd)
 {
-	struct srs_header *header;
-	void *data;
-
-	struct timeval timeout;
-	fd_set fds;
+	struct srs_client_data *client_data;
+	struct srs_buffer *buffer;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	char control[CMSG_SPACE(sizeof(int))];
 	int rc;
 
-	if (client == NULL || message == NULL)
+	if (ril_data.srs_client == NULL || ril_data.srs_client->data == NULL || client == NULL || fd < 0)
 		return -1;
 
-	data = calloc(1, SRS_DATA_MAX_SIZE);
-	if (data == NULL)
+	client_data = (struct srs_client_data *) ril_data.srs_client->data;
+
+	buffer = srs_buffer_new(command, client->seq, data, length);
+	if (buffer == NULL)
 		return -1;
 
-	memset(&timeout, 0, sizeof(timeout));
-	timeout.tv_usec = 300;
+	client->seq = 0;
 
-	if (client->fd < 0)
-		goto error;
+	memset(&iov, 0, sizeof(iov));
+	iov.iov_base = buffer->data;
+	iov.iov_len = buffer->length;
 
-	FD_ZERO(&fds);
-	FD_SET(client->fd, &fds);
+	memset(&msg, 0, sizeof(msg));
+	memset(control, 0, sizeof(control));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
 
-	rc = select(client->fd + 1, &fds, NULL, NULL, &timeout);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
 
-	if (!FD_ISSET(client->fd, &fds)) {
-		ALOGE("SRS read select failed on fd %d", client->fd);
-		goto error;
+	ALOGD("SEND SRS: fd=%d command=%d length=%d with fd %d", client->fd, command, length, fd);
+
+	RIL_CLIENT_LOCK(client_data->client);
+	rc = sendmsg(client->fd, &msg, 0);
+	RIL_CLIENT_UNLOCK(client_data->client);
+
+	if (rc < buffer->length)
+		ALOGE("SRS sendmsg failed on fd %d with %d bytes", client->fd, rc);
+
+	srs_buffer_unref(buffer);
+
+	return rc;
+}
+
+/*
+ * Sends the message to every client subscribed to the topic, encoding it
+ * only once. Clients that fail are shut down and left to the read loop to
+ * unregister. Returns the number of clients the message was sent to.
+ */
+int srs_publish(unsigned int topic, unsigned short command, void *data, int length)
+{
+	struct srs_client_data *client_data;
+	struct srs_client_info *client;
+	struct srs_buffer *buffer;
+	struct list_head *list;
+	int count;
+	int rc;
+
+	if (ril_data.srs_client == NULL || ril_data.srs_client->data == NULL)
+		return -1;
+
+	client_data = (struct srs_client_data *) ril_data.srs_client->data;
+
+	buffer = NULL;
+	count = 0;
+
+	RIL_CLIENT_LOCK(client_data->client);
+
+	list = client_data->clients;
+	while (list != NULL) {
+		client = (struct srs_client_info *) list->data;
+		if (client == NULL || client->fd < 0 || !(client->topics & topic))
+			goto list_continue;
+
+		if (buffer == NULL) {
+			buffer = srs_buffer_new(command, 0, data, length);
+			if (buffer == NULL)
+				break;
+		}
+
+		rc = srs_client_send_buffer(client, buffer);
+
+		if (rc <= 0) {
+			ALOGD("SRS client with fd %d terminated", client->fd);
+
+			client->topics = 0;
+			shutdown(client->fd, SHUT_RDWR);
+			goto list_continue;
+		}
+
+		count++;
+
+list_continue:
+		list = list->next;
 	}
 
-	rc = read(client->fd, data, SRS_DATA_MAX_SIZE);
-	if (rc < (int) sizeof(struct srs_header)) {
+	RIL_CLIENT_UNLOCK(client_data->client);
+
+	srs_buffer_unref(buffer);
+
+	return count;
+}
+
+/*
+ * Reads whatever is available on the client socket and appends it to the
+ * client receive buffer. Returns the number of bytes read, 0 when nothing
+ * was available and -1 when the client is gone.
+ */
+int srs_client_recv(struct srs_client_info *client)
+{
+	int length;
+	int rc;
+
+	if (client == NULL || client->fd < 0)
+		return -1;
+
+	// Compact what is left of the previous read
+	if (client->buffer_offset > 0) {
+		length = client->buffer_length - client->buffer_offset;
+		if (length > 0)
+			memmove(client->buffer, client->buffer + client->buffer_offset, length);
+
+		client->buffer_length = length;
+		client->buffer_offset = 0;
+	}
+
+	length = sizeof(client->buffer) - client->buffer_length;
+	if (length <= 0)
+		return -1;
+
+	rc = read(client->fd, client->buffer + client->buffer_length, length);
+	if (rc < 0 && (errno == EAGAIN || errno == EINTR))
+		return 0;
+
+	if (rc <= 0) {
 		ALOGE("SRS read failed on fd %d with %d bytes", client->fd, rc);
-		goto error;
+		return -1;
 	}
 
-	header = (struct srs_header *) data;
+	client->buffer_length += rc;
+
+	return rc;
+}
+
+/*
+ * Decodes the next complete message from the client receive buffer.
+ * The message data points into the buffer and is only valid until the
+ * next srs_client_recv call. Returns 1 when a message was decoded, 0 when
+ * more data is needed and -1 on a protocol error.
+ */
+int srs_client_message_next(struct srs_client_info *client, struct srs_message *message)
+{
+	struct srs_header header;
+	struct srs_header *h = &header;
+	struct srs_header_seq header_seq;
+	unsigned char *data;
+	int offset;
+	int length;
+
+	if (client == NULL || message == NULL)
+		return -1;
+
+	length = client->buffer_length - client->buffer_offset;
+	if (length < (int) sizeof(struct srs_header))
+		return 0;
+
+	data = client->buffer + client->buffer_offset;
+	memcpy(&header, data, sizeof(header));
+
+	if (header.length < sizeof(struct srs_header) || header.length > SRS_DATA_MAX_SIZE) {
+		ALOGE("SRS invalid message length %d on fd %d", header.length, client->fd);
+		client->protocol_errors++;
+		return -1;
+	}
+
+	offset = sizeof(struct srs_header);
+	if (header.group & SRS_GROUP_SEQ)
+		offset += sizeof(struct srs_header_seq);
+
+	if ((int) header.length < offset) {
+		ALOGE("SRS invalid message length %d on fd %d", header.length, client->fd);
+		client->protocol_errors++;
+		return -1;
+	}
+
+	if (length < (int) header.length)
+		return 0;
 
 	memset(message, 0, sizeof(struct srs_message));
-	message->command = SRS_COMMAND(header);
-	message->length = header->length - sizeof(struct srs_header);
-	if (message->length > 0) {
-		message->data = calloc(1, message->length);
-		memcpy(message->data, (void *) ((char *) data + sizeof(struct srs_header)), message->length);
-	} else {
-		message->data = NULL;
+	message->command = SRS_COMMAND(h);
+
+	if (header.group & SRS_GROUP_SEQ) {
+		memcpy(&header_seq, data + sizeof(struct srs_header), sizeof(header_seq));
+		message->seq = header_seq.seq;
 	}
 
-	free(data);
-	return rc;
+	message->length = header.length - offset;
+	if (message->length > 0)
+		message->data = data + offset;
+	else
+		message->data = NULL;
 
-error:
-	free(data);
-	return 0;
+	client->buffer_offset += header.length;
+	client->messages++;
+
+	return 1;
 }
 
 void srs_control_ping(struct srs_client_info *client, struct srs_message *message)
@@ -377,6 +612,79 @@ void srs_control_ping(struct srs_client_info *client, struct srs_message *messag
 	}
 }
 
+void srs_control_subscribe(struct srs_client_info *client, struct srs_message *message)
+{
+	struct srs_control_subscribe_packet *packet;
+
+	if (client == NULL || message == NULL || message->data == NULL || message->length < (int) sizeof(struct srs_control_subscribe_packet))
+		return;
+
+	packet = (struct srs_control_subscribe_packet *) message->data;
+	client->topics |= packet->topics;
+
+	ALOGD("SRS client with fd %d subscribed to 0x%x", client->fd, client->topics);
+}
+
+void srs_control_unsubscribe(struct srs_client_info *client, struct srs_message *message)
+{
+	struct srs_control_subscribe_packet *packet;
+
+	if (client == NULL || message == NULL || message->data == NULL || message->length < (int) sizeof(struct srs_control_subscribe_packet))
+		return;
+
+	packet = (struct srs_control_subscribe_packet *) message->data;
+	client->topics &= ~packet->topics;
+
+	ALOGD("SRS client with fd %d now subscribed to 0x%x", client->fd, client->topics);
+}
+
+void srs_gps_hello(struct srs_client_info *client, struct srs_message *message)
+{
+	struct srs_gps_hello_packet *packet;
+	struct srs_gps_hello_packet reply;
+	int fd;
+
+	if (client == NULL || message == NULL)
+		return;
+
+	client->type = SRS_CLIENT_TYPE_GPS;
+
+	// The reply has to be the first message the client gets
+	if (message->data != NULL && message->length >= (int) sizeof(struct srs_gps_hello_packet)) {
+		packet = (struct srs_gps_hello_packet *) message->data;
+
+		memset(&reply, 0, sizeof(reply));
+
+		if (packet->flags & SRS_GPS_HELLO_SHM) {
+			fd = ril_gps_shm_fd();
+			if (fd >= 0) {
+				reply.flags = SRS_GPS_HELLO_SHM;
+				reply.shm_size = sizeof(struct srs_gps_shm);
+				srs_send_fd(client, SRS_GPS_HELLO, &reply, sizeof(reply), fd);
+			} else {
+				srs_send(client, SRS_GPS_HELLO, &reply, sizeof(reply));
+			}
+		}
+	}
+
+	client->topics |= SRS_TOPIC_GPS_LOCATION | SRS_TOPIC_GPS_SV_STATUS;
+}
+
+/*
+ * Acknowledges the sequenced message being dispatched if nothing answered it.
+ * Returns -1 when the client was dropped.
+ */
+int srs_control_ack(struct srs_client_info *client)
+{
+	if (client == NULL || client->seq == 0)
+		return 0;
+
+	if (srs_send(client, SRS_CONTROL_ACK, NULL, 0) <= 0)
+		return -1;
+
+	return 0;
+}
+
 static int srs_server_open(void)
 {
 	int server_fd;
@@ -433,30 +741,48 @@ void *srs_client_read_loop(void *data)
 		while ((fd = srs_client_info_get_fd_set(client_data, &fds)) >= 0) {
 			RIL_CLIENT_LOCK(client_data->client);
 			client = srs_client_info_find_fd(client_data, fd);
-			rc = srs_client_recv(client, &message);
-			if (rc <= 0) {
-				ALOGD("SRS client with fd %d terminated", fd);
+			rc = srs_client_recv(client);
+			RIL_CLIENT_UNLOCK(client_data->client);
 
-				if (client != NULL)
-					srs_client_unregister(client_data, client);
-				close(fd);
+			if (rc < 0)
+				goto client_terminate;
 
-				RIL_CLIENT_UNLOCK(client_data->client);
-				continue;
+			while ((rc = srs_client_message_next(client, &message)) > 0) {
+				ALOGD("RECV SRS: fd=%d command=%d length=%d", fd, message.command, message.length);
+				/*if (message.data != NULL && message.length > 0) {
+					ALOGD("==== SRS DATA DUMP ====");
+					hex_dump(message.data, message.length);
+					ALOGD("=======================");
+				}*/
+
+				client->seq = message.seq;
+
+				srs_dispatch(client, &message);
+
+				// The client may have been dropped while handling the message
+				if (srs_client_info_find_fd(client_data, fd) != client)
+					break;
+
+				if (srs_control_ack(client) < 0)
+					break;
 			}
-			RIL_CLIENT_UNLOCK(client_data->client);
 
-			ALOGD("RECV SRS: fd=%d command=%d length=%d", fd, message.command, message.length);
-			/*if (message.data != NULL && message.length > 0) {
-				ALOGD("==== SRS DATA DUMP ====");
-				hex_dump(message.data, message.length);
-				ALOGD("=======================");
-			}*/
+			// Either more data is needed or the client is already gone
+			if (rc >= 0)
+				continue;
+
+			client_data->protocol_errors++;
+			ALOGE("SRS protocol error on fd %d (%d errors total)", fd, client_data->protocol_errors);
 
-			srs_dispatch(client, &message);
+client_terminate:
+			ALOGD("SRS client with fd %d terminated", fd);
 
-			if (message.data != NULL)
-				free(message.data);
+			RIL_CLIENT_LOCK(client_data->client);
+			client = srs_client_info_find_fd(client_data, fd);
+			if (client != NULL)
+				srs_client_unregister(client_data, client);
+			close(fd);
+			RIL_CLIENT_UNLOCK(client_data->client);
 		}
 		SRS_CLIENT_UNLOCK();
 	}
@@ -506,7 +832,9 @@ int srs_read_loop(struct ril_client *client)
 		ALOGD("Accepted new SRS client from fd %d", fd);
 
 		SRS_CLIENT_LOCK();
+		RIL_CLIENT_LOCK(client_data->client);
 		rc = srs_client_register(client_data, fd);
+		RIL_CLIENT_UNLOCK(client_data->client);
 		SRS_CLIENT_UNLOCK();
 		if (rc < 0) {
 			ALOGE("Unable to register SRS client");
@@ -40,6 +40,18 @@
 struct srs_client_info {
 	int fd;
 	int type;
+	unsigned int topics;
+
+	/* Sequence id of the message being dispatched, until answered */
+	unsigned int seq;
+
+	/* Receive buffer: decoded messages are views into it */
+	unsigned char buffer[SRS_DATA_MAX_SIZE];
+	int buffer_length;
+	int buffer_offset;
+
+	unsigned int messages;
+	unsigned int protocol_errors;
 };
 
 struct srs_client_data {
@@ -52,12 +64,31 @@ struct srs_client_data {
 	pthread_t thread;
 	pthread_mutex_t mutex;
 	int running;
+
+	unsigned int protocol_errors;
+};
+
+/* Encoded message, shared by every client it is sent to */
+struct srs_buffer {
+	int refcount;
+	int length;
+	unsigned char data[0];
 };
 
 extern struct ril_client_funcs srs_client_funcs;
 
+struct srs_buffer *srs_buffer_new(unsigned short command, unsigned int seq, void *data, int length);
+struct srs_buffer *srs_buffer_ref(struct srs_buffer *buffer);
+void srs_buffer_unref(struct srs_buffer *buffer);
+
 int srs_send(struct srs_client_info *client, unsigned short command, void *data, int length);
+int srs_send_fd(struct srs_client_info *client, unsigned short command, void *data, int length, int fd);
+int srs_publish(unsigned int topic, unsigned short command, void *data, int length);
 void srs_control_ping(struct srs_client_info *client, struct srs_message *message);
+int srs_control_ack(struct srs_client_info *client);
+void srs_control_subscribe(struct srs_client_info *client, struct srs_message *message);
+void srs_control_unsubscribe(struct srs_client_info *client, struct srs_message *message);
+void srs_gps_hello(struct srs_client_info *client, struct srs_message *message);
 struct srs_client_info *srs_client_info_find_type(struct srs_client_data *client_data, int type);
 
 #endif
@@ -25,6 +25,7 @@
 
 #include "mocha-ril.h"
 #include "util.h"
+#include "gsm7.h"
 #include <tapi_ss.h>
 
 
@@ -112,11 +113,38 @@ void ipc_ss_error_response(void* data)
 	}
 }
 
+/*
+ * USSD strings go to AMSS as text, which it packs with dcs 0x0F: they must
+ * be in the default alphabet and fit RIL_USSD_SIZE octets once packed.
+ */
+static int ril_ussd_check(const char *message)
+{
+	uint8_t septets[RIL_USSD_SIZE * 8 / 7];
+	size_t length;
+	int count;
+
+	length = strlen(message);
+	if (length > sizeof(((tapiSsSendUssd *) NULL)->ussdStr))
+		return -1;
+
+	count = utf8_to_gsm7(message, length, septets, sizeof(septets));
+	if (count < 0 || GSM7_PACKED_SIZE(count) > RIL_USSD_SIZE)
+		return -1;
+
+	return 0;
+}
+
 void ril_request_send_ussd(RIL_Token t, void *data, size_t datalen)
 {
 	tapiSsSendUssd *ussd_req;
 	tapiSsResponse *ss_resp;
 
+	if (data == NULL || ril_ussd_check((char *) data) < 0) {
+		ALOGE("%s: USSD message can't be sent with the default alphabet", __func__);
+		ril_request_complete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
+		return;
+	}
+
 	DEBUG_I("%s: message - %s ", __func__, (char *)data);
 
 	switch(ril_data.state.ussd_state) {
@@ -0,0 +1,329 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <pthread.h>
+#include <sys/time.h>
+
+#define LOG_TAG "RIL-Mocha-STK"
+#include <utils/Log.h>
+
+#include "mocha-ril.h"
+#include "util.h"
+#include <sim.h>
+
+/*
+ * ATK traffic is queued in ril_data.stk_events and handled by its own
+ * thread, so that the IPC dispatch does not wait on ATK packets. The
+ * queue has its own lock; the thread only takes RIL_LOCK for the SIM
+ * file caches.
+ *
+ * The ATK packet carrying terminal responses and envelopes is not known,
+ * so proactive commands are not forwarded to the framework: they are
+ * logged, and REFRESH reloads the SIM files.
+ */
+
+static void ril_stk_stats_update(struct ril_stk_event *event)
+{
+	struct ril_stk_stats *stats = &ril_data.stk_stats;
+	struct timeval now;
+	unsigned int latency;
+
+	gettimeofday(&now, NULL);
+	latency = (now.tv_sec - event->time.tv_sec) * 1000 +
+		(now.tv_usec - event->time.tv_usec) / 1000;
+
+	pthread_mutex_lock(&ril_data.stk_mutex);
+
+	stats->processed++;
+	stats->latency_total += latency;
+	if (latency > stats->latency_max)
+		stats->latency_max = latency;
+
+	if (stats->processed % 16 == 0)
+		ALOGD("%s: %u queued, %u processed, %u dropped, depth %u (max %u), %u ms average, %u ms max",
+			__func__, stats->queued, stats->processed, stats->dropped,
+			stats->depth, stats->depth_max,
+			stats->latency_total / stats->processed, stats->latency_max);
+
+	pthread_mutex_unlock(&ril_data.stk_mutex);
+}
+
+static int ril_stk_tlv_length(uint8_t *data, size_t size, size_t *length)
+{
+	if (size < 1)
+		return -1;
+
+	if (data[0] < 0x80) {
+		*length = data[0];
+		return 1;
+	}
+
+	if (data[0] == 0x81 && size >= 2) {
+		*length = data[1];
+		return 2;
+	}
+
+	return -1;
+}
+
+/*
+ * Finds the proactive command BER-TLV (tag D0) at the start of the ATK
+ * payload and reads its command details and device identities.
+ */
+int ril_stk_command_parse(struct ril_stk_command *command, uint8_t *data, size_t length)
+{
+	size_t tlv_length;
+	size_t offset;
+	size_t p = 0;
+	int found = 0;
+	int tag;
+	int rc;
+
+	if (command == NULL || data == NULL)
+		return -1;
+
+	memset(command, 0, sizeof(struct ril_stk_command));
+
+	// The payload header before the BER-TLV is not known, look for it
+	for (offset = 0 ; offset < length && offset < 16 ; offset++) {
+		if (data[offset] != 0xD0)
+			continue;
+
+		rc = ril_stk_tlv_length(data + offset + 1, length - offset - 1, &tlv_length);
+		if (rc < 0 || offset + 1 + rc + tlv_length > length)
+			continue;
+
+		command->data = data + offset;
+		command->length = 1 + rc + tlv_length;
+		p = 1 + rc;
+		break;
+	}
+
+	if (command->data == NULL)
+		return -1;
+
+	while (p + 2 <= command->length) {
+		tag = command->data[p] & 0x7F;
+
+		rc = ril_stk_tlv_length(command->data + p + 1, command->length - p - 1, &tlv_length);
+		if (rc < 0 || p + 1 + rc + tlv_length > command->length)
+			return -1;
+
+		p += 1 + rc;
+
+		switch (tag) {
+			case 0x01:
+				if (tlv_length < 3)
+					return -1;
+				command->number = command->data[p];
+				command->type = command->data[p + 1];
+				command->qualifier = command->data[p + 2];
+				found = 1;
+				break;
+			case 0x02:
+				if (tlv_length < 2)
+					return -1;
+				command->source = command->data[p];
+				command->destination = command->data[p + 1];
+				break;
+		}
+
+		p += tlv_length;
+	}
+
+	return found ? 0 : -1;
+}
+
+static void ril_stk_proactive(struct ril_stk_event *event)
+{
+	struct ril_stk_command command;
+	int rc;
+
+	rc = ril_stk_command_parse(&command, event->data, event->length);
+	if (rc < 0) {
+		ALOGD("%s: ATK indication without a proactive command", __func__);
+
+		// It may still have refreshed files
+		RIL_LOCK();
+		sim_cache_clear();
+		RIL_UNLOCK();
+		return;
+	}
+
+	ALOGD("%s: Command %d: type 0x%02x qualifier 0x%02x, %02x -> %02x", __func__,
+		command.number, command.type, command.qualifier,
+		command.source, command.destination);
+
+	if (command.type != STK_COMMAND_REFRESH)
+		return;
+
+	RIL_LOCK();
+	ril_sim_files_refresh();
+	RIL_UNLOCK();
+}
+
+static void ril_stk_event_handle(struct ril_stk_event *event)
+{
+	uint8_t buf[2];
+
+	switch (event->type) {
+		case SIM_ATK_EVENT_PROACTIVE:
+			ril_stk_proactive(event);
+			break;
+		case SIM_ATK_EVENT_RESPONSE:
+			ALOGD("%s: ATK interface response, %d bytes", __func__, (int) event->length);
+			break;
+		case SIM_ATK_EVENT_ACK:
+			buf[0] = 0;
+			buf[1] = 0;
+			sim_atk_send_packet(0x1, 0x31, 0x2, buf);
+			break;
+		case SIM_ATK_EVENT_OEM_REQUEST:
+			sim_send_oem_req(event->data, event->length);
+			break;
+		default:
+			ALOGE("%s: Unknown STK event 0x%x", __func__, event->type);
+			break;
+	}
+}
+
+static void *ril_stk_thread(void *data)
+{
+	struct ril_stk_event *event;
+	struct list_head *list;
+
+	while (1) {
+		pthread_mutex_lock(&ril_data.stk_mutex);
+
+		while (ril_data.stk_events == NULL)
+			pthread_cond_wait(&ril_data.stk_cond, &ril_data.stk_mutex);
+
+		list = ril_data.stk_events;
+		event = (struct ril_stk_event *) list->data;
+		ril_data.stk_events = list->next;
+		list_head_free(list);
+		ril_data.stk_stats.depth--;
+
+		pthread_mutex_unlock(&ril_data.stk_mutex);
+
+		if (event == NULL)
+			continue;
+
+		ril_stk_event_handle(event);
+		ril_stk_stats_update(event);
+
+		free(event);
+	}
+
+	return NULL;
+}
+
+void ril_stk_init(void)
+{
+	pthread_attr_t attr;
+	int rc;
+
+	pthread_mutex_init(&ril_data.stk_mutex, NULL);
+	pthread_cond_init(&ril_data.stk_cond, NULL);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	rc = pthread_create(&ril_data.stk_thread, &attr, ril_stk_thread, NULL);
+	if (rc != 0)
+		ALOGE("%s: pthread creation failed", __func__);
+}
+
+int ril_stk_queue(int type, int subtype, void *data, size_t length)
+{
+	struct ril_stk_event *event;
+	struct list_head *list_end;
+	struct list_head *list;
+
+	if (length > RIL_STK_DATA_SIZE || (data == NULL && length > 0))
+		return -1;
+
+	event = calloc(1, sizeof(struct ril_stk_event));
+	if (event == NULL)
+		return -1;
+
+	event->type = type;
+	event->subtype = subtype;
+	if (length > 0)
+		memcpy(event->data, data, length);
+	event->length = length;
+	gettimeofday(&event->time, NULL);
+
+	pthread_mutex_lock(&ril_data.stk_mutex);
+
+	if (ril_data.stk_stats.depth >= RIL_STK_QUEUE_SIZE) {
+		ril_data.stk_stats.dropped++;
+		pthread_mutex_unlock(&ril_data.stk_mutex);
+		free(event);
+		return -1;
+	}
+
+	list_end = ril_data.stk_events;
+	while (list_end != NULL && list_end->next != NULL)
+		list_end = list_end->next;
+
+	list = list_head_alloc((void *) event, list_end, NULL);
+
+	if (ril_data.stk_events == NULL)
+		ril_data.stk_events = list;
+
+	ril_data.stk_stats.queued++;
+	ril_data.stk_stats.depth++;
+	if (ril_data.stk_stats.depth > ril_data.stk_stats.depth_max)
+		ril_data.stk_stats.depth_max = ril_data.stk_stats.depth;
+
+	pthread_cond_signal(&ril_data.stk_cond);
+	pthread_mutex_unlock(&ril_data.stk_mutex);
+
+	return 0;
+}
+
+void ipc_sim_atk_event(void *data)
+{
+	simAtkEvent *atk_event = (simAtkEvent *) data;
+	uint8_t buf[2];
+	int rc;
+
+	if (atk_event == NULL)
+		return;
+
+	rc = ril_stk_queue(atk_event->type, atk_event->subType,
+		atk_event->data, atk_event->length);
+	if (rc == 0)
+		return;
+
+	// The modem still expects its answer
+	switch (atk_event->type) {
+		case SIM_ATK_EVENT_ACK:
+			buf[0] = 0;
+			buf[1] = 0;
+			sim_atk_send_packet(0x1, 0x31, 0x2, buf);
+			break;
+		case SIM_ATK_EVENT_OEM_REQUEST:
+			sim_send_oem_req(atk_event->data, atk_event->length);
+			break;
+		default:
+			ALOGE("%s: Unable to queue ATK event %d", __func__, atk_event->type);
+			break;
+	}
+}
@@ -36,7 +36,7 @@
 
 #include "mocha-ril.h"
 
-#define RIL_CONFIG_PATH "/data/radio/ril_config.bin"
+#define RIL_CONFIG_FILE "ril_config.bin"
 
 /**
  * List
@@ -76,86 +76,6 @@ void list_head_free(struct list_head *list)
 	free(list);
 }
 
-/**
- * Converts GSM7 (8 bits) data to ASCII (7 bits)
- */
-size_t gsm72ascii(unsigned char *gsm7, char **ascii, size_t size)
-{
-	int t, u, d, o = 0;
-	size_t i;
-
-	int ascii_length;
-	char *dec;
-
-	ascii_length = ((size * 8) - ((size * 8) % 7) ) / 7;
-
-	dec = malloc(ascii_length);
-	memset(dec, 0, ascii_length);
-
-	for(i = 0 ; i < size ; i++)
-	{
-		d = 7 - i % 7;
-		if(d == 7 && i != 0)
-			o++;
-
-		t = (gsm7[i] - (((gsm7[i] >> d) & 0xff) << d));
-		u = (gsm7[i] >> d) & 0xff;
-
-		dec[i + o]+=t << (i + o) % 8;
-
-		if(u)
-			dec[i + 1 + o]+=u;
-	}
-
-	*ascii = dec;
-
-	return ascii_length;
-}
-
-/**
- * Converts ASCII (7 bits) data to GSM7 (8 bits)
- */
-size_t ascii2gsm7(char *ascii, unsigned char **gsm7, size_t size)
-{
-	int d_off, d_pos, a_off, a_pos = 0;
-	size_t i;
-
-	int gsm7_length;
-	unsigned char *enc;
-
-	gsm7_length = ((size * 7) - (size * 7) % 8) / 8;
-	gsm7_length += (size * 7) % 8 > 0 ? 1 : 0;
-
-	enc = malloc(gsm7_length);
-	memset(enc, 0, gsm7_length);
-
-	for (i = 0 ; i < size ; i++)
-	{
-		// offset from the right of data to keep
-		d_off = i % 8;
-
-		// position of the data we keep
-		d_pos = ((i * 7) - (i * 7) % 8) / 8;
-		d_pos += (i * 7) % 8 > 0 ? 1 : 0;
-
-		// adding the data with correct offset
-		enc[d_pos] |= ascii[i] >> d_off;
-
-		// numbers of bits to omit to get data to add another place
-		a_off = 8 - d_off;
-
-		// position (on the encoded feed) of the data to add
-		a_pos = d_pos - 1;
-
-		// adding the data to add at the correct position
-		enc[a_pos] |= ascii[i] << a_off;
-	}
-
-	*gsm7 = enc;
-
-	return gsm7_length;
-}
-
 void hex_dump(void *data, int size)
 {
 	/* dumps size bytes of *data to stdout. Looks like:
@@ -295,6 +215,22 @@ int tun_alloc(char *dev, int flags)
 	return fd;
 }
 
+/*
+ * Builds the path of a file in the RIL data directory.
+ */
+int ril_data_path(char *path, size_t size, const char *name)
+{
+	int rc;
+
+	rc = snprintf(path, size, "%s/%s", ril_data.data_path, name);
+	if (rc < 0 || (size_t) rc >= size) {
+		ALOGE("%s: Path to %s is too long", __func__, name);
+		return -1;
+	}
+
+	return 0;
+}
+
 void load_default_ril_config()
 {
 	ril_data.config.bAutoAttach = 1;
@@ -303,21 +239,25 @@ void load_default_ril_config()
 /* Return 0 in case of success, non-zero in case of failure */
 int load_ril_config()
 {
+	char path[RIL_DATA_PATH_SIZE];
 	int fd, n;
 	load_default_ril_config();
 
-	if( (fd = open(RIL_CONFIG_PATH, O_RDONLY)) < 0 ) {
+	if (ril_data_path(path, sizeof(path), RIL_CONFIG_FILE) < 0)
+		return -1;
+
+	if( (fd = open(path, O_RDONLY)) < 0 ) {
 		return fd;
 	}
 
 	n = read(fd, &ril_data.config, sizeof(ril_config));
 	if(n != sizeof(ril_config))
 		goto error;
-	ALOGD("%s: Read %d bytes from %s", __func__, n, RIL_CONFIG_PATH);
+	ALOGD("%s: Read %d bytes from %s", __func__, n, path);
 	close(fd);
 	return 0;
 error:
-	ALOGE("%s: Read only %d of %d bytes from %s", __func__, n, sizeof(ril_config), RIL_CONFIG_PATH);
+	ALOGE("%s: Read only %d of %d bytes from %s", __func__, n, sizeof(ril_config), path);
 	close(fd);
 	return -1;
 }
@@ -325,126 +265,25 @@ error:
 /* Return 0 in case of success, non-zero in case of failure */
 int save_ril_config()
 {
+	char path[RIL_DATA_PATH_SIZE];
 	int fd, n;
 
-	if( (fd = open(RIL_CONFIG_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0 ) {
-		ALOGE("%s: Couldn't open %s for writing, errno: %d", __func__, RIL_CONFIG_PATH, errno);
+	if (ril_data_path(path, sizeof(path), RIL_CONFIG_FILE) < 0)
+		return -1;
+
+	if( (fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0 ) {
+		ALOGE("%s: Couldn't open %s for writing, errno: %d", __func__, path, errno);
 		return fd;
 	}
 
 	n = write(fd, &ril_data.config, sizeof(ril_config));
 	if(n != sizeof(ril_config))
 		goto error;
-	ALOGD("%s: Written %d bytes to %s", __func__, n, RIL_CONFIG_PATH);
+	ALOGD("%s: Written %d bytes to %s", __func__, n, path);
 	close(fd);
 	return 0;
 error:
-	ALOGE("%s: Wrote only %d of %d bytes to %s", __func__, n, sizeof(ril_config), RIL_CONFIG_PATH);
+	ALOGE("%s: Wrote only %d of %d bytes to %s", __func__, n, sizeof(ril_config), path);
 	close(fd);
 	return -1;
 }
-
-size_t data2string_length(const void *data, size_t size)
-{
-	size_t length;
-
-	if (data == NULL || size == 0)
-		return 0;
-
-	length = size * 2 + 1;
-
-	return length;
-}
-
-char *data2string(const void *data, size_t size)
-{
-	char *string;
-	size_t length;
-	char *p;
-	size_t i;
-
-	if (data == NULL || size == 0)
-		return NULL;
-
-	length = data2string_length(data, size);
-	if (length == 0)
-		return NULL;
-
-	string = (char *) calloc(1, length);
-
-	p = string;
-
-	for (i = 0; i < size; i++) {
-		sprintf(p, "%02x", *((unsigned char *) data + i));
-		p += 2 * sizeof(char);
-	}
-
-	return string;
-}
-
-size_t string2data_size(const char *string)
-{
-	size_t length;
-	size_t size;
-
-	if (string == NULL)
-		return 0;
-
-	length = strlen(string);
-	if (length == 0)
-		return 0;
-
-	if (length % 2 == 0)
-		size = length / 2;
-	else
-		size = (length - (length % 2)) / 2 + 1;
-
-	return size;
-}
-
-void *string2data(const char *string)
-{
-	void *data;
-	size_t size;
-	size_t length;
-	int shift;
-	unsigned char *p;
-	unsigned int b;
-	size_t i;
-	int rc;
-
-	if (string == NULL)
-		return NULL;
-
-	length = strlen(string);
-	if (length == 0)
-		return NULL;
-
-	if (length % 2 == 0)
-		shift = 0;
-	else
-		shift = 1;
-
-	size = string2data_size(string);
-	if (size == 0)
-		return NULL;
-
-	data = calloc(1, size);
-
-	p = (unsigned char *) data;
-
-	for (i = 0; i < length; i++) {
-		rc = sscanf(&string[i], "%01x", &b);
-		if (rc < 1)
-			b = 0;
-
-		if ((shift % 2) == 0)
-			*p |= ((b & 0x0f) << 4);
-		else
-			*p++ |= b & 0x0f;
-
-		shift++;
-	}
-
-	return data;
-}
\ No newline at end of file
@@ -31,19 +31,13 @@ struct list_head {
 struct list_head *list_head_alloc(void *data, struct list_head *prev, struct list_head *next);
 void list_head_free(struct list_head *list);
 
-size_t gsm72ascii(unsigned char *gsm7, char **ascii, size_t size);
-size_t ascii2gsm7(char *ascii, unsigned char **gsm7, size_t size);
 void hex_dump(void *data, int size);
 int utf8_write(char *utf8, int offset, int v);
 
 int tun_alloc(char *dev, int flags);
+int ril_data_path(char *path, size_t size, const char *name);
 void load_default_ril_config(void);
 int load_ril_config(void);
 int save_ril_config(void);
 
-size_t data2string_length(const void *data, size_t size);
-char *data2string(const void *data, size_t size);
-size_t string2data_size(const char *string);
-void *string2data(const char *string);
-
 #endif
@@ -19,6 +19,7 @@
  */
 
 #include <pthread.h>
+#include <time.h>
 
 #include <samsung-ril-socket.h>
 
@@ -30,16 +31,43 @@
 #define SRS_CLIENT_LOCK(client) pthread_mutex_lock(&(client->mutex))
 #define SRS_CLIENT_UNLOCK(client) pthread_mutex_unlock(&(client->mutex))
 
+struct srs_client;
+
 typedef void (*srs_client_thread_cb)(struct srs_message *message);
 
+/*
+ * Called from the client loop with the reply to a sequenced request, or with
+ * a NULL message and a negative status when it timed out or the link died.
+ */
+typedef void (*srs_client_request_cb)(struct srs_client *client,
+	struct srs_message *message, int status, void *data);
+
+struct srs_client_request {
+	unsigned int seq;
+	unsigned short command;
+	struct timespec deadline;
+
+	srs_client_request_cb cb;
+	void *data;
+
+	struct srs_client_request *next;
+};
+
 struct srs_client {
 	int fd;
 
 	pthread_mutex_t mutex;
 	pthread_t thread;
 	int thread_run;
+	int thread_joinable;
 
 	srs_client_thread_cb thread_cb;
+
+	unsigned int seq;
+	struct srs_client_request *requests;
+
+	unsigned char buffer[SRS_DATA_MAX_SIZE];
+	int buffer_length;
 };
 
 int srs_client_recv_message(struct srs_client *client, struct srs_message *message);
@@ -55,6 +83,15 @@ int srs_client_thread_start(struct srs_client *client,
 	srs_client_thread_cb cb);
 int srs_client_thread_stop(struct srs_client *client);
 
+int srs_client_send_async(struct srs_client *client, unsigned short command,
+	void *data, int length, int timeout, srs_client_request_cb cb, void *cb_data);
+int srs_client_loop_start(struct srs_client *client, srs_client_thread_cb cb);
+int srs_client_loop_stop(struct srs_client *client);
+
 int srs_client_ping(struct srs_client *client);
 
+int srs_client_gps_shm_open(struct srs_client *client, struct srs_gps_shm **shm_p);
+int srs_client_gps_shm_read(struct srs_gps_shm *shm, struct srs_gps_shm *copy);
+int srs_client_gps_shm_close(struct srs_gps_shm *shm);
+
 #endif
@@ -18,11 +18,13 @@
  *
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -47,6 +49,7 @@ int srs_client_recv_message(struct srs_client *client, struct srs_message *messa
 {
 	struct srs_header *header_p;
 	struct srs_header header;
+	struct srs_header_seq header_seq;
 	void *data = NULL;
 	int length = 0;
 
@@ -84,6 +87,18 @@ int srs_client_recv_message(struct srs_client *client, struct srs_message *messa
 	message->command = SRS_COMMAND(header_p);
 
 	length = header.length - sizeof(header);
+
+	if (header.group & SRS_GROUP_SEQ) {
+		SRS_CLIENT_LOCK(client);
+		rc = read(client->fd, &header_seq, sizeof(header_seq));
+		SRS_CLIENT_UNLOCK(client);
+
+		if (rc != sizeof(header_seq))
+			goto error;
+
+		message->seq = header_seq.seq;
+		length -= sizeof(header_seq);
+	}
 	if (length > 0) {
 		data = calloc(1, length);
 		if (data == NULL)
@@ -123,6 +138,7 @@ done:
 int srs_client_send_message(struct srs_client *client, struct srs_message *message)
 {
 	struct srs_header header;
+	struct srs_header_seq header_seq;
 	unsigned char *p = NULL;
 	void *data = NULL;
 	int length = 0;
@@ -139,6 +155,12 @@ int srs_client_send_message(struct srs_client *client, struct srs_message *messa
 	header.group = SRS_GROUP(message->command);
 	header.index = SRS_INDEX(message->command);
 
+	if (message->seq != 0) {
+		header.length += sizeof(header_seq);
+		header.group |= SRS_GROUP_SEQ;
+		header_seq.seq = message->seq;
+	}
+
 	length = header.length;
 	data = calloc(1, length);
 	if (data == NULL)
@@ -147,6 +169,10 @@ int srs_client_send_message(struct srs_client *client, struct srs_message *messa
 	p = (unsigned char *) data;
 	memcpy(p, &header, sizeof(header));
 	p += sizeof(header);
+	if (message->seq != 0) {
+		memcpy(p, &header_seq, sizeof(header_seq));
+		p += sizeof(header_seq);
+	}
 	if (message->data != NULL && message->length > 0) {
 		memcpy(p, message->data, message->length);
 		p += message->length;
@@ -248,9 +274,20 @@ int srs_client_create(struct srs_client **client_p)
 
 int srs_client_destroy(struct srs_client *client)
 {
+	struct srs_client_request *request;
+
 	if (client == NULL)
 		return -EINVAL;
 
+	// The loop thread still uses the requests and the buffer
+	srs_client_loop_stop(client);
+
+	while (client->requests != NULL) {
+		request = client->requests;
+		client->requests = request->next;
+		free(request);
+	}
+
 	pthread_mutex_destroy(&(client->mutex));
 
 	free(client);
@@ -322,6 +359,359 @@ int srs_client_thread_stop(struct srs_client *client)
 	return 0;
 }
 
+/*
+ * SRS Client loop
+ */
+
+static void srs_client_deadline(struct timespec *deadline, int timeout)
+{
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+
+	deadline->tv_sec += timeout / 1000;
+	deadline->tv_nsec += (timeout % 1000) * 1000000;
+	if (deadline->tv_nsec >= 1000000000) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000;
+	}
+}
+
+static struct srs_client_request *srs_client_request_take(struct srs_client *client, unsigned int seq)
+{
+	struct srs_client_request *request;
+	struct srs_client_request **request_p;
+
+	SRS_CLIENT_LOCK(client);
+
+	request_p = &client->requests;
+	while (*request_p != NULL) {
+		request = *request_p;
+		if (request->seq == seq) {
+			*request_p = request->next;
+			SRS_CLIENT_UNLOCK(client);
+			return request;
+		}
+
+		request_p = &request->next;
+	}
+
+	SRS_CLIENT_UNLOCK(client);
+
+	return NULL;
+}
+
+/*
+ * Takes the first request whose deadline is before now, or any request
+ * when now is NULL.
+ */
+static struct srs_client_request *srs_client_request_take_expired(struct srs_client *client, struct timespec *now)
+{
+	struct srs_client_request *request;
+	struct srs_client_request **request_p;
+
+	SRS_CLIENT_LOCK(client);
+
+	request_p = &client->requests;
+	while (*request_p != NULL) {
+		request = *request_p;
+		if (now == NULL || request->deadline.tv_sec < now->tv_sec ||
+			(request->deadline.tv_sec == now->tv_sec && request->deadline.tv_nsec <= now->tv_nsec)) {
+			*request_p = request->next;
+			SRS_CLIENT_UNLOCK(client);
+			return request;
+		}
+
+		request_p = &request->next;
+	}
+
+	SRS_CLIENT_UNLOCK(client);
+
+	return NULL;
+}
+
+/*
+ * Returns the select timeout, in microseconds, until the nearest deadline.
+ */
+static int srs_client_request_timeout(struct srs_client *client)
+{
+	struct srs_client_request *request;
+	struct timespec now;
+	long long timeout;
+	long long t;
+
+	timeout = SRS_CLIENT_TIMEOUT;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	SRS_CLIENT_LOCK(client);
+
+	for (request = client->requests; request != NULL; request = request->next) {
+		t = (long long) (request->deadline.tv_sec - now.tv_sec) * 1000000 +
+			(request->deadline.tv_nsec - now.tv_nsec) / 1000;
+		if (t < timeout)
+			timeout = t;
+	}
+
+	SRS_CLIENT_UNLOCK(client);
+
+	if (timeout < 0)
+		timeout = 0;
+
+	return (int) timeout;
+}
+
+static void srs_client_loop_message(struct srs_client *client, struct srs_message *message)
+{
+	struct srs_client_request *request;
+
+	if (message->seq == 0) {
+		if (client->thread_cb != NULL)
+			client->thread_cb(message);
+		return;
+	}
+
+	request = srs_client_request_take(client, message->seq);
+	if (request == NULL)
+		return;
+
+	if (request->cb != NULL)
+		request->cb(client, message, 0, request->data);
+
+	free(request);
+}
+
+/*
+ * Decodes and handles every complete message in the receive buffer.
+ * Returns -1 on a protocol error.
+ */
+static int srs_client_loop_decode(struct srs_client *client)
+{
+	struct srs_header_seq header_seq;
+	struct srs_header *header_p;
+	struct srs_header header;
+	struct srs_message message;
+	unsigned char *data;
+	int offset;
+	int length;
+	int i = 0;
+
+	while (client->buffer_length - i >= (int) sizeof(header)) {
+		data = client->buffer + i;
+		memcpy(&header, data, sizeof(header));
+
+		offset = sizeof(header);
+		if (header.group & SRS_GROUP_SEQ)
+			offset += sizeof(header_seq);
+
+		if ((int) header.length < offset || header.length > SRS_DATA_MAX_SIZE)
+			return -1;
+
+		length = client->buffer_length - i;
+		if (length < (int) header.length)
+			break;
+
+		header_p = &header;
+
+		memset(&message, 0, sizeof(message));
+		message.command = SRS_COMMAND(header_p);
+
+		if (header.group & SRS_GROUP_SEQ) {
+			memcpy(&header_seq, data + sizeof(header), sizeof(header_seq));
+			message.seq = header_seq.seq;
+		}
+
+		message.length = header.length - offset;
+		if (message.length > 0)
+			message.data = data + offset;
+
+		srs_client_loop_message(client, &message);
+
+		i += header.length;
+	}
+
+	if (i > 0) {
+		client->buffer_length -= i;
+		if (client->buffer_length > 0)
+			memmove(client->buffer, client->buffer + i, client->buffer_length);
+	}
+
+	return 0;
+}
+
+void *srs_client_loop(void *data)
+{
+	struct srs_client_request *request;
+	struct srs_client *client;
+	struct timespec now;
+	struct timeval timeout;
+	fd_set fds;
+	int t;
+	int rc;
+
+	if (data == NULL)
+		return NULL;
+
+	client = (struct srs_client *) data;
+	client->buffer_length = 0;
+
+	while (client->thread_run && client->fd >= 0) {
+		t = srs_client_request_timeout(client);
+
+		timeout.tv_sec = t / 1000000;
+		timeout.tv_usec = t % 1000000;
+
+		FD_ZERO(&fds);
+		FD_SET(client->fd, &fds);
+
+		rc = select(client->fd + 1, &fds, NULL, NULL, &timeout);
+		if (rc < 0 && errno != EINTR)
+			break;
+
+		if (rc > 0 && FD_ISSET(client->fd, &fds)) {
+			rc = read(client->fd, client->buffer + client->buffer_length,
+				sizeof(client->buffer) - client->buffer_length);
+			if (rc == 0 || (rc < 0 && errno != EINTR && errno != EAGAIN))
+				break;
+
+			if (rc > 0) {
+				client->buffer_length += rc;
+
+				if (srs_client_loop_decode(client) < 0)
+					break;
+			}
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		while ((request = srs_client_request_take_expired(client, &now)) != NULL) {
+			if (request->cb != NULL)
+				request->cb(client, NULL, -ETIMEDOUT, request->data);
+			free(request);
+		}
+	}
+
+	while ((request = srs_client_request_take_expired(client, NULL)) != NULL) {
+		if (request->cb != NULL)
+			request->cb(client, NULL, -EPIPE, request->data);
+		free(request);
+	}
+
+	client->thread_run = 0;
+
+	return NULL;
+}
+
+/*
+ * Starts the client loop: replies are matched to their requests and
+ * other messages are passed to cb, with data only valid during the call.
+ */
+int srs_client_loop_start(struct srs_client *client, srs_client_thread_cb cb)
+{
+	pthread_attr_t attr;
+	int rc;
+
+	if (client == NULL || client->fd < 0)
+		return -EINVAL;
+
+	client->thread_cb = cb;
+	client->thread_run = 1;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+	rc = pthread_create(&(client->thread), &attr, srs_client_loop, (void *) client);
+	if (rc != 0) {
+		client->thread_run = 0;
+		return -1;
+	}
+
+	client->thread_joinable = 1;
+
+	return 0;
+}
+
+/*
+ * Stops the client loop and waits for its thread, which may take up to
+ * the select timeout. From a loop callback, the thread is detached and
+ * ends when the callback returns.
+ */
+int srs_client_loop_stop(struct srs_client *client)
+{
+	if (client == NULL)
+		return -EINVAL;
+
+	client->thread_run = 0;
+
+	if (!client->thread_joinable)
+		return 0;
+
+	client->thread_joinable = 0;
+
+	if (pthread_equal(pthread_self(), client->thread))
+		pthread_detach(client->thread);
+	else
+		pthread_join(client->thread, NULL);
+
+	return 0;
+}
+
+/*
+ * Sends a sequenced request without waiting for its reply. The timeout is
+ * in milliseconds. Returns the request sequence id.
+ */
+int srs_client_send_async(struct srs_client *client, unsigned short command,
+	void *data, int length, int timeout, srs_client_request_cb cb, void *cb_data)
+{
+	struct srs_client_request *request;
+	struct srs_client_request **request_p;
+	struct srs_message message;
+	int rc;
+
+	if (client == NULL || client->fd < 0)
+		return -EINVAL;
+
+	if (timeout <= 0)
+		timeout = SRS_CLIENT_TIMEOUT / 1000;
+
+	request = calloc(1, sizeof(struct srs_client_request));
+	if (request == NULL)
+		return -1;
+
+	request->command = command;
+	request->cb = cb;
+	request->data = cb_data;
+	srs_client_deadline(&request->deadline, timeout);
+
+	SRS_CLIENT_LOCK(client);
+
+	client->seq++;
+	if (client->seq == 0)
+		client->seq++;
+	request->seq = client->seq;
+
+	request_p = &client->requests;
+	while (*request_p != NULL)
+		request_p = &(*request_p)->next;
+	*request_p = request;
+
+	SRS_CLIENT_UNLOCK(client);
+
+	memset(&message, 0, sizeof(message));
+	message.command = command;
+	message.seq = request->seq;
+	message.data = data;
+	message.length = length;
+
+	rc = srs_client_send_message(client, &message);
+	if (rc < 0) {
+		request = srs_client_request_take(client, message.seq);
+		if (request != NULL)
+			free(request);
+
+		return -1;
+	}
+
+	return (int) message.seq;
+}
+
 /*
  * SRS Client inline
  */
@@ -363,3 +753,139 @@ done:
 
 	return rc;
 }
+
+/*
+ * SRS Client GPS shared memory
+ */
+
+#define SRS_CLIENT_GPS_SHM_RETRIES	100
+
+/*
+ * Sends the GPS hello asking for the shared memory region and maps it.
+ * Must be called before the client thread is started, since the reply
+ * carries the region fd as ancillary data.
+ */
+int srs_client_gps_shm_open(struct srs_client *client, struct srs_gps_shm **shm_p)
+{
+	struct srs_gps_hello_packet hello;
+	struct srs_gps_hello_packet *hello_p;
+	struct srs_header *header;
+	struct srs_gps_shm *shm;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	char control[CMSG_SPACE(sizeof(int))];
+	unsigned char data[sizeof(struct srs_header) + sizeof(struct srs_gps_hello_packet)];
+
+	struct timeval timeout;
+	fd_set fds;
+	int fd = -1;
+	int rc;
+
+	if (client == NULL || client->fd < 0 || shm_p == NULL)
+		return -EINVAL;
+
+	memset(&hello, 0, sizeof(hello));
+	hello.flags = SRS_GPS_HELLO_SHM;
+
+	rc = srs_client_send(client, SRS_GPS_HELLO, &hello, sizeof(hello));
+	if (rc < 0)
+		goto error;
+
+	timeout.tv_sec = (SRS_CLIENT_TIMEOUT - SRS_CLIENT_TIMEOUT % 1000000) / 1000000;
+	timeout.tv_usec = SRS_CLIENT_TIMEOUT % 1000000;
+
+	FD_ZERO(&fds);
+	FD_SET(client->fd, &fds);
+
+	rc = select(client->fd + 1, &fds, NULL, NULL, &timeout);
+	if (rc <= 0 || !FD_ISSET(client->fd, &fds))
+		goto error;
+
+	memset(&iov, 0, sizeof(iov));
+	iov.iov_base = data;
+	iov.iov_len = sizeof(data);
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	SRS_CLIENT_LOCK(client);
+	rc = recvmsg(client->fd, &msg, MSG_WAITALL);
+	SRS_CLIENT_UNLOCK(client);
+
+	if (rc != sizeof(data))
+		goto error;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+			memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+	}
+
+	header = (struct srs_header *) data;
+	hello_p = (struct srs_gps_hello_packet *) (data + sizeof(struct srs_header));
+
+	if (SRS_COMMAND(header) != SRS_GPS_HELLO || !(hello_p->flags & SRS_GPS_HELLO_SHM) || fd < 0)
+		goto error;
+
+	if (hello_p->shm_size < sizeof(struct srs_gps_shm))
+		goto error;
+
+	shm = mmap(NULL, sizeof(struct srs_gps_shm), PROT_READ, MAP_SHARED, fd, 0);
+	if (shm == MAP_FAILED)
+		goto error;
+
+	close(fd);
+
+	if (shm->magic != SRS_GPS_SHM_MAGIC || shm->version != SRS_GPS_SHM_VERSION) {
+		munmap(shm, sizeof(struct srs_gps_shm));
+		return -1;
+	}
+
+	*shm_p = shm;
+
+	return 0;
+
+error:
+	if (fd >= 0)
+		close(fd);
+
+	return -1;
+}
+
+/*
+ * Copies a consistent snapshot of the shared GPS data, without any syscall.
+ */
+int srs_client_gps_shm_read(struct srs_gps_shm *shm, struct srs_gps_shm *copy)
+{
+	uint32_t sequence;
+	int i;
+
+	if (shm == NULL || copy == NULL)
+		return -EINVAL;
+
+	for (i = 0; i < SRS_CLIENT_GPS_SHM_RETRIES; i++) {
+		sequence = shm->sequence;
+		if (sequence & 1)
+			continue;
+
+		__sync_synchronize();
+		memcpy(copy, shm, sizeof(struct srs_gps_shm));
+		__sync_synchronize();
+
+		if (shm->sequence == sequence)
+			return 0;
+	}
+
+	return -1;
+}
+
+int srs_client_gps_shm_close(struct srs_gps_shm *shm)
+{
+	if (shm == NULL)
+		return -EINVAL;
+
+	return munmap(shm, sizeof(struct srs_gps_shm));
+}
@@ -0,0 +1,125 @@
+/**
+ * This file is part of libmocha-ipc.
+ *
+ * libmocha-ipc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libmocha-ipc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libmocha-ipc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <radio.h>
+
+#include "test.h"
+
+static void bcd_test_round_trip(const char *digits)
+{
+	uint8_t bcd[16];
+	char ascii[33];
+	int length = strlen(digits);
+	int rc;
+
+	rc = ascii2bcd(bcd, digits, length, sizeof(bcd));
+	test_check(rc == (length + 1) / 2);
+	if (rc < 0)
+		return;
+
+	rc = bcd2ascii(ascii, bcd, rc);
+	test_check(rc == length);
+	test_check(strcmp(ascii, digits) == 0);
+}
+
+static void bcd_test_encode(void)
+{
+	const uint8_t even[] = { 0x21, 0x43 };
+	const uint8_t odd[] = { 0x21, 0xF3 };
+	const uint8_t signs[] = { 0xBA, 0xF1 };
+	uint8_t bcd[4];
+
+	// Swapped semi-octets
+	memset(bcd, 0, sizeof(bcd));
+	test_check(ascii2bcd(bcd, "1234", 4, sizeof(bcd)) == 2);
+	test_check(memcmp(bcd, even, sizeof(even)) == 0);
+
+	// Odd lengths end with the 0xF filler
+	memset(bcd, 0, sizeof(bcd));
+	test_check(ascii2bcd(bcd, "123", 3, sizeof(bcd)) == 2);
+	test_check(memcmp(bcd, odd, sizeof(odd)) == 0);
+
+	memset(bcd, 0, sizeof(bcd));
+	test_check(ascii2bcd(bcd, "*#1", 3, sizeof(bcd)) == 2);
+	test_check(memcmp(bcd, signs, sizeof(signs)) == 0);
+
+	test_check(ascii2bcd(bcd, "", 0, sizeof(bcd)) == 0);
+}
+
+static void bcd_test_decode(void)
+{
+	const uint8_t filler[] = { 0x21, 0xF3, 0x54 };
+	const uint8_t end[] = { 0x21, 0xE3 };
+	const uint8_t low[] = { 0xF1 };
+	char ascii[8];
+
+	// Decoding stops at the filler
+	test_check(bcd2ascii(ascii, filler, sizeof(filler)) == 3);
+	test_check(strcmp(ascii, "123") == 0);
+
+	test_check(bcd2ascii(ascii, end, sizeof(end)) == 3);
+	test_check(strcmp(ascii, "123") == 0);
+
+	test_check(bcd2ascii(ascii, low, sizeof(low)) == 1);
+	test_check(strcmp(ascii, "1") == 0);
+
+	test_check(bcd2ascii(ascii, low, 0) == 0);
+	test_check(ascii[0] == '\0');
+
+	test_check(bcddigit2ascii(0xA) == '*');
+	test_check(bcddigit2ascii(0xB) == '#');
+	test_check(bcddigit2ascii(0xF) == '\0');
+}
+
+static void bcd_test_errors(void)
+{
+	uint8_t bcd[4];
+
+	// A short output buffer is not written past
+	memset(bcd, 0x5A, sizeof(bcd));
+	test_check(ascii2bcd(bcd, "12345", 5, 2) == -1);
+	test_check(bcd[2] == 0x5A && bcd[3] == 0x5A);
+
+	test_check(ascii2bcd(bcd, "1234", 4, 2) == 2);
+	test_check(bcd[2] == 0x5A);
+
+	// '+' belongs to the type of number, callers strip it
+	test_check(ascii2bcd(bcd, "+12", 3, sizeof(bcd)) == -1);
+	test_check(ascii2bcd(bcd, "12a", 3, sizeof(bcd)) == -1);
+}
+
+int main(int argc, char *argv[])
+{
+	bcd_test_round_trip("1");
+	bcd_test_round_trip("12");
+	bcd_test_round_trip("123");
+	bcd_test_round_trip("31612345678");
+	bcd_test_round_trip("*100#");
+	bcd_test_round_trip("#31#0612");
+	bcd_test_round_trip("12P34?5");
+	bcd_test_round_trip("0123456789012345678");
+
+	bcd_test_encode();
+	bcd_test_decode();
+	bcd_test_errors();
+
+	return test_result("bcd_test");
+}
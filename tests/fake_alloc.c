@@ -0,0 +1,67 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fake_ril.h"
+
+/*
+ * Counts the heap allocations made by the objects linked with
+ * -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=strdup
+ */
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *p, size_t size);
+char *__real_strdup(const char *s);
+
+static unsigned int fake_alloc_counter;
+
+unsigned int fake_alloc_count(void)
+{
+	return __sync_fetch_and_add(&fake_alloc_counter, 0);
+}
+
+void *__wrap_malloc(size_t size)
+{
+	__sync_fetch_and_add(&fake_alloc_counter, 1);
+
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+	__sync_fetch_and_add(&fake_alloc_counter, 1);
+
+	return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+	__sync_fetch_and_add(&fake_alloc_counter, 1);
+
+	return __real_realloc(p, size);
+}
+
+char *__wrap_strdup(const char *s)
+{
+	__sync_fetch_and_add(&fake_alloc_counter, 1);
+
+	return __real_strdup(s);
+}
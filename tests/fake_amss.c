@@ -0,0 +1,148 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#define LOG_TAG "RIL-Mocha-Fake-AMSS"
+#include <utils/Log.h>
+
+#include <radio.h>
+#include <tapi.h>
+#include <tapi_nettext.h>
+
+#include "fake_modem.h"
+#include "fake_amss.h"
+
+static struct {
+	pthread_mutex_t mutex;
+	unsigned int send_delay;
+	struct fake_amss_stats stats;
+} fake_amss = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static int fake_amss_queue(uint16_t function, void *data, size_t length, unsigned int delay)
+{
+	uint8_t frame[sizeof(struct tapiPacketHeader) + sizeof(tapiNettextInfo)];
+	struct tapiPacketHeader *header;
+
+	if (length > sizeof(frame) - sizeof(struct tapiPacketHeader))
+		return -1;
+
+	header = (struct tapiPacketHeader *) frame;
+	header->tapiService = TAPI_TYPE_NETTEXT;
+	header->tapiServiceFunction = function;
+	header->len = length;
+	memcpy(frame + sizeof(struct tapiPacketHeader), data, length);
+
+	return fake_modem_queue(FIFO_PKT_TAPI, frame, sizeof(struct tapiPacketHeader) + length, delay);
+}
+
+/*
+ * Called with RIL_LOCK held, from ipc_send: only queues the answers.
+ */
+static void fake_amss_tapi(struct modem_io *frame)
+{
+	struct tapiPacketHeader *header;
+	tapiNettextInfo *info;
+	tapiNettextCallBack callback;
+
+	if (frame->datasize < sizeof(struct tapiPacketHeader))
+		return;
+
+	header = (struct tapiPacketHeader *) frame->data;
+
+	// Acks of our own frames and other services
+	if (header->tapiService != TAPI_TYPE_NETTEXT)
+		return;
+
+	switch (header->tapiServiceFunction) {
+		case TAPI_NETTEXT_SEND:
+			if (frame->datasize < sizeof(struct tapiPacketHeader) + sizeof(tapiNettextInfo))
+				return;
+
+			info = (tapiNettextInfo *) (frame->data + sizeof(struct tapiPacketHeader));
+
+			memset(&callback, 0, sizeof(callback));
+			callback.unknown1 = info->hNetTextInfo;
+			callback.status = 0;
+
+			pthread_mutex_lock(&fake_amss.mutex);
+			fake_amss.stats.sent++;
+			pthread_mutex_unlock(&fake_amss.mutex);
+
+			if (fake_amss_queue(TAPI_NETTEXT_SEND_CALLBACK, &callback, sizeof(callback), fake_amss.send_delay) < 0) {
+				ALOGE("%s: Unable to queue the send callback", __func__);
+				return;
+			}
+
+			pthread_mutex_lock(&fake_amss.mutex);
+			fake_amss.stats.acked++;
+			pthread_mutex_unlock(&fake_amss.mutex);
+			break;
+		case TAPI_NETTEXT_SET_BURST:
+			pthread_mutex_lock(&fake_amss.mutex);
+			fake_amss.stats.bursts++;
+			pthread_mutex_unlock(&fake_amss.mutex);
+			break;
+		default:
+			break;
+	}
+}
+
+void fake_amss_init(unsigned int send_delay)
+{
+	pthread_mutex_lock(&fake_amss.mutex);
+	fake_amss.send_delay = send_delay;
+	memset(&fake_amss.stats, 0, sizeof(fake_amss.stats));
+	pthread_mutex_unlock(&fake_amss.mutex);
+
+	fake_modem_register(FIFO_PKT_TAPI, fake_amss_tapi);
+}
+
+/*
+ * Delivers a message to the RIL delay us from now.
+ */
+int fake_amss_incoming(tapiNettextInfo *info, unsigned int delay)
+{
+	int rc;
+
+	if (info == NULL)
+		return -1;
+
+	rc = fake_amss_queue(TAPI_NETTEXT_INCOMING, info, sizeof(tapiNettextInfo), delay);
+	if (rc < 0)
+		return -1;
+
+	pthread_mutex_lock(&fake_amss.mutex);
+	fake_amss.stats.incoming++;
+	pthread_mutex_unlock(&fake_amss.mutex);
+
+	return 0;
+}
+
+void fake_amss_stats(struct fake_amss_stats *stats)
+{
+	if (stats == NULL)
+		return;
+
+	pthread_mutex_lock(&fake_amss.mutex);
+	memcpy(stats, &fake_amss.stats, sizeof(struct fake_amss_stats));
+	pthread_mutex_unlock(&fake_amss.mutex);
+}
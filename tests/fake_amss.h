@@ -0,0 +1,41 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FAKE_AMSS_H_
+#define _FAKE_AMSS_H_
+
+#include <tapi_nettext.h>
+
+/*
+ * AMSS nettext stand-in on the fake modem: acknowledges each
+ * TAPI_NETTEXT_SEND after send_delay us with TAPI_NETTEXT_SEND_CALLBACK,
+ * and delivers incoming messages as TAPI_NETTEXT_INCOMING.
+ */
+
+struct fake_amss_stats {
+	unsigned int sent;
+	unsigned int acked;
+	unsigned int incoming;
+	unsigned int bursts;
+};
+
+void fake_amss_init(unsigned int send_delay);
+int fake_amss_incoming(tapiNettextInfo *info, unsigned int delay);
+void fake_amss_stats(struct fake_amss_stats *stats);
+
+#endif
@@ -0,0 +1,285 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <pthread.h>
+#include <sys/time.h>
+
+#define LOG_TAG "RIL-Mocha-Fake-Modem"
+#include <utils/Log.h>
+
+#include "mocha-ril.h"
+#include "ipc_private.h"
+#include "fake_modem.h"
+
+/*
+ * Frames are kept in fixed slots, so that the transport itself does not
+ * show up in the allocation counts. The queue holds slot numbers sorted
+ * by delivery time, frames due at the same time keep their order.
+ */
+
+struct fake_modem_frame {
+	struct timeval time;
+	int cmd;
+	size_t size;
+	uint8_t data[FAKE_MODEM_FRAME_SIZE];
+};
+
+static struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	fake_modem_peer peers[FAKE_MODEM_PEERS];
+	struct fake_modem_frame frames[FAKE_MODEM_FRAMES];
+	int queue[FAKE_MODEM_FRAMES];
+	int queue_count;
+	int free[FAKE_MODEM_FRAMES];
+	int free_count;
+	int dispatching;
+	struct fake_modem_stats stats;
+} fake_modem = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.free_count = -1,
+};
+
+static void fake_modem_log_handler(const char *message, void *user_data)
+{
+	ALOGD("ipc: %s", message);
+}
+
+static struct ipc_client fake_modem_ipc_client = {
+	.log_handler = fake_modem_log_handler,
+};
+
+static struct ipc_client_data fake_modem_client_data = {
+	.ipc_client = &fake_modem_ipc_client,
+	.ipc_client_fd = -1,
+};
+
+unsigned long long fake_modem_time(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+
+	return (unsigned long long) now.tv_sec * 1000000 + now.tv_usec;
+}
+
+void fake_modem_register(int cmd, fake_modem_peer peer)
+{
+	if (cmd < 0 || cmd >= FAKE_MODEM_PEERS)
+		return;
+
+	pthread_mutex_lock(&fake_modem.mutex);
+	fake_modem.peers[cmd] = peer;
+	pthread_mutex_unlock(&fake_modem.mutex);
+}
+
+/*
+ * Queues a frame from the modem, dispatched delay us from now.
+ */
+int fake_modem_queue(int cmd, void *data, size_t size, unsigned int delay)
+{
+	struct fake_modem_frame *frame;
+	struct timeval now, offset;
+	int slot;
+	int i;
+
+	if (size > FAKE_MODEM_FRAME_SIZE || (data == NULL && size > 0))
+		return -1;
+
+	pthread_mutex_lock(&fake_modem.mutex);
+
+	if (fake_modem.free_count < 0) {
+		for (i = 0 ; i < FAKE_MODEM_FRAMES ; i++)
+			fake_modem.free[i] = i;
+		fake_modem.free_count = FAKE_MODEM_FRAMES;
+	}
+
+	if (fake_modem.free_count == 0) {
+		fake_modem.stats.dropped++;
+		pthread_mutex_unlock(&fake_modem.mutex);
+		return -1;
+	}
+
+	slot = fake_modem.free[--fake_modem.free_count];
+	frame = &fake_modem.frames[slot];
+
+	gettimeofday(&now, NULL);
+	offset.tv_sec = delay / 1000000;
+	offset.tv_usec = delay % 1000000;
+	timeradd(&now, &offset, &frame->time);
+
+	frame->cmd = cmd;
+	frame->size = size;
+	if (size > 0)
+		memcpy(frame->data, data, size);
+
+	for (i = fake_modem.queue_count ; i > 0 ; i--) {
+		if (!timercmp(&fake_modem.frames[fake_modem.queue[i - 1]].time, &frame->time, >))
+			break;
+		fake_modem.queue[i] = fake_modem.queue[i - 1];
+	}
+
+	fake_modem.queue[i] = slot;
+	fake_modem.queue_count++;
+	if ((unsigned int) fake_modem.queue_count > fake_modem.stats.depth_max)
+		fake_modem.stats.depth_max = fake_modem.queue_count;
+
+	pthread_cond_broadcast(&fake_modem.cond);
+	pthread_mutex_unlock(&fake_modem.mutex);
+
+	return 0;
+}
+
+/*
+ * Waits until every queued frame has been dispatched.
+ */
+void fake_modem_wait_idle(void)
+{
+	pthread_mutex_lock(&fake_modem.mutex);
+
+	while (fake_modem.queue_count > 0 || fake_modem.dispatching)
+		pthread_cond_wait(&fake_modem.cond, &fake_modem.mutex);
+
+	pthread_mutex_unlock(&fake_modem.mutex);
+}
+
+void fake_modem_stats(struct fake_modem_stats *stats)
+{
+	if (stats == NULL)
+		return;
+
+	pthread_mutex_lock(&fake_modem.mutex);
+	memcpy(stats, &fake_modem.stats, sizeof(struct fake_modem_stats));
+	pthread_mutex_unlock(&fake_modem.mutex);
+}
+
+/*
+ * Transport functions mocha-ipc calls with RIL_SHLIB
+ */
+
+void ipc_send(struct modem_io *request)
+{
+	fake_modem_peer peer = NULL;
+
+	if (request == NULL)
+		return;
+
+	pthread_mutex_lock(&fake_modem.mutex);
+	fake_modem.stats.sent++;
+	if (request->cmd < FAKE_MODEM_PEERS)
+		peer = fake_modem.peers[request->cmd];
+	pthread_mutex_unlock(&fake_modem.mutex);
+
+	// Called with RIL_LOCK held: peers only queue their answers
+	if (peer != NULL)
+		peer(request);
+}
+
+int ipc_modem_io(void *data, uint32_t cmd)
+{
+	return 0;
+}
+
+void wave_ipc_register(void)
+{
+}
+
+void jet_ipc_register(void)
+{
+}
+
+/*
+ * IPC client, in place of the one in mocha-ril/ipc.c
+ */
+
+static int fake_modem_create(struct ril_client *client)
+{
+	client->data = &fake_modem_client_data;
+
+	return 0;
+}
+
+static int fake_modem_destroy(struct ril_client *client)
+{
+	client->data = NULL;
+
+	return 0;
+}
+
+static int fake_modem_read_loop(struct ril_client *client)
+{
+	struct fake_modem_frame *frame;
+	struct modem_io resp;
+	struct timeval now;
+	struct timespec timeout;
+	int slot;
+
+	pthread_mutex_lock(&fake_modem.mutex);
+
+	while (1) {
+		if (fake_modem.queue_count == 0) {
+			pthread_cond_wait(&fake_modem.cond, &fake_modem.mutex);
+			continue;
+		}
+
+		slot = fake_modem.queue[0];
+		frame = &fake_modem.frames[slot];
+
+		gettimeofday(&now, NULL);
+		if (timercmp(&now, &frame->time, <)) {
+			timeout.tv_sec = frame->time.tv_sec;
+			timeout.tv_nsec = frame->time.tv_usec * 1000;
+			pthread_cond_timedwait(&fake_modem.cond, &fake_modem.mutex, &timeout);
+			continue;
+		}
+
+		fake_modem.queue_count--;
+		memmove(fake_modem.queue, fake_modem.queue + 1, fake_modem.queue_count * sizeof(int));
+		fake_modem.dispatching = 1;
+
+		pthread_mutex_unlock(&fake_modem.mutex);
+
+		resp.magic = 0xCAFECAFE;
+		resp.cmd = frame->cmd;
+		resp.datasize = frame->size;
+		resp.data = frame->data;
+
+		RIL_LOCK();
+		ipc_dispatch(&fake_modem_ipc_client, &resp);
+		RIL_UNLOCK();
+
+		pthread_mutex_lock(&fake_modem.mutex);
+
+		fake_modem.free[fake_modem.free_count++] = slot;
+		fake_modem.stats.received++;
+		fake_modem.dispatching = 0;
+
+		pthread_cond_broadcast(&fake_modem.cond);
+	}
+
+	pthread_mutex_unlock(&fake_modem.mutex);
+
+	return 0;
+}
+
+struct ril_client_funcs ipc_client_funcs = {
+	.create = fake_modem_create,
+	.destroy = fake_modem_destroy,
+	.read_loop = fake_modem_read_loop,
+};
@@ -0,0 +1,54 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FAKE_MODEM_H_
+#define _FAKE_MODEM_H_
+
+#include <stdint.h>
+#include <sys/time.h>
+
+#include <radio.h>
+
+/*
+ * Fake modem transport, linked in place of mocha-ril/ipc.c and the device
+ * handlers. Frames the RIL sends go to the peer registered for their
+ * FIFO packet type, frames the peers queue are dispatched by the IPC
+ * client thread, under RIL_LOCK like ipc_read_loop does.
+ */
+
+#define FAKE_MODEM_FRAMES		256
+#define FAKE_MODEM_FRAME_SIZE		2048
+#define FAKE_MODEM_PEERS		64
+
+typedef void (*fake_modem_peer)(struct modem_io *frame);
+
+struct fake_modem_stats {
+	unsigned int sent;
+	unsigned int received;
+	unsigned int dropped;
+	unsigned int depth_max;
+};
+
+void fake_modem_register(int cmd, fake_modem_peer peer);
+int fake_modem_queue(int cmd, void *data, size_t size, unsigned int delay);
+void fake_modem_wait_idle(void);
+void fake_modem_stats(struct fake_modem_stats *stats);
+
+unsigned long long fake_modem_time(void);
+
+#endif
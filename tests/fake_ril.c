@@ -0,0 +1,242 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define LOG_TAG "RIL-Mocha-Fake-RIL"
+#include <utils/Log.h>
+
+#include "mocha-ril.h"
+#include "fake_ril.h"
+
+struct fake_ril_callback {
+	struct timeval time;
+	RIL_TimedCallback callback;
+	void *data;
+};
+
+static struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_t thread;
+	struct fake_ril_callback callbacks[FAKE_RIL_CALLBACKS];
+	int count;
+	struct fake_ril_handlers *handlers;
+	const RIL_RadioFunctions *ops;
+	char data_path[RIL_DATA_PATH_SIZE];
+} fake_ril = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void fake_ril_on_request_complete(RIL_Token t, RIL_Errno e, void *data, size_t length)
+{
+	if (fake_ril.handlers != NULL && fake_ril.handlers->complete != NULL)
+		fake_ril.handlers->complete(t, e, data, length);
+}
+
+static void fake_ril_on_unsolicited_response(int request, const void *data, size_t length)
+{
+	if (fake_ril.handlers != NULL && fake_ril.handlers->unsolicited != NULL)
+		fake_ril.handlers->unsolicited(request, data, length);
+}
+
+/*
+ * Callbacks are sorted by time, those due at the same time keep their
+ * order, like in the rild event loop.
+ */
+static void *fake_ril_request_timed_callback(RIL_TimedCallback callback, void *data, const struct timeval *time)
+{
+	struct timeval now, due;
+	int i;
+
+	gettimeofday(&now, NULL);
+	if (time != NULL)
+		timeradd(&now, time, &due);
+	else
+		due = now;
+
+	pthread_mutex_lock(&fake_ril.mutex);
+
+	if (fake_ril.count >= FAKE_RIL_CALLBACKS) {
+		ALOGE("%s: Too many timed callbacks", __func__);
+		pthread_mutex_unlock(&fake_ril.mutex);
+		return NULL;
+	}
+
+	for (i = fake_ril.count ; i > 0 ; i--) {
+		if (!timercmp(&fake_ril.callbacks[i - 1].time, &due, >))
+			break;
+		fake_ril.callbacks[i] = fake_ril.callbacks[i - 1];
+	}
+
+	fake_ril.callbacks[i].time = due;
+	fake_ril.callbacks[i].callback = callback;
+	fake_ril.callbacks[i].data = data;
+	fake_ril.count++;
+
+	pthread_cond_signal(&fake_ril.cond);
+	pthread_mutex_unlock(&fake_ril.mutex);
+
+	return NULL;
+}
+
+static void *fake_ril_thread(void *data)
+{
+	struct fake_ril_callback callback;
+	struct timeval now;
+	struct timespec timeout;
+
+	pthread_mutex_lock(&fake_ril.mutex);
+
+	while (1) {
+		if (fake_ril.count == 0) {
+			pthread_cond_wait(&fake_ril.cond, &fake_ril.mutex);
+			continue;
+		}
+
+		gettimeofday(&now, NULL);
+		if (timercmp(&now, &fake_ril.callbacks[0].time, <)) {
+			timeout.tv_sec = fake_ril.callbacks[0].time.tv_sec;
+			timeout.tv_nsec = fake_ril.callbacks[0].time.tv_usec * 1000;
+			pthread_cond_timedwait(&fake_ril.cond, &fake_ril.mutex, &timeout);
+			continue;
+		}
+
+		callback = fake_ril.callbacks[0];
+		fake_ril.count--;
+		memmove(fake_ril.callbacks, fake_ril.callbacks + 1,
+			fake_ril.count * sizeof(struct fake_ril_callback));
+
+		pthread_mutex_unlock(&fake_ril.mutex);
+
+		// Timed callbacks take RIL_LOCK themselves
+		callback.callback(callback.data);
+
+		pthread_mutex_lock(&fake_ril.mutex);
+	}
+
+	pthread_mutex_unlock(&fake_ril.mutex);
+
+	return NULL;
+}
+
+static const struct RIL_Env fake_ril_env = {
+	.OnRequestComplete = fake_ril_on_request_complete,
+	.OnUnsolicitedResponse = fake_ril_on_unsolicited_response,
+	.RequestTimedCallback = fake_ril_request_timed_callback,
+};
+
+/*
+ * The RIL keeps its configuration and SMS outbox in a directory of its
+ * own, removed on exit, rather than in the one of the installed RIL.
+ */
+static void fake_ril_data_remove(void)
+{
+	char path[RIL_DATA_PATH_SIZE * 2];
+	struct dirent *entry;
+	DIR *dir;
+
+	dir = opendir(fake_ril.data_path);
+	if (dir == NULL)
+		return;
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", fake_ril.data_path, entry->d_name);
+		unlink(path);
+	}
+
+	closedir(dir);
+	rmdir(fake_ril.data_path);
+}
+
+static int fake_ril_data_create(void)
+{
+	const char *tmp;
+
+	tmp = getenv("TMPDIR");
+	if (tmp == NULL || tmp[0] == '\0')
+		tmp = FAKE_RIL_TMP_PATH;
+
+	snprintf(fake_ril.data_path, sizeof(fake_ril.data_path), "%s/mocha-ril.XXXXXX", tmp);
+	if (mkdtemp(fake_ril.data_path) == NULL) {
+		ALOGE("%s: Unable to create a directory in %s", __func__, tmp);
+		return -1;
+	}
+
+	atexit(fake_ril_data_remove);
+
+	return 0;
+}
+
+const RIL_RadioFunctions *fake_ril_init(struct fake_ril_handlers *handlers)
+{
+	pthread_attr_t attr;
+	char *argv[3];
+	int rc;
+
+	fake_ril.handlers = handlers;
+
+	rc = fake_ril_data_create();
+	if (rc < 0)
+		return NULL;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	rc = pthread_create(&fake_ril.thread, &attr, fake_ril_thread, NULL);
+	if (rc != 0) {
+		ALOGE("%s: pthread creation failed", __func__);
+		return NULL;
+	}
+
+	argv[0] = "mocha-ril";
+	argv[1] = "-d";
+	argv[2] = fake_ril.data_path;
+
+	fake_ril.ops = RIL_Init(&fake_ril_env, 3, argv);
+
+	return fake_ril.ops;
+}
+
+void fake_ril_request(int request, void *data, size_t length, RIL_Token t)
+{
+	if (fake_ril.ops == NULL)
+		return;
+
+	fake_ril.ops->onRequest(request, data, length, t);
+}
+
+/*
+ * From libnetutils, which the tests don't link: there are no data calls on
+ * the fake modem.
+ */
+int ifc_configure(const char *ifname, in_addr_t address, in_addr_t netmask,
+	in_addr_t gateway, in_addr_t dns1, in_addr_t dns2)
+{
+	return -1;
+}
@@ -0,0 +1,43 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FAKE_RIL_H_
+#define _FAKE_RIL_H_
+
+#include <telephony/ril.h>
+
+/*
+ * Fake RIL_Env, standing for rild: responses and unsolicited responses
+ * go to the harness handlers, timed callbacks run on their own thread.
+ */
+
+#define FAKE_RIL_CALLBACKS		64
+#define FAKE_RIL_TMP_PATH		"/data/local/tmp"
+
+struct fake_ril_handlers {
+	void (*complete)(RIL_Token t, RIL_Errno e, void *data, size_t length);
+	void (*unsolicited)(int request, const void *data, size_t length);
+};
+
+const RIL_RadioFunctions *fake_ril_init(struct fake_ril_handlers *handlers);
+void fake_ril_request(int request, void *data, size_t length, RIL_Token t);
+
+/* Allocation counts, when linked with fake_alloc.c */
+unsigned int fake_alloc_count(void);
+
+#endif
@@ -0,0 +1,650 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_TAG "RIL-Mocha-Fake-SIM"
+#include <utils/Log.h>
+
+#include <radio.h>
+#include <sim.h>
+
+#include "hex.h"
+
+#include "fake_modem.h"
+#include "fake_sim.h"
+
+/* File structures as in fileInfoEvent, one more than in TS 11.11 */
+#define FAKE_SIM_TRANSPARENT		1
+#define FAKE_SIM_LINEAR_FIXED		2
+#define FAKE_SIM_CYCLIC			4
+
+/* SIM_EVENT_SIM_OPEN buffer, the IMSI is read at fixed offsets in it */
+#define FAKE_SIM_OPEN_SIZE		0x473
+#define FAKE_SIM_OPEN_IMSI_LENGTH	0xAE
+#define FAKE_SIM_OPEN_IMSI		0xB2
+
+#define FAKE_SIM_EF_IMSI		0x6F07
+
+struct fake_sim_file {
+	uint16_t fileid;
+	uint8_t structure;
+	int record_size;
+	int records;
+	int size;
+	uint8_t *data;
+};
+
+static struct {
+	pthread_mutex_t mutex;
+	struct fake_sim_file files[FAKE_SIM_FILES];
+	int files_count;
+	uint8_t data[FAKE_SIM_DATA_SIZE];
+	size_t data_used;
+	unsigned int latency[FAKE_SIM_REQUESTS];
+	unsigned long long busy_until;
+	int inserted;
+	int open_pending;
+	uint32_t open_sid;
+	uint8_t open_request;
+	struct fake_sim_stats stats;
+} fake_sim = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static struct fake_sim_file *fake_sim_file_find(uint16_t fileid)
+{
+	int i;
+
+	for (i = 0 ; i < fake_sim.files_count ; i++)
+		if (fake_sim.files[i].fileid == fileid)
+			return &fake_sim.files[i];
+
+	return NULL;
+}
+
+/*
+ * Queues an event for a request, once the card is done with the ones
+ * before it. Called with the fake SIM mutex held.
+ */
+static int fake_sim_answer(uint32_t sid, uint8_t request, uint8_t event, uint8_t status,
+	void *data, size_t length)
+{
+	uint8_t frame[FAKE_MODEM_FRAME_SIZE];
+	struct simPacketHeader *header;
+	simEventPacketHeader *event_header;
+	unsigned long long now;
+	unsigned int latency;
+	int rc;
+
+	if (length > sizeof(frame) - sizeof(struct simPacketHeader) - sizeof(simEventPacketHeader))
+		return -1;
+
+	header = (struct simPacketHeader *) frame;
+	header->type = 0;
+	header->subType = SIM_SUBTYPE_DIFF + request;
+	header->bufLen = sizeof(simEventPacketHeader) + length;
+
+	event_header = (simEventPacketHeader *) (frame + sizeof(struct simPacketHeader));
+	event_header->sid = sid;
+	event_header->eventType = event;
+	event_header->eventStatus = status;
+	event_header->unused = request;
+	event_header->bufLen = length;
+
+	if (length > 0)
+		memcpy(frame + sizeof(struct simPacketHeader) + sizeof(simEventPacketHeader), data, length);
+
+	latency = request < FAKE_SIM_REQUESTS ? fake_sim.latency[request] : 0;
+
+	now = fake_modem_time();
+	if (fake_sim.busy_until < now)
+		fake_sim.busy_until = now;
+	fake_sim.busy_until += latency;
+	fake_sim.stats.busy += latency;
+
+	rc = fake_modem_queue(FIFO_PKT_SIM, frame, sizeof(struct simPacketHeader) + header->bufLen,
+		fake_sim.busy_until - now);
+	if (rc < 0) {
+		ALOGE("%s: Unable to queue event %d", __func__, event);
+		return -1;
+	}
+
+	fake_sim.stats.answered++;
+	if (status == SIM_FILE_NOT_FOUND)
+		fake_sim.stats.not_found++;
+
+	return 0;
+}
+
+static void fake_sim_open(uint32_t sid, uint8_t request)
+{
+	uint8_t open[FAKE_SIM_OPEN_SIZE];
+	struct fake_sim_file *imsi;
+	uint8_t event;
+
+	memset(open, 0, sizeof(open));
+
+	// Offsets are from the start of the event header
+	imsi = fake_sim_file_find(FAKE_SIM_EF_IMSI);
+	if (imsi != NULL && imsi->size <= FAKE_SIM_OPEN_SIZE - FAKE_SIM_OPEN_IMSI) {
+		open[FAKE_SIM_OPEN_IMSI_LENGTH - sizeof(simEventPacketHeader)] = imsi->size;
+		memcpy(open + FAKE_SIM_OPEN_IMSI - sizeof(simEventPacketHeader), imsi->data, imsi->size);
+	}
+
+	event = request == SIM_OEM_REQUEST_OPEN ? SIM_EVENT_SIM_OPEN : SIM_EVENT_GET_SIM_OPEN_DATA;
+
+	fake_sim_answer(sid, request, event, SIM_OK, open, sizeof(open));
+}
+
+static void fake_sim_file_info(uint32_t sid, uint8_t *data, size_t length)
+{
+	struct fake_sim_file *file;
+	fileInfoEvent info;
+	uint16_t fileid;
+
+	if (length < sizeof(fileid))
+		return;
+
+	memcpy(&fileid, data, sizeof(fileid));
+
+	memset(&info, 0, sizeof(info));
+	info.fileId = fileid;
+
+	file = fake_sim_file_find(fileid);
+	if (file == NULL) {
+		fake_sim_answer(sid, SIM_OEM_REQUEST_GET_FILE_INFO, SIM_EVENT_FILE_INFO,
+			SIM_FILE_NOT_FOUND, &info, sizeof(info));
+		return;
+	}
+
+	info.fileStructure = file->structure;
+	info.recordSize = file->record_size;
+	info.recordCount = file->records;
+	info.fileSize = file->size;
+
+	fake_sim_answer(sid, SIM_OEM_REQUEST_GET_FILE_INFO, SIM_EVENT_FILE_INFO,
+		SIM_OK, &info, sizeof(info));
+}
+
+/*
+ * Binary reads start at the beginning of the file: the request has no
+ * offset.
+ */
+static void fake_sim_read(uint32_t sid, uint8_t request, uint8_t *data, size_t length)
+{
+	uint8_t response[sizeof(simDataResponse) + 256];
+	simDataResponse *header;
+	simDataRequest sim_data;
+	struct fake_sim_file *file;
+	uint8_t status = SIM_OK;
+	uint8_t *p = NULL;
+	int size = 0;
+
+	if (length < sizeof(sim_data))
+		return;
+
+	memcpy(&sim_data, data, sizeof(sim_data));
+
+	file = fake_sim_file_find(sim_data.fileId);
+	if (file == NULL) {
+		status = SIM_FILE_NOT_FOUND;
+		goto complete;
+	}
+
+	if (request == SIM_OEM_REQUEST_READ_FILE_RECORD) {
+		if (file->structure == FAKE_SIM_TRANSPARENT ||
+			sim_data.recordIndex < 1 || sim_data.recordIndex > (uint32_t) file->records) {
+			status = SIM_INCORRECT_PARAMS;
+			goto complete;
+		}
+
+		p = file->data + (sim_data.recordIndex - 1) * file->record_size;
+		size = file->record_size;
+	} else {
+		if (file->structure != FAKE_SIM_TRANSPARENT) {
+			status = SIM_INCORRECT_PARAMS;
+			goto complete;
+		}
+
+		p = file->data;
+		size = sim_data.size > 0 && sim_data.size < file->size ? sim_data.size : file->size;
+	}
+
+	if (size > 256)
+		size = 256;
+
+complete:
+	header = (simDataResponse *) response;
+	header->fileId = sim_data.fileId;
+	header->bufLen = status == SIM_OK ? size : 0;
+
+	if (status == SIM_OK)
+		memcpy(response + sizeof(simDataResponse), p, size);
+
+	fake_sim_answer(sid, request, SIM_EVENT_READ_FILE, status,
+		response, sizeof(simDataResponse) + header->bufLen);
+}
+
+static void fake_sim_update(uint32_t sid, uint8_t request, uint8_t *data, size_t length)
+{
+	simDataResponse response;
+	simUpdateFile sim_data;
+	struct fake_sim_file *file;
+	uint8_t status = SIM_OK;
+	uint8_t *p;
+	int size;
+
+	if (length < sizeof(sim_data))
+		return;
+
+	memcpy(&sim_data, data, sizeof(sim_data));
+
+	file = fake_sim_file_find(sim_data.fileId);
+	if (file == NULL) {
+		status = SIM_FILE_NOT_FOUND;
+		goto complete;
+	}
+
+	if (sim_data.bufLen > length - sizeof(sim_data)) {
+		status = SIM_INCORRECT_PARAMS;
+		goto complete;
+	}
+
+	if (request == SIM_OEM_REQUEST_UPDATE_FILE_RECORD) {
+		if (file->structure == FAKE_SIM_TRANSPARENT ||
+			sim_data.recordIndex < 1 || sim_data.recordIndex > (uint32_t) file->records ||
+			sim_data.bufLen != (uint32_t) file->record_size) {
+			status = SIM_INCORRECT_PARAMS;
+			goto complete;
+		}
+
+		p = file->data + (sim_data.recordIndex - 1) * file->record_size;
+		size = file->record_size;
+	} else {
+		if (file->structure != FAKE_SIM_TRANSPARENT || sim_data.bufLen > (uint32_t) file->size) {
+			status = SIM_INCORRECT_PARAMS;
+			goto complete;
+		}
+
+		p = file->data;
+		size = sim_data.bufLen;
+	}
+
+	memcpy(p, data + sizeof(sim_data), size);
+
+complete:
+	response.fileId = sim_data.fileId;
+	response.bufLen = 0;
+
+	fake_sim_answer(sid, request, SIM_EVENT_UPDATE_FILE, status, &response, sizeof(response));
+}
+
+/*
+ * Looks for a record starting with the pattern, the RIL only uses the
+ * status of the answer.
+ */
+static void fake_sim_search(uint32_t sid, uint8_t *data, size_t length)
+{
+	simSearchRecord sim_data;
+	struct fake_sim_file *file;
+	uint8_t status = SIM_FILE_NOT_FOUND;
+	uint8_t *pattern;
+	int i;
+
+	if (length < sizeof(sim_data))
+		return;
+
+	memcpy(&sim_data, data, sizeof(sim_data));
+	pattern = data + sizeof(sim_data);
+
+	file = fake_sim_file_find(sim_data.fileId);
+	if (file == NULL || file->structure == FAKE_SIM_TRANSPARENT)
+		goto complete;
+
+	if (sim_data.recordSize > length - sizeof(sim_data) ||
+		sim_data.recordSize > (uint32_t) file->record_size) {
+		status = SIM_INCORRECT_PARAMS;
+		goto complete;
+	}
+
+	for (i = 0 ; i < file->records ; i++) {
+		if (memcmp(file->data + i * file->record_size, pattern, sim_data.recordSize) == 0) {
+			status = SIM_OK;
+			break;
+		}
+	}
+
+complete:
+	fake_sim_answer(sid, SIM_OEM_REQUEST_SEARCH_RECORD, SIM_EVENT_SEARCH_RECORD, status, NULL, 0);
+}
+
+/*
+ * Called with RIL_LOCK held, from ipc_send: only queues the answers.
+ */
+static void fake_sim_request(struct modem_io *frame)
+{
+	struct simPacketHeader *header;
+	struct oemSimPacketHeader oem_header;
+	uint8_t *data;
+	size_t length;
+
+	if (frame->datasize < sizeof(struct simPacketHeader) + sizeof(struct oemSimPacketHeader))
+		return;
+
+	// ATK packets, the RIL does not wait for their answers
+	header = (struct simPacketHeader *) frame->data;
+	if (header->type != 0)
+		return;
+
+	memcpy(&oem_header, frame->data + sizeof(struct simPacketHeader), sizeof(oem_header));
+	data = frame->data + sizeof(struct simPacketHeader) + sizeof(struct oemSimPacketHeader);
+	length = frame->datasize - sizeof(struct simPacketHeader) - sizeof(struct oemSimPacketHeader);
+	if (oem_header.oemBufLen < length)
+		length = oem_header.oemBufLen;
+
+	pthread_mutex_lock(&fake_sim.mutex);
+
+	if (oem_header.type < FAKE_SIM_REQUESTS)
+		fake_sim.stats.requests[oem_header.type]++;
+
+	switch (oem_header.type) {
+		case SIM_OEM_REQUEST_OPEN:
+		case SIM_OEM_REQUEST_GET_OPEN_DATA:
+			if (!fake_sim.inserted) {
+				fake_sim.open_pending = 1;
+				fake_sim.open_sid = oem_header.hSim;
+				fake_sim.open_request = oem_header.type;
+				break;
+			}
+
+			fake_sim_open(oem_header.hSim, oem_header.type);
+			break;
+		case SIM_OEM_REQUEST_GET_FILE_INFO:
+			fake_sim_file_info(oem_header.hSim, data, length);
+			break;
+		case SIM_OEM_REQUEST_READ_FILE_BINARY:
+		case SIM_OEM_REQUEST_READ_FILE_RECORD:
+			fake_sim_read(oem_header.hSim, oem_header.type, data, length);
+			break;
+		case SIM_OEM_REQUEST_UPDATE_FILE_BINARY:
+		case SIM_OEM_REQUEST_UPDATE_FILE_RECORD:
+			fake_sim_update(oem_header.hSim, oem_header.type, data, length);
+			break;
+		case SIM_OEM_REQUEST_SEARCH_RECORD:
+			fake_sim_search(oem_header.hSim, data, length);
+			break;
+		default:
+			break;
+	}
+
+	pthread_mutex_unlock(&fake_sim.mutex);
+}
+
+void fake_sim_init(void)
+{
+	pthread_mutex_lock(&fake_sim.mutex);
+	fake_sim.files_count = 0;
+	fake_sim.data_used = 0;
+	fake_sim.busy_until = 0;
+	fake_sim.inserted = 0;
+	fake_sim.open_pending = 0;
+	memset(fake_sim.latency, 0, sizeof(fake_sim.latency));
+	memset(&fake_sim.stats, 0, sizeof(fake_sim.stats));
+	pthread_mutex_unlock(&fake_sim.mutex);
+
+	fake_modem_register(FIFO_PKT_SIM, fake_sim_request);
+}
+
+/*
+ * Image parsing
+ */
+
+static const char *fake_sim_token(const char *p, const char **end)
+{
+	while (*p == ' ' || *p == '\t' || *p == '\r')
+		p++;
+
+	*end = p;
+	while (**end != '\0' && **end != '\n' && **end != ' ' && **end != '\t' && **end != '\r')
+		(*end)++;
+
+	return *end > p ? p : NULL;
+}
+
+static int fake_sim_number(const char *p, const char *end, int base)
+{
+	char *e;
+	long value;
+
+	if (p == NULL)
+		return -1;
+
+	value = strtol(p, &e, base);
+	if (e != end || value < 0 || value > 0xFFFF)
+		return -1;
+
+	return value;
+}
+
+/*
+ * Parses the line at p, returns the start of the next one or NULL.
+ * Called with the fake SIM mutex held.
+ */
+static const char *fake_sim_load_line(const char *p, int line)
+{
+	struct fake_sim_file *file;
+	const char *token;
+	const char *end;
+	int fileid;
+	int record;
+	int size;
+	int rc;
+
+	token = fake_sim_token(p, &end);
+	if (token == NULL || *token == '#')
+		goto next;
+
+	if (fake_sim.files_count >= FAKE_SIM_FILES)
+		goto error;
+
+	fileid = fake_sim_number(token, end, 16);
+	if (fileid < 0 || fake_sim_file_find(fileid) != NULL)
+		goto error;
+
+	file = &fake_sim.files[fake_sim.files_count];
+	memset(file, 0, sizeof(struct fake_sim_file));
+	file->fileid = fileid;
+
+	token = fake_sim_token(end, &end);
+	if (token == NULL || end - token != 1)
+		goto error;
+
+	switch (*token) {
+		case 't':
+			file->structure = FAKE_SIM_TRANSPARENT;
+			token = fake_sim_token(end, &end);
+			file->size = fake_sim_number(token, end, 10);
+			break;
+		case 'l':
+		case 'c':
+			file->structure = *token == 'l' ? FAKE_SIM_LINEAR_FIXED : FAKE_SIM_CYCLIC;
+			token = fake_sim_token(end, &end);
+			file->record_size = fake_sim_number(token, end, 10);
+			token = fake_sim_token(end, &end);
+			file->records = fake_sim_number(token, end, 10);
+			if (file->record_size <= 0 || file->record_size > 255 ||
+				file->records <= 0 || file->records > 255)
+				goto error;
+			file->size = file->record_size * file->records;
+			break;
+		default:
+			goto error;
+	}
+
+	if (file->size <= 0 || (size_t) file->size > sizeof(fake_sim.data) - fake_sim.data_used)
+		goto error;
+
+	file->data = fake_sim.data + fake_sim.data_used;
+	memset(file->data, 0xFF, file->size);
+
+	// One token for transparent files, one per record for the others
+	record = 0;
+	while ((token = fake_sim_token(end, &end)) != NULL) {
+		if (file->structure == FAKE_SIM_TRANSPARENT) {
+			if (record > 0)
+				goto error;
+			size = file->size;
+		} else {
+			if (record >= file->records)
+				goto error;
+			size = file->record_size;
+		}
+
+		rc = hex_decode(token, end - token, file->data + record * file->record_size, size);
+		if (rc < 0)
+			goto error;
+
+		record++;
+	}
+
+	fake_sim.data_used += file->size;
+	fake_sim.files_count++;
+
+	p = end;
+	goto next;
+
+error:
+	ALOGE("%s: Invalid file at line %d", __func__, line);
+	return NULL;
+
+next:
+	while (*p != '\0' && *p != '\n')
+		p++;
+
+	return *p == '\n' ? p + 1 : p;
+}
+
+/*
+ * Adds the files of an image, returns the number of files on the card.
+ */
+int fake_sim_load(const char *image)
+{
+	const char *p;
+	int count;
+	int line;
+
+	if (image == NULL)
+		return -1;
+
+	pthread_mutex_lock(&fake_sim.mutex);
+
+	p = image;
+	line = 1;
+	while (*p != '\0') {
+		p = fake_sim_load_line(p, line++);
+		if (p == NULL)
+			break;
+	}
+
+	count = p != NULL ? fake_sim.files_count : -1;
+
+	pthread_mutex_unlock(&fake_sim.mutex);
+
+	return count;
+}
+
+int fake_sim_load_file(const char *path)
+{
+	char *image = NULL;
+	FILE *file;
+	long size;
+	int rc = -1;
+
+	file = fopen(path, "r");
+	if (file == NULL)
+		return -1;
+
+	if (fseek(file, 0, SEEK_END) < 0)
+		goto complete;
+
+	size = ftell(file);
+	if (size < 0 || fseek(file, 0, SEEK_SET) < 0)
+		goto complete;
+
+	image = calloc(1, size + 1);
+	if (image == NULL)
+		goto complete;
+
+	if (fread(image, 1, size, file) != (size_t) size)
+		goto complete;
+
+	rc = fake_sim_load(image);
+
+complete:
+	if (image != NULL)
+		free(image);
+
+	fclose(file);
+
+	return rc;
+}
+
+/*
+ * Time the card takes to answer a SIM_OEM_REQUEST_*, in us.
+ */
+void fake_sim_latency(int request, unsigned int delay)
+{
+	if (request < 0 || request >= FAKE_SIM_REQUESTS)
+		return;
+
+	pthread_mutex_lock(&fake_sim.mutex);
+	fake_sim.latency[request] = delay;
+	pthread_mutex_unlock(&fake_sim.mutex);
+}
+
+/*
+ * Open requests wait for the card to be inserted, so that the harness
+ * decides when the SIM becomes ready.
+ */
+void fake_sim_insert(void)
+{
+	pthread_mutex_lock(&fake_sim.mutex);
+
+	fake_sim.inserted = 1;
+
+	if (fake_sim.open_pending) {
+		fake_sim.open_pending = 0;
+		fake_sim_open(fake_sim.open_sid, fake_sim.open_request);
+	}
+
+	pthread_mutex_unlock(&fake_sim.mutex);
+}
+
+void fake_sim_stats(struct fake_sim_stats *stats)
+{
+	if (stats == NULL)
+		return;
+
+	pthread_mutex_lock(&fake_sim.mutex);
+	memcpy(stats, &fake_sim.stats, sizeof(struct fake_sim_stats));
+	pthread_mutex_unlock(&fake_sim.mutex);
+}
@@ -0,0 +1,55 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FAKE_SIM_H_
+#define _FAKE_SIM_H_
+
+#include <sim.h>
+
+/*
+ * SIM card on the fake modem: answers the SIM OEM requests from an EF
+ * image, one request at a time like the card does, each taking the
+ * latency set for its request type.
+ *
+ * The image is text, one EF per line, data in hex and padded with 0xFF:
+ *   <fileid> t <size> [<data>]
+ *   <fileid> l <record size> <records> [<record> ...]
+ *   <fileid> c <record size> <records> [<record> ...]
+ * for transparent, linear fixed and cyclic files. Lines starting with
+ * '#' are comments.
+ */
+
+#define FAKE_SIM_FILES			64
+#define FAKE_SIM_DATA_SIZE		32768
+#define FAKE_SIM_REQUESTS		64
+
+struct fake_sim_stats {
+	unsigned int requests[FAKE_SIM_REQUESTS];
+	unsigned int answered;
+	unsigned int not_found;
+	unsigned long long busy;
+};
+
+void fake_sim_init(void);
+int fake_sim_load(const char *image);
+int fake_sim_load_file(const char *path);
+void fake_sim_latency(int request, unsigned int delay);
+void fake_sim_insert(void);
+void fake_sim_stats(struct fake_sim_stats *stats);
+
+#endif
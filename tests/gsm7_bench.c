@@ -0,0 +1,210 @@
+/**
+ * This file is part of libmocha-ipc.
+ *
+ * libmocha-ipc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libmocha-ipc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libmocha-ipc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "gsm7.h"
+
+/*
+ * GSM7 codec benchmark: gsm7_pack and gsm7_unpack against the per-septet
+ * shift loops of the ascii2gsm7 and gsm72ascii they replaced, run without
+ * their allocations. The old code had no septet offset, messages with a
+ * user data header were packed from offset 0 with the header septets
+ * prepended, which the shift loop is given here too.
+ */
+
+#define GSM7_BENCH_SEPTETS	168
+
+struct gsm7_bench_case {
+	const char *name;
+	size_t count;
+	size_t offset;
+};
+
+static const struct gsm7_bench_case gsm7_bench_cases[] = {
+	{ "short", 24, 0 },
+	{ "full", 160, 0 },
+	{ "udh", 153, 7 },
+};
+
+static volatile uint8_t gsm7_bench_sink;
+
+static unsigned long long gsm7_bench_time(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (unsigned long long) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void gsm7_bench_shift_pack(const uint8_t *septets, size_t count, uint8_t *packed)
+{
+	size_t size = GSM7_PACKED_SIZE(count);
+	int d_off, d_pos;
+	size_t i;
+
+	memset(packed, 0, size);
+
+	for (i = 0; i < count; i++) {
+		d_off = i % 8;
+		d_pos = (i * 7 + 7) / 8;
+
+		packed[d_pos] |= septets[i] >> d_off;
+		if (d_pos > 0)
+			packed[d_pos - 1] |= septets[i] << (8 - d_off);
+	}
+}
+
+static void gsm7_bench_shift_unpack(const uint8_t *packed, size_t size, uint8_t *septets)
+{
+	int t, u, d, o = 0;
+	size_t i;
+
+	memset(septets, 0, (size * 8) / 7 + 1);
+
+	for (i = 0; i < size; i++) {
+		d = 7 - i % 7;
+		if (d == 7 && i != 0)
+			o++;
+
+		t = packed[i] - (((packed[i] >> d) & 0xff) << d);
+		u = (packed[i] >> d) & 0xff;
+
+		septets[i + o] += t << (i + o) % 8;
+		if (u)
+			septets[i + 1 + o] += u;
+	}
+}
+
+static void gsm7_bench_report(const char *codec, const struct gsm7_bench_case *test,
+	unsigned int runs, unsigned long long time, unsigned long long base)
+{
+	if (time == 0)
+		time = 1;
+
+	printf("%-6s %-12s %7llu ns/msg %8llu Mseptets/s", test->name, codec,
+		time / runs, (unsigned long long) test->count * runs * 1000 / time);
+
+	if (base > 0)
+		printf("  x%llu.%02llu", base / time, base * 100 / time % 100);
+
+	printf("\n");
+}
+
+static void gsm7_bench_run(const struct gsm7_bench_case *test, unsigned int runs)
+{
+	uint8_t septets[GSM7_BENCH_SEPTETS];
+	uint8_t unpacked[GSM7_BENCH_SEPTETS + 8];
+	uint8_t packed[GSM7_PACKED_SIZE(GSM7_BENCH_SEPTETS)];
+	size_t total = test->offset + test->count;
+	size_t size = GSM7_PACKED_SIZE(total);
+	unsigned long long start;
+	unsigned long long shift;
+	unsigned long long time;
+	unsigned int i;
+
+	for (i = 0; i < total; i++)
+		septets[i] = (i * 37 + 11) & 0x7F;
+
+	// Both codecs must agree before they are timed
+	gsm7_bench_shift_pack(septets, total, unpacked);
+	if (gsm7_pack(septets + test->offset, test->count, test->offset, packed, sizeof(packed)) != size ||
+		memcmp(packed, unpacked, size) != 0 ||
+		gsm7_unpack(packed, size, test->offset, unpacked, test->count) != test->count ||
+		memcmp(unpacked, septets + test->offset, test->count) != 0) {
+		printf("%s: gsm7_pack and the shift loop disagree\n", test->name);
+		exit(1);
+	}
+
+	gsm7_bench_shift_unpack(packed, size, unpacked);
+	if (memcmp(unpacked, septets, total) != 0) {
+		printf("%s: gsm7_unpack and the shift loop disagree\n", test->name);
+		exit(1);
+	}
+
+	start = gsm7_bench_time();
+	for (i = 0; i < runs; i++) {
+		gsm7_bench_shift_pack(septets, total, packed);
+		gsm7_bench_sink = packed[i % size];
+	}
+	shift = gsm7_bench_time() - start;
+	gsm7_bench_report("pack shift", test, runs, shift, 0);
+
+	start = gsm7_bench_time();
+	for (i = 0; i < runs; i++) {
+		gsm7_pack(septets + test->offset, test->count, test->offset, packed, sizeof(packed));
+		gsm7_bench_sink = packed[i % size];
+	}
+	time = gsm7_bench_time() - start;
+	gsm7_bench_report("pack", test, runs, time, shift);
+
+	start = gsm7_bench_time();
+	for (i = 0; i < runs; i++) {
+		gsm7_bench_shift_unpack(packed, size, unpacked);
+		gsm7_bench_sink = unpacked[i % total];
+	}
+	shift = gsm7_bench_time() - start;
+	gsm7_bench_report("unpack shift", test, runs, shift, 0);
+
+	start = gsm7_bench_time();
+	for (i = 0; i < runs; i++) {
+		gsm7_unpack(packed, size, test->offset, unpacked, test->count);
+		gsm7_bench_sink = unpacked[i % test->count];
+	}
+	time = gsm7_bench_time() - start;
+	gsm7_bench_report("unpack", test, runs, time, shift);
+}
+
+static void gsm7_bench_usage(const char *name)
+{
+	printf("usage: %s [options]\n", name);
+	printf("  -n runs     messages packed and unpacked per case (100000)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int runs = 100000;
+	unsigned int i;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:h")) != -1) {
+		switch (c) {
+			case 'n':
+				runs = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				gsm7_bench_usage(argv[0]);
+				return c == 'h' ? 0 : 1;
+		}
+	}
+
+	if (runs == 0) {
+		gsm7_bench_usage(argv[0]);
+		return 1;
+	}
+
+	for (i = 0; i < sizeof(gsm7_bench_cases) / sizeof(gsm7_bench_cases[0]); i++)
+		gsm7_bench_run(&gsm7_bench_cases[i], runs);
+
+	return 0;
+}
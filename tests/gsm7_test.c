@@ -0,0 +1,184 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gsm7.h"
+
+#include "test.h"
+
+#define GSM7_TEST_RUNS		10000
+#define GSM7_TEST_SEPTETS	200
+
+/*
+ * Scalar reference: septet i takes bits 7 * i to 7 * i + 6 of the stream,
+ * least significant bit first.
+ */
+static void gsm7_test_reference(const uint8_t *septets, size_t count, size_t offset, uint8_t *packed)
+{
+	size_t bit;
+	size_t i;
+	int k;
+
+	for (i = 0; i < count; i++) {
+		for (k = 0; k < 7; k++) {
+			bit = (offset + i) * 7 + k;
+			if (septets[i] & (1 << k))
+				packed[bit / 8] |= 1 << (bit % 8);
+			else
+				packed[bit / 8] &= ~(1 << (bit % 8));
+		}
+	}
+
+	// Bits following the last septet are cleared
+	bit = (offset + count) * 7;
+	if (bit % 8)
+		packed[bit / 8] &= (1 << (bit % 8)) - 1;
+}
+
+static void gsm7_test_random(uint8_t *data, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		data[i] = rand() & 0xff;
+}
+
+/*
+ * Random septets at random offsets, over a random header: packing matches
+ * the reference, keeps the header bits, and unpacks to the same septets.
+ */
+static void gsm7_test_pack(void)
+{
+	uint8_t septets[GSM7_TEST_SEPTETS];
+	uint8_t unpacked[GSM7_TEST_SEPTETS];
+	uint8_t packed[GSM7_PACKED_SIZE(2 * GSM7_TEST_SEPTETS) + 1];
+	uint8_t expected[sizeof(packed)];
+	size_t offset;
+	size_t count;
+	size_t length;
+	size_t i;
+	int run;
+
+	for (run = 0; run < GSM7_TEST_RUNS; run++) {
+		offset = rand() % 16;
+		count = rand() % (GSM7_TEST_SEPTETS + 1);
+
+		gsm7_test_random(septets, count);
+		gsm7_test_random(packed, sizeof(packed));
+		memcpy(expected, packed, sizeof(packed));
+
+		for (i = 0; i < count; i++)
+			septets[i] &= 0x7f;
+
+		gsm7_test_reference(septets, count, offset, expected);
+
+		length = gsm7_pack(septets, count, offset, packed, sizeof(packed));
+		test_check(length == GSM7_PACKED_SIZE(offset + count));
+		test_check(memcmp(packed, expected, sizeof(packed)) == 0);
+
+		memset(unpacked, 0xff, sizeof(unpacked));
+		test_check(gsm7_unpack(packed, length, offset, unpacked, count) == count);
+		test_check(memcmp(unpacked, septets, count) == 0);
+	}
+}
+
+static void gsm7_test_pack_bounds(void)
+{
+	uint8_t septets[8] = { 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f };
+	uint8_t packed[8];
+	uint8_t unpacked[8];
+
+	// 8 septets take 7 bytes, the 8th byte is left alone
+	memset(packed, 0x5A, sizeof(packed));
+	test_check(gsm7_pack(septets, 8, 0, packed, 7) == 7);
+	test_check(packed[7] == 0x5A);
+
+	// Too small, nothing is written
+	memset(packed, 0x5A, sizeof(packed));
+	test_check(gsm7_pack(septets, 8, 0, packed, 6) == 0);
+	test_check(packed[0] == 0x5A);
+
+	test_check(gsm7_pack(septets, 8, 1, packed, 7) == 0);
+
+	// The high bit of the input is ignored
+	septets[0] = 0xC1;
+	test_check(gsm7_pack(septets, 1, 0, packed, sizeof(packed)) == 1);
+	test_check(packed[0] == 0x41);
+
+	test_check(gsm7_pack(septets, 0, 0, packed, sizeof(packed)) == 0);
+
+	// Unpacking past the end of the data
+	test_check(gsm7_unpack(packed, 7, 0, unpacked, 8) == 8);
+	test_check(gsm7_unpack(packed, 6, 0, unpacked, 8) == 0);
+	test_check(gsm7_unpack(packed, 7, 1, unpacked, 8) == 0);
+}
+
+static void gsm7_test_utf8(void)
+{
+	const uint8_t hello[] = { 0x48, 0x65, 0x6C, 0x6C, 0x6F, 0x00, 0x02 };
+	const uint8_t extension[] = { 0x1B, 0x65, 0x1B, 0x28, 0x1B, 0x29 };
+	const uint8_t accents[] = { 0x04, 0x05, 0x7F, 0x1E };
+	uint8_t septets[16];
+	int c;
+
+	test_check(utf8_to_gsm7("Hello@$", 7, septets, sizeof(septets)) == sizeof(hello));
+	test_check(memcmp(septets, hello, sizeof(hello)) == 0);
+
+	// Extension characters take an escape septet
+	test_check(utf8_to_gsm7("\xE2\x82\xAC{}", 5, septets, sizeof(septets)) == sizeof(extension));
+	test_check(memcmp(septets, extension, sizeof(extension)) == 0);
+
+	test_check(utf8_to_gsm7("\xC3\xA8\xC3\xA9\xC3\xA0\xC3\x9F", 8, septets, sizeof(septets)) == sizeof(accents));
+	test_check(memcmp(septets, accents, sizeof(accents)) == 0);
+
+	// Every ASCII letter and digit is its own septet
+	for (c = '0'; c <= 'z'; c++) {
+		char ascii = c;
+
+		if (!(c <= '9' || (c >= 'A' && c <= 'Z') || c >= 'a'))
+			continue;
+
+		test_check(utf8_to_gsm7(&ascii, 1, septets, sizeof(septets)) == 1);
+		test_check(septets[0] == c);
+	}
+
+	test_check(utf8_to_gsm7("", 0, septets, sizeof(septets)) == 0);
+
+	// Not in the alphabet, invalid or truncated UTF-8, no room
+	test_check(utf8_to_gsm7("`", 1, septets, sizeof(septets)) == -1);
+	test_check(utf8_to_gsm7("\xD0\x96", 2, septets, sizeof(septets)) == -1);
+	test_check(utf8_to_gsm7("\xC3", 1, septets, sizeof(septets)) == -1);
+	test_check(utf8_to_gsm7("\xC3\x28", 2, septets, sizeof(septets)) == -1);
+	test_check(utf8_to_gsm7("\xF0\x9F\x98\x80", 4, septets, sizeof(septets)) == -1);
+	test_check(utf8_to_gsm7("abc", 3, septets, 2) == -1);
+	test_check(utf8_to_gsm7("a{", 2, septets, 2) == -1);
+}
+
+int main(int argc, char *argv[])
+{
+	srand(argc > 1 ? atoi(argv[1]) : 1);
+
+	gsm7_test_pack();
+	gsm7_test_pack_bounds();
+	gsm7_test_utf8();
+
+	return test_result("gsm7_test");
+}
@@ -0,0 +1,164 @@
+/**
+ * This file is part of libmocha-ipc.
+ *
+ * libmocha-ipc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libmocha-ipc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libmocha-ipc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "hex.h"
+#include "test.h"
+
+/*
+ * Every size up to 9 bytes, so that hex_decode goes through its 4-byte
+ * loop zero to two times and ends with each tail length.
+ */
+static void hex_test_round_trip(void)
+{
+	uint8_t data[9];
+	uint8_t decoded[9];
+	char string[HEX_LENGTH(9)];
+	size_t size;
+	size_t i;
+	int rc;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i * 0x1D + 0xA5;
+
+	for (size = 0; size <= sizeof(data); size++) {
+		rc = hex_encode(data, size, string, sizeof(string));
+		test_check(rc == (int) size * 2);
+		test_check(hex_decode_size(string) == (int) size);
+
+		memset(decoded, 0, sizeof(decoded));
+		rc = hex_decode(string, strlen(string), decoded, sizeof(decoded));
+		test_check(rc == (int) size);
+		test_check(memcmp(decoded, data, size) == 0);
+
+		rc = hex_encode_upper(data, size, string, sizeof(string));
+		test_check(rc == (int) size * 2);
+
+		memset(decoded, 0, sizeof(decoded));
+		rc = hex_decode(string, strlen(string), decoded, sizeof(decoded));
+		test_check(rc == (int) size);
+		test_check(memcmp(decoded, data, size) == 0);
+	}
+}
+
+static void hex_test_encode(void)
+{
+	const uint8_t data[] = { 0x00, 0x0F, 0xA0, 0xFF };
+	char string[HEX_LENGTH(4)];
+
+	test_check(hex_encode(data, sizeof(data), string, sizeof(string)) == 8);
+	test_check(strcmp(string, "000fa0ff") == 0);
+
+	test_check(hex_encode_upper(data, sizeof(data), string, sizeof(string)) == 8);
+	test_check(strcmp(string, "000FA0FF") == 0);
+
+	test_check(hex_encode(data, 0, string, sizeof(string)) == 0);
+	test_check(string[0] == '\0');
+}
+
+static void hex_test_decode(void)
+{
+	const uint8_t expected[] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0xAB };
+	uint8_t data[9];
+
+	test_check(hex_byte("00") == 0x00);
+	test_check(hex_byte("aF") == 0xAF);
+	test_check(hex_byte("Fa") == 0xFA);
+	test_check(hex_byte("g0") == -1);
+	test_check(hex_byte("0g") == -1);
+
+	// Mixed case, through both the 4-byte loop and the tail
+	test_check(hex_decode("0123456789abcdefAB", 18, data, sizeof(data)) == 9);
+	test_check(memcmp(data, expected, sizeof(expected)) == 0);
+
+	// Only length digits are decoded
+	test_check(hex_decode("0123456789abcdefAB", 4, data, sizeof(data)) == 2);
+}
+
+static void hex_test_odd(void)
+{
+	uint8_t data[4];
+
+	test_check(hex_decode_size("123") == -1);
+	test_check(hex_decode_size("") == 0);
+	test_check(hex_decode_size(NULL) == -1);
+
+	test_check(hex_decode("123", 3, data, sizeof(data)) == -1);
+	test_check(hex_decode("1234567", 7, data, sizeof(data)) == -1);
+}
+
+/*
+ * A bad digit anywhere in the string, in the 4-byte loop or in the
+ * tail, fails the whole decode.
+ */
+static void hex_test_invalid(void)
+{
+	const char bad[] = { 'g', 'G', ' ', ':', '@', '`', 'x', '\x80', '\xFF' };
+	char string[HEX_LENGTH(9)];
+	uint8_t data[9];
+	size_t i, j;
+
+	for (i = 0; i < 18; i++) {
+		for (j = 0; j < sizeof(bad); j++) {
+			memset(string, '7', 18);
+			string[18] = '\0';
+			string[i] = bad[j];
+
+			test_check(hex_decode(string, 18, data, sizeof(data)) == -1);
+		}
+	}
+
+	test_check(hex_decode(NULL, 0, data, sizeof(data)) == -1);
+	test_check(hex_decode("00", 2, NULL, 0) == -1);
+}
+
+static void hex_test_short(void)
+{
+	const uint8_t data[] = { 0x12, 0x34, 0x56 };
+	char string[HEX_LENGTH(3)];
+	uint8_t decoded[4];
+
+	// A short output buffer is not written to
+	memset(decoded, 0x5A, sizeof(decoded));
+	test_check(hex_decode("11223344", 8, decoded, 3) == -1);
+	test_check(decoded[0] == 0x5A && decoded[3] == 0x5A);
+
+	test_check(hex_decode("11223344", 8, decoded, 4) == 4);
+
+	// The NUL needs room too
+	memset(string, 'z', sizeof(string));
+	test_check(hex_encode(data, sizeof(data), string, sizeof(string) - 1) == -1);
+	test_check(string[0] == 'z');
+	test_check(hex_encode_upper(data, sizeof(data), string, sizeof(string) - 1) == -1);
+
+	test_check(hex_encode(data, sizeof(data), string, sizeof(string)) == 6);
+}
+
+int main(int argc, char *argv[])
+{
+	hex_test_round_trip();
+	hex_test_encode();
+	hex_test_decode();
+	hex_test_odd();
+	hex_test_invalid();
+	hex_test_short();
+
+	return test_result("hex_test");
+}
@@ -0,0 +1,231 @@
+/**
+ * This file is part of libmocha-ipc.
+ *
+ * libmocha-ipc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libmocha-ipc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libmocha-ipc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "mocha-ril.h"
+
+/*
+ * Incoming PDU benchmark: times sms_deliver_pdu_build on mixes of the
+ * messages the modem delivers, each built from a fresh copy of the modem
+ * message as ipc_incoming_sms gets it.
+ */
+
+#define PDU_BENCH_TYPES		6
+
+struct pdu_bench_mix {
+	const char *name;
+	unsigned int weights[PDU_BENCH_TYPES];
+};
+
+static const char pdu_bench_text[] = "The quick brown fox jumps over the lazy dog. ";
+
+static const char *pdu_bench_type_names[PDU_BENCH_TYPES] = {
+	"short gsm7", "full gsm7", "ucs2", "concat gsm7", "8-bit", "status report",
+};
+
+/*
+ * Person to person traffic is mostly short texts, service traffic has
+ * more concatenated parts, binary messages and status reports.
+ */
+static const struct pdu_bench_mix pdu_bench_mixes[] = {
+	{ "personal", { 60, 15, 15, 10, 0, 0 } },
+	{ "service", { 15, 20, 5, 30, 10, 20 } },
+};
+
+static tapiNettextInfo pdu_bench_messages[PDU_BENCH_TYPES];
+static volatile char pdu_bench_sink;
+
+static unsigned long long pdu_bench_time(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (unsigned long long) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void pdu_bench_text_copy(uint8_t *body, size_t length)
+{
+	size_t i;
+
+	for (i = 0; i < length; i++)
+		body[i] = pdu_bench_text[i % (sizeof(pdu_bench_text) - 1)];
+}
+
+static void pdu_bench_messages_build(void)
+{
+	tapiNettextInfo *info;
+	int i;
+
+	for (i = 0; i < PDU_BENCH_TYPES; i++) {
+		info = &pdu_bench_messages[i];
+		memset(info, 0, sizeof(tapiNettextInfo));
+
+		strcpy(info->SMSC, "79037011111");
+		strcpy(info->szFromNumber, "46705012345");
+		info->TON_FromNumber = 1;
+		info->scTime = 1318946412;
+		info->time_zone = 8;
+	}
+
+	info = &pdu_bench_messages[0];
+	info->messageLength = 24;
+	pdu_bench_text_copy(info->messageBody, 24);
+
+	info = &pdu_bench_messages[1];
+	info->messageLength = 160;
+	pdu_bench_text_copy(info->messageBody, 160);
+
+	info = &pdu_bench_messages[2];
+	info->alphabetType = 3;
+	info->messageLength = 140;
+	for (i = 0; i < 70; i++) {
+		info->messageBody[i * 2] = 0x04;
+		info->messageBody[i * 2 + 1] = 0x10 + i % 0x20;
+	}
+
+	info = &pdu_bench_messages[3];
+	info->nUDH = 1;
+	info->messageLength = 5 + 153;
+	memcpy(info->messageBody, "\x00\x03\x2A\x02\x01", 5);
+	pdu_bench_text_copy(info->messageBody + 5, 153);
+
+	info = &pdu_bench_messages[4];
+	info->msgType = 0x10;
+	info->messageLength = 140;
+	for (i = 0; i < 140; i++)
+		info->messageBody[i] = i * 7;
+
+	info = &pdu_bench_messages[5];
+	info->dischargeTime = 1318946470;
+}
+
+/*
+ * Returns the time taken to build runs PDUs of the given types, in ns.
+ */
+static unsigned long long pdu_bench_run(const uint8_t *types, unsigned int runs)
+{
+	char pdu[RIL_SMS_PDU_SIZE];
+	tapiNettextInfo info;
+	unsigned long long start;
+	unsigned int i;
+	int length;
+
+	start = pdu_bench_time();
+
+	for (i = 0; i < runs; i++) {
+		memcpy(&info, &pdu_bench_messages[types[i]], sizeof(info));
+
+		length = sms_deliver_pdu_build(&info, pdu, sizeof(pdu));
+		if (length < 0) {
+			printf("Unable to build a %s PDU\n", pdu_bench_type_names[types[i]]);
+			exit(1);
+		}
+
+		pdu_bench_sink = pdu[length / 2];
+	}
+
+	return pdu_bench_time() - start;
+}
+
+static void pdu_bench_report(const char *name, unsigned int runs, unsigned long long time)
+{
+	if (time == 0)
+		time = 1;
+
+	printf("%-14s %6llu ns/msg %9llu msgs/s\n", name, time / runs,
+		(unsigned long long) runs * 1000000000ULL / time);
+}
+
+static void pdu_bench_usage(const char *name)
+{
+	printf("usage: %s [options]\n", name);
+	printf("  -n runs     PDUs built per type and per mix (100000)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const struct pdu_bench_mix *mix;
+	unsigned long long time;
+	unsigned int runs = 100000;
+	unsigned int total;
+	unsigned int i, j;
+	uint8_t *types;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:h")) != -1) {
+		switch (c) {
+			case 'n':
+				runs = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				pdu_bench_usage(argv[0]);
+				return c == 'h' ? 0 : 1;
+		}
+	}
+
+	if (runs == 0) {
+		pdu_bench_usage(argv[0]);
+		return 1;
+	}
+
+	types = calloc(runs, sizeof(uint8_t));
+	if (types == NULL)
+		return 1;
+
+	pdu_bench_messages_build();
+
+	for (i = 0; i < PDU_BENCH_TYPES; i++) {
+		memset(types, i, runs);
+		time = pdu_bench_run(types, runs);
+		pdu_bench_report(pdu_bench_type_names[i], runs, time);
+	}
+
+	// Mixes are drawn with a fixed seed, so that runs compare
+	srand(1);
+
+	for (i = 0; i < sizeof(pdu_bench_mixes) / sizeof(pdu_bench_mixes[0]); i++) {
+		mix = &pdu_bench_mixes[i];
+
+		total = 0;
+		for (j = 0; j < PDU_BENCH_TYPES; j++)
+			total += mix->weights[j];
+
+		for (j = 0; j < runs; j++) {
+			unsigned int draw = rand() % total;
+
+			types[j] = 0;
+			while (draw >= mix->weights[types[j]]) {
+				draw -= mix->weights[types[j]];
+				types[j]++;
+			}
+		}
+
+		time = pdu_bench_run(types, runs);
+		pdu_bench_report(mix->name, runs, time);
+	}
+
+	free(types);
+
+	return 0;
+}
@@ -0,0 +1,286 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mocha-ril.h"
+
+#include "fake_ril.h"
+#include "test.h"
+
+/*
+ * Incoming SMS PDUs, pinned against the output of the string based
+ * ipc_incoming_sms that sms_deliver_pdu_build replaced, with its lower
+ * case hex digits made upper case. Addresses have no '+', which the old
+ * code copied into the PDU.
+ */
+
+struct pdu_test_case {
+	const char *name;
+	void (*build)(tapiNettextInfo *info);
+	int request;
+	const char *pdu;
+};
+
+static const char pdu_test_text[] = "The quick brown fox jumps over the lazy dog. ";
+
+static void pdu_test_text_copy(uint8_t *body, size_t length)
+{
+	size_t i;
+
+	for (i = 0; i < length; i++)
+		body[i] = pdu_test_text[i % (sizeof(pdu_test_text) - 1)];
+}
+
+static void pdu_test_info(tapiNettextInfo *info)
+{
+	memset(info, 0, sizeof(tapiNettextInfo));
+
+	strcpy(info->SMSC, "79037011111");
+	strcpy(info->szFromNumber, "46705012345");
+	info->TON_FromNumber = 1;
+	info->scTime = 1318946412;
+	info->time_zone = 8;
+}
+
+static void pdu_test_gsm7(tapiNettextInfo *info)
+{
+	pdu_test_info(info);
+	info->messageLength = 11;
+	memcpy(info->messageBody, "Hello world", 11);
+}
+
+static void pdu_test_gsm7_full(tapiNettextInfo *info)
+{
+	pdu_test_info(info);
+	info->messageLength = 160;
+	pdu_test_text_copy(info->messageBody, 160);
+}
+
+static void pdu_test_gsm7_flash(tapiNettextInfo *info)
+{
+	pdu_test_info(info);
+	info->bFlash = 1;
+	info->messageLength = 5;
+	memcpy(info->messageBody, "Flash", 5);
+}
+
+static void pdu_test_gsm7_national(tapiNettextInfo *info)
+{
+	pdu_test_info(info);
+	info->SMSC[0] = '\0';
+	strcpy(info->szFromNumber, "0612345");
+	info->TON_FromNumber = 0;
+	info->messageLength = 2;
+	memcpy(info->messageBody, "Hi", 2);
+}
+
+static void pdu_test_gsm7_alphanumeric(tapiNettextInfo *info)
+{
+	pdu_test_info(info);
+	strcpy(info->szFromNumber, "Operator");
+	info->TON_FromNumber = 5;
+	info->messageLength = 9;
+	memcpy(info->messageBody, "Top up 10", 9);
+}
+
+static void pdu_test_ucs2(tapiNettextInfo *info)
+{
+	const uint8_t body[] = { 0x04, 0x1F, 0x04, 0x40, 0x04, 0x38, 0x04, 0x32, 0x04, 0x35, 0x04, 0x42, 0x00, 0x21 };
+
+	pdu_test_info(info);
+	info->alphabetType = 3;
+	info->messageLength = sizeof(body);
+	memcpy(info->messageBody, body, sizeof(body));
+}
+
+static void pdu_test_8bit(tapiNettextInfo *info)
+{
+	int i;
+
+	pdu_test_info(info);
+	info->msgType = 0x10;
+	info->messageLength = 140;
+	for (i = 0; i < 140; i++)
+		info->messageBody[i] = i * 7;
+}
+
+static void pdu_test_udh_gsm7(tapiNettextInfo *info)
+{
+	pdu_test_info(info);
+	info->nUDH = 1;
+	info->messageLength = 5 + 153;
+	memcpy(info->messageBody, "\x00\x03\x2A\x02\x01", 5);
+	pdu_test_text_copy(info->messageBody + 5, 153);
+}
+
+static void pdu_test_udh_gsm7_last(tapiNettextInfo *info)
+{
+	pdu_test_info(info);
+	info->nUDH = 1;
+	info->messageLength = 5 + 7;
+	memcpy(info->messageBody, "\x00\x03\x2A\x02\x02", 5);
+	memcpy(info->messageBody + 5, "The end", 7);
+}
+
+static void pdu_test_udh_ucs2(tapiNettextInfo *info)
+{
+	const uint8_t body[] = { 0x00, 0x03, 0x07, 0x02, 0x01, 0x04, 0x1F, 0x04, 0x40, 0x04, 0x38 };
+
+	pdu_test_info(info);
+	info->nUDH = 1;
+	info->alphabetType = 3;
+	info->messageLength = sizeof(body);
+	memcpy(info->messageBody, body, sizeof(body));
+}
+
+static void pdu_test_status_report(tapiNettextInfo *info)
+{
+	pdu_test_info(info);
+	info->dischargeTime = 1318946470;
+}
+
+static void pdu_test_status_report_failed(tapiNettextInfo *info)
+{
+	pdu_test_info(info);
+	info->dischargeTime = 1318950000;
+	info->statusReport = 1;
+}
+
+static const struct pdu_test_case pdu_test_cases[] = {
+	{ "gsm7", pdu_test_gsm7, RIL_UNSOL_RESPONSE_NEW_SMS,
+		"07919730071111F1040B916407052143F50000110181410021800BC8329BFD06"
+		"DDDF723619" },
+	{ "gsm7 full", pdu_test_gsm7_full, RIL_UNSOL_RESPONSE_NEW_SMS,
+		"07919730071111F1040B916407052143F5000011018141002180A054741914AF"
+		"A7C76B9058FEBEBB41E6371EA4AEB7E173D0DB5E9683E8E832881DD6E741E4F7"
+		"D905A2A2CBA0783D3D5E83C4F2F7DD0D32BFF12075BD0D9F83DEF6B21C444797"
+		"41ECB03E0F22BFCF2E10155D06C5EBE9F11A2496BFEF6E90F98D07A9EB6DF81C"
+		"F4B697E5203ABA0C6287F57910F97D7681A8E832285E4F8FD720B1FC7D7783CC"
+		"6F3C485D6FC3E7" },
+	{ "gsm7 flash", pdu_test_gsm7_flash, RIL_UNSOL_RESPONSE_NEW_SMS,
+		"07919730071111F1040B916407052143F5001011018141002180054676788E06" },
+	{ "gsm7 national", pdu_test_gsm7_national, RIL_UNSOL_RESPONSE_NEW_SMS,
+		"00040781602143F500001101814100218002C834" },
+	{ "gsm7 alphanumeric", pdu_test_gsm7_alphanumeric, RIL_UNSOL_RESPONSE_NEW_SMS,
+		"07919730071111F1040ED04F78591EA6BFE500001101814100218009D4371C54"
+		"87836230" },
+	{ "ucs2", pdu_test_ucs2, RIL_UNSOL_RESPONSE_NEW_SMS,
+		"07919730071111F1040B916407052143F50008110181410021800E041F044004"
+		"380432043504420021" },
+	{ "8-bit", pdu_test_8bit, RIL_UNSOL_RESPONSE_NEW_SMS,
+		"07919730071111F1440B916407052143F50004110181410021808C00070E151C"
+		"232A31383F464D545B626970777E858C939AA1A8AFB6BDC4CBD2D9E0E7EEF5FC"
+		"030A11181F262D343B424950575E656C737A81888F969DA4ABB2B9C0C7CED5DC"
+		"E3EAF1F8FF060D141B222930373E454C535A61686F767D848B9299A0A7AEB5BC"
+		"C3CAD1D8DFE6EDF4FB020910171E252C333A41484F565D646B727980878E959C"
+		"A3AAB1B8BFC6CD" },
+	{ "udh gsm7", pdu_test_udh_gsm7, RIL_UNSOL_RESPONSE_NEW_SMS,
+		"07919730071111F1440B916407052143F5000011018141002180A00500032A02"
+		"01A8E832285E4F8FD720B1FC7D7783CC6F3C485D6FC3E7A0B7BD2C07D1D16510"
+		"3BACCF83C8EFB30B44459741F17A7ABC0689E5EFBB1B647EE341EA7A1B3E07BD"
+		"ED6539888E2E83D8617D1E447E9F5D202ABA0C8AD7D3E335482C7FDFDD20F31B"
+		"0F52D7DBF039E86D2FCB41747419C40EEBF320F2FBEC0251D16550BC9E1EAF41"
+		"62F9FBEE0699DF" },
+	{ "udh gsm7 last", pdu_test_udh_gsm7_last, RIL_UNSOL_RESPONSE_NEW_SMS,
+		"07919730071111F1440B916407052143F50000110181410021800E0500032A02"
+		"02A8E832A8EC2603" },
+	{ "udh ucs2", pdu_test_udh_ucs2, RIL_UNSOL_RESPONSE_NEW_SMS,
+		"07919730071111F1440B916407052143F50008110181410021800C0500030702"
+		"01041F04400438" },
+	{ "status report", pdu_test_status_report, RIL_UNSOL_RESPONSE_NEW_SMS_STATUS_REPORT,
+		"07919730071111F106000B916407052143F51101814100218011018141100180"
+		"00" },
+	{ "status report failed", pdu_test_status_report_failed, RIL_UNSOL_RESPONSE_NEW_SMS_STATUS_REPORT,
+		"07919730071111F106000B916407052143F51101814100218011018151000080"
+		"01" },
+};
+
+static struct {
+	int request;
+	char pdu[RIL_SMS_PDU_SIZE];
+	size_t length;
+} pdu_test_unsolicited;
+
+static void pdu_test_on_unsolicited(int request, const void *data, size_t length)
+{
+	if (request != RIL_UNSOL_RESPONSE_NEW_SMS && request != RIL_UNSOL_RESPONSE_NEW_SMS_STATUS_REPORT)
+		return;
+
+	pdu_test_unsolicited.request = request;
+	pdu_test_unsolicited.length = length;
+	snprintf(pdu_test_unsolicited.pdu, sizeof(pdu_test_unsolicited.pdu), "%s", (const char *) data);
+}
+
+static struct fake_ril_handlers pdu_test_handlers = {
+	.unsolicited = pdu_test_on_unsolicited,
+};
+
+static void pdu_test_run(const struct pdu_test_case *test)
+{
+	tapiNettextInfo info;
+	char pdu[RIL_SMS_PDU_SIZE];
+	int length;
+
+	// The builder alone
+	test->build(&info);
+	length = sms_deliver_pdu_build(&info, pdu, sizeof(pdu));
+	test_check(length == (int) strlen(test->pdu));
+	test_check(length < 0 || strcmp(pdu, test->pdu) == 0);
+	if (length < 0 || strcmp(pdu, test->pdu) != 0)
+		printf("%s: got %s\n", test->name, length < 0 ? "nothing" : pdu);
+
+	// Too short by one byte
+	test_check(sms_deliver_pdu_build(&info, pdu, strlen(test->pdu)) == -1);
+
+	// The whole path, as the modem delivers it
+	memset(&pdu_test_unsolicited, 0, sizeof(pdu_test_unsolicited));
+
+	RIL_LOCK();
+	ipc_incoming_sms(&info);
+	RIL_UNLOCK();
+
+	test_check(pdu_test_unsolicited.request == test->request);
+	test_check(strcmp(pdu_test_unsolicited.pdu, test->pdu) == 0);
+	test_check(pdu_test_unsolicited.length == strlen(test->pdu));
+}
+
+int main(int argc, char *argv[])
+{
+	tapiNettextInfo info;
+	char pdu[RIL_SMS_PDU_SIZE];
+	unsigned int i;
+
+	if (fake_ril_init(&pdu_test_handlers) == NULL)
+		return 1;
+
+	for (i = 0; i < sizeof(pdu_test_cases) / sizeof(pdu_test_cases[0]); i++)
+		pdu_test_run(&pdu_test_cases[i]);
+
+	// Lengths the modem can't send
+	pdu_test_udh_gsm7(&info);
+	info.messageLength = 4;
+	test_check(sms_deliver_pdu_build(&info, pdu, sizeof(pdu)) == -1);
+
+	pdu_test_gsm7(&info);
+	info.messageLength = sizeof(info.messageBody) + 1;
+	test_check(sms_deliver_pdu_build(&info, pdu, sizeof(pdu)) == -1);
+
+	return test_result("pdu_test");
+}
@@ -0,0 +1,608 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "mocha-ril.h"
+#include "hex.h"
+
+#include "fake_modem.h"
+#include "fake_ril.h"
+#include "fake_sim.h"
+
+/*
+ * SIM boot replay: the whole RIL boots against the fake modem and SIM
+ * card. Once RIL_REQUEST_GET_SIM_STATUS reports the SIM ready, the
+ * SIM_IO requests the framework sends at boot are replayed: every file
+ * is requested at once, each one reads its header then its data, one
+ * request after the other. Reports the time from SIM ready until the
+ * framework and the RIL loaded their files, and the round trips it took.
+ */
+
+#define SIM_BOOT_BINARY		0
+#define SIM_BOOT_ALL		-1
+
+// Values from TS 11.11, as the framework sends them
+#define SIM_BOOT_READ_BINARY	0xB0
+#define SIM_BOOT_READ_RECORD	0xB2
+#define SIM_BOOT_GET_RESPONSE	0xC0
+#define SIM_BOOT_TRANSPARENT	0x00
+
+#define SIM_BOOT_TIMEOUT	30
+#define SIM_BOOT_RECORD_MODE	0x04
+#define SIM_BOOT_HEADER_SIZE	15
+
+struct sim_boot_file {
+	int fileid;
+	int records;
+};
+
+/* SIMRecords.fetchSimRecords, for a GSM SIM */
+static const struct sim_boot_file sim_boot_records[] = {
+	{ 0x2FE2, SIM_BOOT_BINARY },	/* EF_ICCID */
+	{ 0x6F40, 1 },			/* EF_MSISDN */
+	{ 0x6FC9, 1 },			/* EF_MBI */
+	{ 0x6FAD, SIM_BOOT_BINARY },	/* EF_AD */
+	{ 0x6FCA, 1 },			/* EF_MWIS */
+	{ 0x6F11, SIM_BOOT_BINARY },	/* EF_VOICE_MAIL_INDICATOR_CPHS */
+	{ 0x6FCB, 1 },			/* EF_CFIS */
+	{ 0x6F13, SIM_BOOT_BINARY },	/* EF_CFF_CPHS */
+	{ 0x6F46, SIM_BOOT_BINARY },	/* EF_SPN */
+	{ 0x6FCD, SIM_BOOT_BINARY },	/* EF_SPDI */
+	{ 0x6FC5, 1 },			/* EF_PNN */
+	{ 0x6F38, SIM_BOOT_BINARY },	/* EF_SST */
+	{ 0x6F16, SIM_BOOT_BINARY },	/* EF_INFO_CPHS */
+	{ 0x6F15, SIM_BOOT_BINARY },	/* EF_CSP_CPHS */
+};
+
+/* The phonebook and the messages, as the apps read them on first use */
+static const struct sim_boot_file sim_boot_apps[] = {
+	{ SIM_EF_ADN, SIM_BOOT_ALL },
+	{ SIM_EF_SMS, SIM_BOOT_ALL },
+};
+
+#define SIM_BOOT_FILES	(sizeof(sim_boot_records) / sizeof(sim_boot_records[0]) + \
+	sizeof(sim_boot_apps) / sizeof(sim_boot_apps[0]))
+
+/* EF_SPDI is left out, to have a file the framework does not find */
+static const char sim_boot_image[] =
+	"# fileid structure size data\n"
+	"2FE2 t 10 98101430121181157002\n"
+	"6F07 t 9 082943010000000010\n"
+	"6FAD t 4 00000002\n"
+	"6F46 t 17 004D6F636861\n"
+	"6F38 t 13 FF3FFF0F0F00003F0F300CF0\n"
+	"6F11 t 2 5555\n"
+	"6F13 t 2 5555\n"
+	"6F16 t 3 020000\n"
+	"6F15 t 18\n"
+	"6F40 l 28 2 FFFFFFFFFFFFFFFFFFFFFFFFFFFF07916407052143F5FFFFFFFFFFFF\n"
+	"6F4A l 13 10\n"
+	"6F42 l 40 1 FFFFFFFFFFFFFFFFFFFFFFFFFDFFFFFFFFFFFFFFFFFFFFFFFF07919730071111F1FFFFFFFF0000FF\n"
+	"6FC9 l 4 1 01000000\n"
+	"6FCA l 5 1 0000000000\n"
+	"6FCB l 16 1 0100\n"
+	"6FC5 l 24 1\n"
+	"6F3A l 30 100 "
+		"4D6F636861FFFFFFFFFFFFFFFFFFFFFF058110325476FFFFFFFFFFFFFFFF "
+		"566F6963656D61696CFFFFFFFFFFFFFF058121436587FFFFFFFFFFFFFFFF\n"
+	"6F3B l 30 10\n"
+	"6F3C l 176 10 "
+		"0307919730071111F1040B916407052143F50000110181410021800BC8329BFD06DDDF723619 "
+		"00 00 00 00 00 00 00 00 00\n";
+
+struct sim_boot_load {
+	const struct sim_boot_file *file;
+	int record;
+	int count;
+	int size;
+	int record_size;
+	int requests;
+	int failed;
+	int done;
+	int answered;
+	int sw1;
+	int sw2;
+	unsigned char header[SIM_BOOT_HEADER_SIZE];
+	int header_size;
+};
+
+static struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct sim_boot_load loads[SIM_BOOT_FILES];
+	int loads_count;
+	int status_changes;
+	int status_pending;
+	int ready;
+	unsigned long long status_time;
+	unsigned long long fetch_time;
+	unsigned long long loaded_time;
+	unsigned int requests;
+	unsigned int failed;
+} sim_boot = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static int sim_boot_status_token;
+
+#define SIM_BOOT_TOKEN_STATUS	((RIL_Token) &sim_boot_status_token)
+
+/*
+ * RIL_Env handlers, called with RIL_LOCK held: only record the answers
+ * for the main thread, as rild hands them to the framework.
+ */
+
+static void sim_boot_on_complete(RIL_Token t, RIL_Errno e, void *data, size_t length)
+{
+	RIL_CardStatus_v6 *card_status;
+	RIL_SIM_IO_Response *response;
+	struct sim_boot_load *load;
+	uintptr_t index;
+	int index_app;
+	int size;
+
+	pthread_mutex_lock(&sim_boot.mutex);
+
+	if (t == SIM_BOOT_TOKEN_STATUS) {
+		sim_boot.status_pending = 0;
+
+		card_status = (RIL_CardStatus_v6 *) data;
+		if (e != RIL_E_SUCCESS || card_status == NULL || length < sizeof(RIL_CardStatus_v6))
+			goto complete;
+
+		index_app = card_status->gsm_umts_subscription_app_index;
+		if (index_app >= 0 && index_app < RIL_CARD_MAX_APPS &&
+			card_status->applications[index_app].app_state == RIL_APPSTATE_READY)
+			sim_boot.ready = 1;
+
+		goto complete;
+	}
+
+	index = (uintptr_t) t - 1;
+	if (index >= (uintptr_t) sim_boot.loads_count)
+		goto complete;
+
+	load = &sim_boot.loads[index];
+	load->answered = 1;
+	load->sw1 = 0;
+	load->sw2 = 0;
+	load->header_size = 0;
+
+	response = (RIL_SIM_IO_Response *) data;
+	if (e != RIL_E_SUCCESS || response == NULL || length < sizeof(RIL_SIM_IO_Response))
+		goto complete;
+
+	load->sw1 = response->sw1;
+	load->sw2 = response->sw2;
+
+	// Only the header of the file is needed to go on
+	if (response->simResponse != NULL && load->record == 0) {
+		size = hex_decode(response->simResponse, strlen(response->simResponse),
+			load->header, sizeof(load->header));
+		load->header_size = size > 0 ? size : 0;
+	}
+
+complete:
+	pthread_cond_broadcast(&sim_boot.cond);
+	pthread_mutex_unlock(&sim_boot.mutex);
+}
+
+static void sim_boot_on_unsolicited(int request, const void *data, size_t length)
+{
+	if (request != RIL_UNSOL_RESPONSE_SIM_STATUS_CHANGED)
+		return;
+
+	pthread_mutex_lock(&sim_boot.mutex);
+	sim_boot.status_changes++;
+	sim_boot.status_time = fake_modem_time();
+	pthread_cond_broadcast(&sim_boot.cond);
+	pthread_mutex_unlock(&sim_boot.mutex);
+}
+
+static struct fake_ril_handlers sim_boot_handlers = {
+	.complete = sim_boot_on_complete,
+	.unsolicited = sim_boot_on_unsolicited,
+};
+
+/*
+ * Waits on the condition until the deadline, returns -1 once it passed.
+ * Called with the mutex held.
+ */
+static int sim_boot_wait(unsigned long long deadline)
+{
+	struct timespec timeout;
+
+	if (fake_modem_time() >= deadline)
+		return -1;
+
+	timeout.tv_sec = deadline / 1000000;
+	timeout.tv_nsec = deadline % 1000000 * 1000;
+	pthread_cond_timedwait(&sim_boot.cond, &sim_boot.mutex, &timeout);
+
+	return 0;
+}
+
+static void sim_boot_request(int index, int command, int p1, int p2, int p3)
+{
+	struct sim_boot_load *load = &sim_boot.loads[index];
+	RIL_SIM_IO_v6 sim_io;
+
+	memset(&sim_io, 0, sizeof(sim_io));
+	sim_io.command = command;
+	sim_io.fileid = load->file->fileid;
+	sim_io.path = "3F007F20";
+	sim_io.p1 = p1;
+	sim_io.p2 = p2;
+	sim_io.p3 = p3;
+
+	load->requests++;
+	sim_boot.requests++;
+
+	// Local answers complete before fake_ril_request returns
+	pthread_mutex_unlock(&sim_boot.mutex);
+	fake_ril_request(RIL_REQUEST_SIM_IO, &sim_io, sizeof(sim_io), (RIL_Token) (uintptr_t) (index + 1));
+	pthread_mutex_lock(&sim_boot.mutex);
+}
+
+/*
+ * Sends the next request of a file, or marks it done. Called with the
+ * mutex held.
+ */
+static void sim_boot_next(int index)
+{
+	struct sim_boot_load *load = &sim_boot.loads[index];
+	int structure;
+
+	load->answered = 0;
+
+	if (load->sw1 != 0x90) {
+		load->failed = 1;
+		sim_boot.failed++;
+		goto done;
+	}
+
+	// Header first
+	if (load->record == 0) {
+		if (load->header_size < SIM_BOOT_HEADER_SIZE) {
+			load->failed = 1;
+			sim_boot.failed++;
+			goto done;
+		}
+
+		load->size = (load->header[2] << 8) | load->header[3];
+		structure = load->header[13];
+		load->record_size = load->header[14];
+
+		if (load->file->records == SIM_BOOT_BINARY || structure == SIM_BOOT_TRANSPARENT) {
+			load->record = 1;
+			load->count = 1;
+			sim_boot_request(index, SIM_BOOT_READ_BINARY, 0, 0, load->size);
+			return;
+		}
+
+		if (load->record_size == 0)
+			goto done;
+
+		if (load->file->records == SIM_BOOT_ALL) {
+			load->record = 1;
+			load->count = load->size / load->record_size;
+		} else {
+			load->record = load->file->records;
+			load->count = load->record;
+		}
+
+		sim_boot_request(index, SIM_BOOT_READ_RECORD, load->record,
+			SIM_BOOT_RECORD_MODE, load->record_size);
+		return;
+	}
+
+	if (load->record < load->count) {
+		load->record++;
+		sim_boot_request(index, SIM_BOOT_READ_RECORD, load->record,
+			SIM_BOOT_RECORD_MODE, load->record_size);
+		return;
+	}
+
+done:
+	load->done = 1;
+}
+
+static void sim_boot_add(const struct sim_boot_file *files, int count)
+{
+	int i;
+
+	for (i = 0; i < count && sim_boot.loads_count < (int) SIM_BOOT_FILES; i++) {
+		memset(&sim_boot.loads[sim_boot.loads_count], 0, sizeof(struct sim_boot_load));
+		sim_boot.loads[sim_boot.loads_count].file = &files[i];
+		sim_boot.loads_count++;
+	}
+}
+
+/*
+ * Called with the mutex held.
+ */
+static int sim_boot_replay(unsigned long long deadline)
+{
+	int pending;
+	int i;
+
+	sim_boot.fetch_time = fake_modem_time();
+
+	// All the files are asked for at once, like the framework does
+	for (i = 0; i < sim_boot.loads_count; i++)
+		sim_boot_request(i, SIM_BOOT_GET_RESPONSE, 0, 0, SIM_BOOT_HEADER_SIZE);
+
+	while (1) {
+		pending = 0;
+
+		for (i = 0; i < sim_boot.loads_count; i++) {
+			if (sim_boot.loads[i].answered)
+				sim_boot_next(i);
+			if (!sim_boot.loads[i].done)
+				pending++;
+		}
+
+		if (pending == 0)
+			break;
+
+		// Answers may have come in while requests were sent
+		for (i = 0; i < sim_boot.loads_count; i++)
+			if (sim_boot.loads[i].answered)
+				break;
+		if (i < sim_boot.loads_count)
+			continue;
+
+		if (sim_boot_wait(deadline) < 0)
+			return -1;
+	}
+
+	sim_boot.loaded_time = fake_modem_time();
+
+	return 0;
+}
+
+static unsigned long long sim_boot_time(struct timeval *time)
+{
+	return (unsigned long long) time->tv_sec * 1000000 + time->tv_usec;
+}
+
+static void sim_boot_report(void)
+{
+	struct fake_modem_stats modem_stats;
+	struct fake_sim_stats sim_stats;
+	struct ril_sim_boot_stats boot_stats;
+	struct ril_sim_io_stats io_stats;
+	unsigned long long ready;
+	unsigned long long ril_loaded;
+	unsigned int file_requests = 0;
+	unsigned int i;
+
+	RIL_LOCK();
+	memcpy(&boot_stats, &ril_data.sim_boot_stats, sizeof(boot_stats));
+	memcpy(&io_stats, &ril_data.sim_io_stats, sizeof(io_stats));
+	RIL_UNLOCK();
+
+	fake_modem_stats(&modem_stats);
+	fake_sim_stats(&sim_stats);
+
+	ready = sim_boot_time(&boot_stats.start);
+	ril_loaded = sim_boot_time(&boot_stats.end);
+
+	printf("ril: files loaded %llu.%03llums after SIM ready\n",
+		(ril_loaded - ready) / 1000, (ril_loaded - ready) % 1000);
+	printf("framework: SIM status at +%llums, first request at +%llums, records loaded at +%llu.%03llums\n",
+		(sim_boot.status_time - ready) / 1000, (sim_boot.fetch_time - ready) / 1000,
+		(sim_boot.loaded_time - ready) / 1000, (sim_boot.loaded_time - ready) % 1000);
+	printf("framework: %d files, %u SIM_IO requests, %u files failed\n",
+		sim_boot.loads_count, sim_boot.requests, sim_boot.failed);
+	printf("ril: %u SIM_IO requests, %u answered locally, %u modem round trips, %u coalesced, %u in flight max\n",
+		boot_stats.framework, boot_stats.local, boot_stats.modem,
+		io_stats.coalesced, io_stats.inflight_max);
+
+	for (i = 0; i < FAKE_SIM_REQUESTS; i++)
+		if (i != SIM_OEM_REQUEST_OPEN && i != SIM_OEM_REQUEST_ATK_OPEN)
+			file_requests += sim_stats.requests[i];
+
+	printf("sim: %u open, %u file info, %u binary reads, %u record reads, %u updates, %u searches, %u not found\n",
+		sim_stats.requests[SIM_OEM_REQUEST_OPEN], sim_stats.requests[SIM_OEM_REQUEST_GET_FILE_INFO],
+		sim_stats.requests[SIM_OEM_REQUEST_READ_FILE_BINARY], sim_stats.requests[SIM_OEM_REQUEST_READ_FILE_RECORD],
+		sim_stats.requests[SIM_OEM_REQUEST_UPDATE_FILE_BINARY] + sim_stats.requests[SIM_OEM_REQUEST_UPDATE_FILE_RECORD],
+		sim_stats.requests[SIM_OEM_REQUEST_SEARCH_RECORD], sim_stats.not_found);
+	printf("sim: %u file requests, busy %llu.%03llums\n",
+		file_requests, sim_stats.busy / 1000, sim_stats.busy % 1000);
+	printf("modem: %u frames sent, %u received, %u dropped, queue depth max %u\n",
+		modem_stats.sent, modem_stats.received, modem_stats.dropped, modem_stats.depth_max);
+}
+
+static void sim_boot_usage(const char *name)
+{
+	printf("usage: %s [options]\n", name);
+	printf("  -f image    EF image to load instead of the built-in one\n");
+	printf("  -l latency  card latency for every request, in us (2000)\n");
+	printf("  -i latency  card latency for file info requests, in us\n");
+	printf("  -r latency  card latency for read requests, in us\n");
+	printf("  -w window   RIL SIM I/O window, overrides %s\n", RIL_SIM_IO_WINDOW_PROPERTY);
+	printf("  -a          also read EF_ADN and EF_SMS whole\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *image = NULL;
+	unsigned long long deadline;
+	unsigned int latency = 2000;
+	int info_latency = -1;
+	int read_latency = -1;
+	int window = 0;
+	int apps = 0;
+	int files;
+	int running;
+	int rc;
+	int c;
+	int i;
+
+	while ((c = getopt(argc, argv, "f:l:i:r:w:ah")) != -1) {
+		switch (c) {
+			case 'f':
+				image = optarg;
+				break;
+			case 'l':
+				latency = strtoul(optarg, NULL, 0);
+				break;
+			case 'i':
+				info_latency = atoi(optarg);
+				break;
+			case 'r':
+				read_latency = atoi(optarg);
+				break;
+			case 'w':
+				window = atoi(optarg);
+				break;
+			case 'a':
+				apps = 1;
+				break;
+			default:
+				sim_boot_usage(argv[0]);
+				return c == 'h' ? 0 : 1;
+		}
+	}
+
+	fake_sim_init();
+
+	for (i = 0; i < FAKE_SIM_REQUESTS; i++)
+		fake_sim_latency(i, latency);
+	if (info_latency >= 0)
+		fake_sim_latency(SIM_OEM_REQUEST_GET_FILE_INFO, info_latency);
+	if (read_latency >= 0) {
+		fake_sim_latency(SIM_OEM_REQUEST_READ_FILE_BINARY, read_latency);
+		fake_sim_latency(SIM_OEM_REQUEST_READ_FILE_RECORD, read_latency);
+	}
+
+	files = image != NULL ? fake_sim_load_file(image) : fake_sim_load(sim_boot_image);
+	if (files <= 0) {
+		fprintf(stderr, "Unable to load the SIM image\n");
+		return 1;
+	}
+
+	sim_boot_add(sim_boot_records, sizeof(sim_boot_records) / sizeof(sim_boot_records[0]));
+	if (apps)
+		sim_boot_add(sim_boot_apps, sizeof(sim_boot_apps) / sizeof(sim_boot_apps[0]));
+
+	if (fake_ril_init(&sim_boot_handlers) == NULL) {
+		fprintf(stderr, "RIL_Init failed\n");
+		return 1;
+	}
+
+	// The IPC client thread marks the client ready once it runs
+	while (1) {
+		RIL_LOCK();
+		rc = ril_modem_check();
+		RIL_UNLOCK();
+
+		if (rc == 0)
+			break;
+
+		usleep(1000);
+	}
+
+	// AMSS is up: the RIL opens the SIM, the card answers once inserted
+	fake_modem_queue(FIFO_PKT_SYSTEM, "S8500XXKL5", sizeof("S8500XXKL5"), 0);
+
+	while (1) {
+		RIL_LOCK();
+		rc = ril_data.state.power_state;
+		if (rc != POWER_STATE_OFF) {
+			// Set up by ril_sim_init, which ran with CP system start
+			if (window > 0)
+				ril_data.sim_io_window = window;
+			window = ril_data.sim_io_window;
+		}
+		RIL_UNLOCK();
+
+		if (rc != POWER_STATE_OFF)
+			break;
+
+		usleep(1000);
+	}
+
+	printf("%d files on the SIM, latency %uus, window %d%s\n", files, latency,
+		window, apps ? ", with the apps files" : "");
+
+	fake_sim_insert();
+
+	deadline = fake_modem_time() + SIM_BOOT_TIMEOUT * 1000000ULL;
+
+	// Framework side: card status on every change, until the SIM is ready
+	pthread_mutex_lock(&sim_boot.mutex);
+
+	while (!sim_boot.ready) {
+		if (sim_boot.status_changes > 0 && !sim_boot.status_pending) {
+			sim_boot.status_changes = 0;
+			sim_boot.status_pending = 1;
+
+			pthread_mutex_unlock(&sim_boot.mutex);
+			fake_ril_request(RIL_REQUEST_GET_SIM_STATUS, NULL, 0, SIM_BOOT_TOKEN_STATUS);
+			pthread_mutex_lock(&sim_boot.mutex);
+			continue;
+		}
+
+		if (sim_boot_wait(deadline) < 0)
+			goto timeout;
+	}
+
+	rc = sim_boot_replay(deadline);
+	if (rc < 0)
+		goto timeout;
+
+	pthread_mutex_unlock(&sim_boot.mutex);
+
+	// The RIL may still be loading its own files
+	while (1) {
+		RIL_LOCK();
+		running = ril_data.sim_boot_stats.running;
+		RIL_UNLOCK();
+
+		if (!running)
+			break;
+
+		if (fake_modem_time() >= deadline) {
+			fprintf(stderr, "Timed out waiting for the RIL SIM files\n");
+			return 1;
+		}
+
+		usleep(1000);
+	}
+
+	fake_modem_wait_idle();
+
+	sim_boot_report();
+
+	return 0;
+
+timeout:
+	pthread_mutex_unlock(&sim_boot.mutex);
+	fprintf(stderr, "Timed out waiting for the SIM\n");
+
+	return 1;
+}
@@ -0,0 +1,468 @@
+/**
+ * This file is part of mocha-ril.
+ *
+ * mocha-ril is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mocha-ril is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mocha-ril.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "mocha-ril.h"
+#include "gsm7.h"
+#include "hex.h"
+
+#include "fake_modem.h"
+#include "fake_ril.h"
+#include "fake_amss.h"
+
+/*
+ * SMS benchmark: the whole RIL runs against the fake modem, with the AMSS
+ * stand-in acknowledging sends after a configurable delay. Outgoing
+ * messages are timed from RIL_REQUEST_SEND_SMS to their completion, with
+ * up to depth requests outstanding, incoming ones from their delivery by
+ * the modem to RIL_UNSOL_RESPONSE_NEW_SMS.
+ */
+
+#define SMS_BENCH_SMSC		"07919730071111F1"
+#define SMS_BENCH_PDUS		4
+#define SMS_BENCH_PDU_SIZE	HEX_LENGTH(176)
+
+struct sms_bench_phase {
+	const char *name;
+	unsigned long long *latency;
+	unsigned int count;
+	unsigned int done;
+	unsigned int failed;
+	unsigned long long start;
+	unsigned long long end;
+	unsigned int allocs;
+};
+
+static struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct sms_bench_phase send;
+	struct sms_bench_phase receive;
+	unsigned long long *send_time;
+	unsigned long long *receive_time;
+	unsigned int outstanding;
+} sms_bench = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.send = { .name = "send" },
+	.receive = { .name = "receive" },
+};
+
+static char sms_bench_pdus[SMS_BENCH_PDUS][SMS_BENCH_PDU_SIZE];
+static tapiNettextInfo sms_bench_incoming[SMS_BENCH_PDUS + 1];
+
+/*
+ * Message mix
+ */
+
+static void sms_bench_text(uint8_t *septets, size_t count)
+{
+	static const char text[] = "the quick brown fox jumps over the lazy dog ";
+	size_t i;
+
+	// Lower case letters and spaces are the same in ASCII and GSM7
+	for (i = 0; i < count; i++)
+		septets[i] = text[i % (sizeof(text) - 1)];
+}
+
+static void sms_bench_submit(char *pdu, int udh, uint8_t dcs, const uint8_t *ud, size_t ud_size, size_t udl)
+{
+	uint8_t data[176];
+	size_t size = 0;
+
+	data[size++] = udh ? 0x41 : 0x01;
+	data[size++] = 0x00;
+	data[size++] = 0x0B;
+	data[size++] = 0x91;
+	memcpy(data + size, "\x64\x07\x05\x21\x43\xF5", 6);
+	size += 6;
+	data[size++] = 0x00;
+	data[size++] = dcs;
+	data[size++] = udl;
+	memcpy(data + size, ud, ud_size);
+	size += ud_size;
+
+	hex_encode_upper(data, size, pdu, SMS_BENCH_PDU_SIZE);
+}
+
+static void sms_bench_pdus_build(void)
+{
+	uint8_t septets[160];
+	uint8_t ud[140];
+	size_t size;
+	int i;
+
+	// Short GSM7
+	sms_bench_text(septets, 24);
+	size = gsm7_pack(septets, 24, 0, ud, sizeof(ud));
+	sms_bench_submit(sms_bench_pdus[0], 0, 0x00, ud, size, 24);
+
+	// Full GSM7
+	sms_bench_text(septets, 160);
+	size = gsm7_pack(septets, 160, 0, ud, sizeof(ud));
+	sms_bench_submit(sms_bench_pdus[1], 0, 0x00, ud, size, 160);
+
+	// Full UCS2
+	for (i = 0; i < 70; i++) {
+		ud[i * 2] = 0x04;
+		ud[i * 2 + 1] = 0x10 + i % 0x20;
+	}
+	sms_bench_submit(sms_bench_pdus[2], 0, 0x08, ud, 140, 140);
+
+	// First part of a concatenated GSM7 message
+	memset(ud, 0, sizeof(ud));
+	memcpy(ud, "\x05\x00\x03\x2A\x02\x01", 6);
+	sms_bench_text(septets, 153);
+	size = gsm7_pack(septets, 153, 7, ud, sizeof(ud));
+	sms_bench_submit(sms_bench_pdus[3], 1, 0x00, ud, size, 160);
+}
+
+static void sms_bench_incoming_build(void)
+{
+	tapiNettextInfo *info;
+	int i;
+
+	for (i = 0; i < SMS_BENCH_PDUS + 1; i++) {
+		info = &sms_bench_incoming[i];
+		memset(info, 0, sizeof(tapiNettextInfo));
+
+		info->TON_FromNumber = 1;
+		strcpy(info->szFromNumber, "+46705012345");
+		info->lengthFromNumber = strlen(info->szFromNumber);
+		strcpy(info->SMSC, "+79037011111");
+		info->lengthSMSC = strlen(info->SMSC);
+		info->scTime = 1300000000 + i;
+		info->time_zone = 4;
+	}
+
+	// Short GSM7
+	info = &sms_bench_incoming[0];
+	info->messageLength = 24;
+	sms_bench_text(info->messageBody, 24);
+
+	// Full GSM7
+	info = &sms_bench_incoming[1];
+	info->messageLength = 160;
+	sms_bench_text(info->messageBody, 160);
+
+	// Full UCS2
+	info = &sms_bench_incoming[2];
+	info->alphabetType = 3;
+	info->messageLength = 140;
+	for (i = 0; i < 70; i++) {
+		info->messageBody[i * 2] = 0x04;
+		info->messageBody[i * 2 + 1] = 0x10 + i % 0x20;
+	}
+
+	// 8-bit
+	info = &sms_bench_incoming[3];
+	info->msgType = 0x10;
+	info->messageLength = 140;
+	for (i = 0; i < 140; i++)
+		info->messageBody[i] = i;
+
+	// First part of a concatenated GSM7 message
+	info = &sms_bench_incoming[4];
+	info->nUDH = 1;
+	info->bUDHI = 1;
+	info->messageLength = 158;
+	memcpy(info->messageBody, "\x00\x03\x2A\x02\x01", 5);
+	sms_bench_text(info->messageBody + 5, 153);
+}
+
+/*
+ * RIL_Env handlers
+ */
+
+static void sms_bench_complete(RIL_Token t, RIL_Errno e, void *data, size_t length)
+{
+	unsigned int index = (unsigned int) (uintptr_t) t - 1;
+	struct sms_bench_phase *phase = &sms_bench.send;
+
+	pthread_mutex_lock(&sms_bench.mutex);
+
+	if (index < phase->count) {
+		phase->latency[phase->done] = fake_modem_time() - sms_bench.send_time[index];
+		if (e != RIL_E_SUCCESS)
+			phase->failed++;
+		phase->done++;
+		sms_bench.outstanding--;
+		pthread_cond_broadcast(&sms_bench.cond);
+	}
+
+	pthread_mutex_unlock(&sms_bench.mutex);
+}
+
+static void sms_bench_unsolicited(int request, const void *data, size_t length)
+{
+	struct sms_bench_phase *phase = &sms_bench.receive;
+
+	if (request != RIL_UNSOL_RESPONSE_NEW_SMS)
+		return;
+
+	pthread_mutex_lock(&sms_bench.mutex);
+
+	// Frames are dispatched in order, each one gives a single message
+	if (phase->done < phase->count) {
+		phase->latency[phase->done] = fake_modem_time() - sms_bench.receive_time[phase->done];
+		phase->done++;
+		pthread_cond_broadcast(&sms_bench.cond);
+	}
+
+	pthread_mutex_unlock(&sms_bench.mutex);
+}
+
+static struct fake_ril_handlers sms_bench_handlers = {
+	.complete = sms_bench_complete,
+	.unsolicited = sms_bench_unsolicited,
+};
+
+/*
+ * Phases
+ */
+
+static void sms_bench_wait(struct sms_bench_phase *phase)
+{
+	pthread_mutex_lock(&sms_bench.mutex);
+	while (phase->done < phase->count)
+		pthread_cond_wait(&sms_bench.cond, &sms_bench.mutex);
+	pthread_mutex_unlock(&sms_bench.mutex);
+
+	phase->end = fake_modem_time();
+}
+
+static void sms_bench_send(unsigned int depth)
+{
+	struct sms_bench_phase *phase = &sms_bench.send;
+	char *values[2];
+	unsigned int allocs;
+	unsigned int i;
+
+	values[0] = SMS_BENCH_SMSC;
+
+	allocs = fake_alloc_count();
+	phase->start = fake_modem_time();
+
+	for (i = 0; i < phase->count; i++) {
+		pthread_mutex_lock(&sms_bench.mutex);
+		while (sms_bench.outstanding >= depth)
+			pthread_cond_wait(&sms_bench.cond, &sms_bench.mutex);
+		sms_bench.outstanding++;
+		sms_bench.send_time[i] = fake_modem_time();
+		pthread_mutex_unlock(&sms_bench.mutex);
+
+		values[1] = sms_bench_pdus[i % SMS_BENCH_PDUS];
+		fake_ril_request(RIL_REQUEST_SEND_SMS, values, sizeof(values), (RIL_Token) (uintptr_t) (i + 1));
+	}
+
+	sms_bench_wait(phase);
+	fake_modem_wait_idle();
+
+	phase->allocs = fake_alloc_count() - allocs;
+}
+
+static void sms_bench_receive(unsigned int interval)
+{
+	struct sms_bench_phase *phase = &sms_bench.receive;
+	unsigned long long due;
+	unsigned int allocs;
+	unsigned int i;
+	int rc;
+
+	allocs = fake_alloc_count();
+	phase->start = fake_modem_time();
+
+	for (i = 0; i < phase->count; i++) {
+		// Keep the fake modem queue from filling up
+		if (i % (FAKE_MODEM_FRAMES / 2) == 0)
+			fake_modem_wait_idle();
+
+		pthread_mutex_lock(&sms_bench.mutex);
+		due = fake_modem_time() + interval;
+		sms_bench.receive_time[i] = due;
+		rc = fake_amss_incoming(&sms_bench_incoming[i % (SMS_BENCH_PDUS + 1)], interval);
+		pthread_mutex_unlock(&sms_bench.mutex);
+
+		if (rc < 0) {
+			fprintf(stderr, "Unable to queue incoming message %u\n", i);
+			exit(1);
+		}
+
+		if (interval > 0)
+			usleep(interval);
+	}
+
+	sms_bench_wait(phase);
+	fake_modem_wait_idle();
+
+	phase->allocs = fake_alloc_count() - allocs;
+}
+
+static int sms_bench_compare(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *) a;
+	unsigned long long y = *(const unsigned long long *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void sms_bench_report(struct sms_bench_phase *phase)
+{
+	unsigned long long total = 0;
+	unsigned long long time;
+	unsigned int i;
+
+	if (phase->count == 0)
+		return;
+
+	qsort(phase->latency, phase->count, sizeof(unsigned long long), sms_bench_compare);
+	for (i = 0; i < phase->count; i++)
+		total += phase->latency[i];
+
+	time = phase->end - phase->start;
+	if (time == 0)
+		time = 1;
+
+	printf("%s: %u messages (%u failed) in %llu.%03llums, %llu msgs/s\n",
+		phase->name, phase->count, phase->failed, time / 1000, time % 1000,
+		(unsigned long long) phase->count * 1000000 / time);
+	printf("%s: latency avg %lluus, p50 %lluus, p99 %lluus, max %lluus\n",
+		phase->name, total / phase->count, phase->latency[phase->count / 2],
+		phase->latency[phase->count * 99 / 100], phase->latency[phase->count - 1]);
+	printf("%s: %u allocations, %u.%02u per message\n",
+		phase->name, phase->allocs, phase->allocs / phase->count,
+		phase->allocs * 100 / phase->count % 100);
+}
+
+static void sms_bench_usage(const char *name)
+{
+	printf("usage: %s [options]\n", name);
+	printf("  -n count    messages sent and received (1000)\n");
+	printf("  -d delay    AMSS send acknowledgement delay, in us (1000)\n");
+	printf("  -i interval delay between incoming messages, in us (0)\n");
+	printf("  -w window   RIL send window, overrides %s\n", RIL_SMS_SEND_WINDOW_PROPERTY);
+	printf("  -p depth    outstanding RIL_REQUEST_SEND_SMS (1)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct fake_modem_stats modem_stats;
+	struct fake_amss_stats amss_stats;
+	unsigned int count = 1000;
+	unsigned int delay = 1000;
+	unsigned int interval = 0;
+	unsigned int depth = 1;
+	int window = 0;
+	int rc;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:d:i:w:p:h")) != -1) {
+		switch (c) {
+			case 'n':
+				count = strtoul(optarg, NULL, 0);
+				break;
+			case 'd':
+				delay = strtoul(optarg, NULL, 0);
+				break;
+			case 'i':
+				interval = strtoul(optarg, NULL, 0);
+				break;
+			case 'w':
+				window = atoi(optarg);
+				break;
+			case 'p':
+				depth = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				sms_bench_usage(argv[0]);
+				return c == 'h' ? 0 : 1;
+		}
+	}
+
+	if (count == 0 || depth == 0) {
+		sms_bench_usage(argv[0]);
+		return 1;
+	}
+
+	sms_bench.send.count = count;
+	sms_bench.receive.count = count;
+	sms_bench.send.latency = calloc(count, sizeof(unsigned long long));
+	sms_bench.receive.latency = calloc(count, sizeof(unsigned long long));
+	sms_bench.send_time = calloc(count, sizeof(unsigned long long));
+	sms_bench.receive_time = calloc(count, sizeof(unsigned long long));
+	if (sms_bench.send.latency == NULL || sms_bench.receive.latency == NULL ||
+		sms_bench.send_time == NULL || sms_bench.receive_time == NULL)
+		return 1;
+
+	sms_bench_pdus_build();
+	sms_bench_incoming_build();
+
+	fake_amss_init(delay);
+
+	if (fake_ril_init(&sms_bench_handlers) == NULL) {
+		fprintf(stderr, "RIL_Init failed\n");
+		return 1;
+	}
+
+	// The IPC client thread marks the client ready once it runs
+	while (1) {
+		RIL_LOCK();
+		rc = ril_modem_check();
+		RIL_UNLOCK();
+
+		if (rc == 0)
+			break;
+
+		usleep(1000);
+	}
+
+	if (window > 0) {
+		RIL_LOCK();
+		ril_data.sms_send_window = window;
+		RIL_UNLOCK();
+	}
+
+	printf("%u messages, send delay %uus, incoming interval %uus, window %d, depth %u\n",
+		count, delay, interval, ril_data.sms_send_window, depth);
+
+	sms_bench_send(depth);
+	sms_bench_report(&sms_bench.send);
+
+	sms_bench_receive(interval);
+	sms_bench_report(&sms_bench.receive);
+
+	fake_modem_stats(&modem_stats);
+	fake_amss_stats(&amss_stats);
+
+	printf("modem: %u frames sent, %u received, %u dropped, queue depth max %u\n",
+		modem_stats.sent, modem_stats.received, modem_stats.dropped, modem_stats.depth_max);
+	printf("amss: %u sent, %u acked, %u incoming, %u bursts\n",
+		amss_stats.sent, amss_stats.acked, amss_stats.incoming, amss_stats.bursts);
+	printf("ril: %u SMS in flight max, %u received, receive avg %uus, max %uus\n",
+		ril_data.sms_stats.inflight_max, ril_data.sms_stats.received,
+		ril_data.sms_stats.received ? ril_data.sms_stats.receive_time_total / ril_data.sms_stats.received : 0,
+		ril_data.sms_stats.receive_time_max);
+
+	return 0;
+}